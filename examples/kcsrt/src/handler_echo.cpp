@@ -22,7 +22,7 @@ void EchoHandler::run(const BoostPtree &request, BoostPtree &response)
 {
   kisscpp::LogStream log(__PRETTY_FUNCTION__);
 
-  kisscpp::StatsKeeper::instance()->increment("recieved");
+  kisscpp::StatsKeeper::instance()->increment(receivedStat);
 
   try {
     std::string message = request.get<std::string>("message");
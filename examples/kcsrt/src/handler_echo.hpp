@@ -38,6 +38,7 @@ class EchoHandler : public kisscpp::RequestHandler  /// Step 5. Derive your hand
                                                                           /// will cause this handler's run() method to be executed.
     {
       kisscpp::LogStream log(__PRETTY_FUNCTION__);
+      receivedStat = kisscpp::StatsKeeper::instance()->registerStat("recieved"); /// Register stats once, and update them through the handle.
     }
 
     ~EchoHandler() {};
@@ -45,6 +46,7 @@ class EchoHandler : public kisscpp::RequestHandler  /// Step 5. Derive your hand
     void run(const BoostPtree &request, BoostPtree &response); /// Step 6. You must override the run method from kisscpp::RequestHandler
   protected:
   private:
+    kisscpp::StatHandle receivedStat;
 };
 
 #endif
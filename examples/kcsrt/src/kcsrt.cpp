@@ -36,10 +36,11 @@ kcsrt::kcsrt(const std::string &instance,
   stats       = kisscpp::StatsKeeper::instance();
   errorStates = kisscpp::ErrorStateList::instance();
 
-  stats->setStatValue("recieved",0);
-  stats->setStatValue("sent"    ,0);
-  stats->setStatValue("success" ,0);
-  stats->setStatValue("fail"    ,0);
+  stats->registerStat("recieved"); // Listed from the start, also before anything was counted.
+  stats->registerStat("success" );
+
+  sentStat    = stats->registerStat("sent");
+  failStat    = stats->registerStat("fail");
 
   registerHandlers();
   threadGroup.create_thread(boost::bind(&kcsrt::sendingProcessor, this));
@@ -105,15 +106,15 @@ void kcsrt::sendingProcessor()
 
       log << kisscpp::manip::debug_normal << i_port << "->" << o_port << " : Sent             : " << messageCount << kisscpp::manip::endl;
 
-      stats->increment("sent");
+      stats->increment(sentStat);
 
     } catch(kisscpp::RetryableCommsFailure &e) {
       failCount++;
       log << kisscpp::manip::error_normal << i_port << "->" << o_port << " : Fail - Retryable : " << messageCount << kisscpp::manip::endl;
-      stats->increment("fail");
+      stats->increment(failStat);
     } catch(kisscpp::PerminantCommsFailure &e) {
       failCount++;
-      stats->increment("fail");
+      stats->increment(failStat);
       log << kisscpp::manip::error_normal << i_port << "->" << o_port << " : Fail - Perminant : " << messageCount << kisscpp::manip::endl;
     }
 
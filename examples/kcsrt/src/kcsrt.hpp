@@ -50,6 +50,8 @@ class kcsrt : public kisscpp::Server        /// Step 1: Derive your application'
     bool                       running;
     boost::thread_group        threadGroup;
     kisscpp::StatsKeeper      *stats;
+    kisscpp::StatHandle        sentStat;
+    kisscpp::StatHandle        failStat;
     kisscpp::ErrorStateList   *errorStates;
 };
 
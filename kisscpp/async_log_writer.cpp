@@ -0,0 +1,304 @@
+// File  : async_log_writer.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "async_log_writer.hpp"
+
+namespace kisscpp
+{
+  namespace
+  {
+    //--------------------------------------------------------------------------------
+    void writeAll(int fd, const std::string &data)
+    {
+      std::size_t written = 0;
+
+      while(written < data.size()) {
+        ssize_t rc = ::write(fd, data.data() + written, data.size() - written);
+
+        if(rc < 0 && errno == EINTR) { continue; }
+        if(rc <= 0)                  { return;   } // Nowhere to report it, the log is where we would.
+
+        written += rc;
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  AsyncLogWriter::AsyncLogWriter(const std::string   &path,
+                                 bool                 log2console,
+                                 std::size_t          queue_size,
+                                 log_overflow_policy  overflow_policy,
+                                 bool                 binary   /* = false */,
+                                 const LogRotation   &rotation /* = LogRotation() */) :
+    filePath       (path),
+    toConsole      (log2console),
+    overflowPolicy (overflow_policy),
+    binaryFormat   (binary),
+    rotator        (rotation),
+    fd             (-1),
+    ringMask       (0),
+    enqueuePos     (0),
+    dequeuePos     (0),
+    dropped        (0),
+    droppedReported(0),
+    reopenRequested(false),
+    writerSleeping (false),
+    stopping       (false)
+  {
+    std::size_t ring_size = 2;
+
+    while(ring_size < queue_size) {
+      ring_size *= 2;
+    }
+
+    ring.reset(new Cell[ring_size]);
+    ringMask = ring_size - 1;
+
+    for(std::size_t i = 0; i < ring_size; ++i) {
+      ring[i].sequence.store(i, boost::memory_order_relaxed);
+    }
+
+    writerThread = boost::thread(boost::bind(&AsyncLogWriter::run, this));
+  }
+
+  //--------------------------------------------------------------------------------
+  AsyncLogWriter::~AsyncLogWriter()
+  {
+    stopping.store(true);
+    wakeCondition.notify_one();
+    writerThread.join();
+
+    if(fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void AsyncLogWriter::push(std::string &line, bool flush)
+  {
+    if(tryPush(line)) {
+      if(flush || (enqueuePos.load(boost::memory_order_relaxed) - dequeuePos.load(boost::memory_order_relaxed)) > ringMask / 2) {
+        wakeWriter();
+      }
+      return;
+    }
+
+    if(overflowPolicy == LO_BLOCK) {
+      do {
+        wakeWriter();
+        boost::this_thread::yield();
+      } while(!tryPush(line));
+    } else {
+      dropped.fetch_add(1, boost::memory_order_relaxed);
+      wakeWriter();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void AsyncLogWriter::reopen()
+  {
+    reopenRequested.store(true);
+    wakeWriter();
+  }
+
+  //--------------------------------------------------------------------------------
+  log_overflow_policy AsyncLogWriter::toOverflowPolicy(const std::string &policy)
+  {
+    std::string p = boost::algorithm::to_lower_copy(policy);
+
+    if     (p == "block") { return LO_BLOCK; }
+    else if(p == "drop" ) { return LO_DROP;  }
+    else                  { return LO_COUNT; } // yes, this default to count is intentional
+  }
+
+  //--------------------------------------------------------------------------------
+  // A slot is free for the producer at position pos, when its sequence equals pos.
+  // It is published by setting the sequence to pos + 1.
+  bool AsyncLogWriter::tryPush(std::string &line)
+  {
+    std::size_t pos = enqueuePos.load(boost::memory_order_relaxed);
+    Cell       *cell;
+
+    while(true) {
+      cell = &ring[pos & ringMask];
+
+      std::size_t seq  = cell->sequence.load(boost::memory_order_acquire);
+      long        diff = static_cast<long>(seq) - static_cast<long>(pos);
+
+      if(diff == 0) {
+        if(enqueuePos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+          break;
+        }
+      } else if(diff < 0) {
+        return false;                                       // Full.
+      } else {
+        pos = enqueuePos.load(boost::memory_order_relaxed);
+      }
+    }
+
+    cell->line.swap(line);
+    cell->sequence.store(pos + 1, boost::memory_order_release);
+
+    return true;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Appends the next queued line to batch. Only called from the writer thread.
+  bool AsyncLogWriter::tryPop(std::string &batch)
+  {
+    std::size_t pos  = dequeuePos.load(boost::memory_order_relaxed);
+    Cell       *cell = &ring[pos & ringMask];
+
+    if(cell->sequence.load(boost::memory_order_acquire) != pos + 1) {
+      return false;                                         // Empty, or the producer is not done yet.
+    }
+
+    batch.append(cell->line);
+    if(!binaryFormat) {
+      batch.push_back('\n');
+    }
+
+    cell->line.clear();
+    cell->sequence.store(pos + ringMask + 1, boost::memory_order_release);
+    dequeuePos.store(pos + 1, boost::memory_order_relaxed);
+
+    return true;
+  }
+
+  //--------------------------------------------------------------------------------
+  void AsyncLogWriter::run()
+  {
+    std::string batch;
+
+    batch.reserve(ASYNC_LOG_MAX_BATCH_BYTES);
+
+    while(true) {
+      while(batch.size() < ASYNC_LOG_MAX_BATCH_BYTES && tryPop(batch)) {
+      }
+
+      bool full_batch = (batch.size() >= ASYNC_LOG_MAX_BATCH_BYTES);
+
+      writeOut(batch);
+      batch.clear();
+
+      if(full_batch) {
+        continue;
+      }
+
+      if(stopping.load()) {
+        if(enqueuePos.load() == dequeuePos.load(boost::memory_order_relaxed)) {
+          break;
+        }
+
+        boost::this_thread::yield();                        // A producer is still filling its slot.
+        continue;
+      }
+
+      boost::unique_lock<boost::mutex> lock(wakeMutex);
+
+      writerSleeping.store(true);
+
+      if(enqueuePos.load() == dequeuePos.load(boost::memory_order_relaxed) && !stopping.load() && !reopenRequested.load()) {
+        wakeCondition.timed_wait(lock, boost::posix_time::milliseconds(ASYNC_LOG_WRITE_INTERVAL_MS));
+      }
+
+      writerSleeping.store(false);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void AsyncLogWriter::writeOut(std::string &batch)
+  {
+    uint64_t dropped_now = dropped.load(boost::memory_order_relaxed);
+
+    if(overflowPolicy == LO_COUNT && dropped_now != droppedReported) {
+      std::stringstream summary;
+
+      summary << ": [" << (dropped_now - droppedReported) << "] log records dropped, the log queue was full.";
+
+      if(binaryFormat) {
+        BinaryLog::textRecord(batch, BinaryLog::now(), 7, "kisscpp::AsyncLogWriter", summary.str()); // 7: error low
+      } else {
+        batch.append(boost::posix_time::to_iso_string(boost::posix_time::microsec_clock::local_time()) + " [kisscpp::AsyncLogWriter] " + summary.str() + "\n");
+      }
+
+      droppedReported = dropped_now;
+    }
+
+    if(reopenRequested.exchange(false) && fd >= 0) {
+      ::close(fd);
+      fd = -1;
+    }
+
+    if(fd >= 0 && rotator.check(filePath, batch.size())) { // Checked while idle as well, so rotating by time is on time.
+      ::close(fd);
+      fd = -1;
+    }
+
+    if(batch.empty()) {
+      return;
+    }
+
+    if(fd < 0) {
+      fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+
+      if(fd >= 0) {
+        rotator.opened(filePath);
+      }
+
+      if(fd >= 0 && binaryFormat) {
+        std::string header;
+
+        BinaryLog::header(header);
+        writeAll(fd, header);
+        binaryDefinitions.reset();
+      }
+    }
+
+    if(fd >= 0 && binaryFormat) {
+      std::string out;
+
+      binaryDefinitions.prepare(batch, out);
+      writeAll(fd, out);
+      rotator.wrote(out.size());
+    } else if(fd >= 0) {
+      writeAll(fd, batch);
+      rotator.wrote(batch.size());
+    }
+
+    if(toConsole && !binaryFormat) {
+      writeAll(STDOUT_FILENO, batch);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void AsyncLogWriter::wakeWriter()
+  {
+    if(writerSleeping.load()) {
+      wakeCondition.notify_one();                           // Not holding wakeMutex: a missed wake up only costs one interval.
+    }
+  }
+}
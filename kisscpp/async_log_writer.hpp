@@ -0,0 +1,118 @@
+// File  : async_log_writer.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _ASYNC_LOG_WRITER_HPP_
+#define _ASYNC_LOG_WRITER_HPP_
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/scoped_array.hpp>
+#include "binary_log.hpp"
+#include "log_rotator.hpp"
+
+#define ASYNC_LOG_WRITE_INTERVAL_MS 100
+#define ASYNC_LOG_MAX_BATCH_BYTES   (1024 * 1024)
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  //! What to do with a log record when the queue to the writer thread is full.
+  enum log_overflow_policy {
+    LO_BLOCK = 0, //!< Wait for the writer thread to make room.
+    LO_DROP  = 1, //!< Discard the record.
+    LO_COUNT = 2  //!< Discard the record, and have the writer log how many were discarded.
+  };
+
+  //--------------------------------------------------------------------------------
+  // Writes log lines to a file on a dedicated thread.
+  //
+  // Threads that log, only push a formatted line into a bounded, lock-free ring
+  // (multiple producers, single consumer). The writer thread takes everything that
+  // is queued, and writes it with a single write(2). It wakes up every
+  // ASYNC_LOG_WRITE_INTERVAL_MS, when a record asks for a flush, or when the ring is
+  // half full.
+  //
+  // Does not log itself, LogStream is built on top of it.
+  class AsyncLogWriter
+  {
+    public:
+      AsyncLogWriter(const std::string   &path,
+                     bool                 log2console,
+                     std::size_t          queue_size,      // Rounded up to a power of 2.
+                     log_overflow_policy  overflow_policy,
+                     bool                 binary   = false,          // Records are binary log records, see binary_log.hpp.
+                     const LogRotation   &rotation = LogRotation());
+
+      ~AsyncLogWriter();                                   // Writes out everything still queued.
+
+      void     push          (std::string &line, bool flush); // line is swapped out, not copied. flush wakes the writer right away.
+      void     reopen        ();                           // Reopen the file before the next write, i.e. after it was rotated.
+
+      uint64_t droppedRecords() const { return dropped.load(boost::memory_order_relaxed); }
+
+      static log_overflow_policy toOverflowPolicy(const std::string &policy); // "block", "drop" or "count".
+
+    protected:
+    private:
+      AsyncLogWriter(const AsyncLogWriter&);
+      AsyncLogWriter& operator=(const AsyncLogWriter&);
+
+      struct Cell
+      {
+        boost::atomic<std::size_t> sequence;
+        std::string                line;
+      };
+
+      bool tryPush (std::string &line);
+      bool tryPop  (std::string &batch);                // Appends the line, and a newline (text only).
+      void run     ();
+      void writeOut(std::string &batch);
+      void wakeWriter();
+
+      std::string                 filePath;
+      bool                        toConsole;
+      log_overflow_policy         overflowPolicy;
+      bool                        binaryFormat;
+      BinaryLogDefinitions        binaryDefinitions;    // What the current file defines.
+      LogRotator                  rotator;
+      int                         fd;
+
+      boost::scoped_array<Cell>   ring;
+      std::size_t                 ringMask;
+      boost::atomic<std::size_t>  enqueuePos;
+      boost::atomic<std::size_t>  dequeuePos;           // Only advanced by the writer thread.
+
+      boost::atomic<uint64_t>     dropped;
+      uint64_t                    droppedReported;
+      boost::atomic<bool>         reopenRequested;
+      boost::atomic<bool>         writerSleeping;
+      boost::atomic<bool>         stopping;
+
+      boost::mutex                wakeMutex;
+      boost::condition_variable   wakeCondition;
+      boost::thread               writerThread;
+  };
+}
+
+#endif // _ASYNC_LOG_WRITER_HPP_
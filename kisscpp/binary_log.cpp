@@ -0,0 +1,444 @@
+// File  : binary_log.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <time.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <boost/atomic.hpp>
+#include "binary_log.hpp"
+
+namespace kisscpp
+{
+  namespace
+  {
+    boost::atomic<const char*> internedStrings[BINARY_LOG_MAX_STRINGS];
+    uint32_t                   processId = static_cast<uint32_t>(getpid()); // Not asked for every record: getpid() is a system call.
+
+    //--------------------------------------------------------------------------------
+    template<typename T>
+    void appendRaw(std::string &out, const T v)
+    {
+      out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    //--------------------------------------------------------------------------------
+    template<typename T>
+    T readRaw(const std::string &in, std::size_t &pos)
+    {
+      T v;
+
+      if(pos + sizeof(T) > in.size()) {
+        throw std::runtime_error("Truncated binary log record.");
+      }
+
+      std::memcpy(&v, in.data() + pos, sizeof(T));
+      pos += sizeof(T);
+
+      return v;
+    }
+
+    //--------------------------------------------------------------------------------
+    std::string readString(const std::string &in, std::size_t &pos)
+    {
+      uint32_t length = readRaw<uint32_t>(in, pos);
+
+      if(pos + length > in.size()) {
+        throw std::runtime_error("Truncated binary log record.");
+      }
+
+      pos += length;
+
+      return in.substr(pos - length, length);
+    }
+
+    //--------------------------------------------------------------------------------
+    void appendStringRef(std::string &out, const char *s)
+    {
+      uint32_t id = BinaryLog::intern(s);
+
+      appendRaw<uint32_t>(out, id);
+
+      if(id == BINARY_LOG_NO_ID) {                       // No ids left, the string goes along.
+        std::size_t length = std::strlen(s);
+
+        appendRaw<uint32_t>(out, static_cast<uint32_t>(length));
+        out.append(s, length);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::header(std::string &out)
+  {
+    out.append(BINARY_LOG_MAGIC, BINARY_LOG_MAGIC_LENGTH);
+    appendRaw<uint16_t>(out, BINARY_LOG_VERSION);
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::textRecord(std::string       &out,
+                             uint64_t           time,
+                             int                level,
+                             const std::string &source,
+                             const std::string &message)
+  {
+    std::size_t start = out.size();
+
+    appendRaw<uint32_t>(out, 0);
+    appendRaw<uint8_t> (out, BLR_TEXT);
+    appendRaw<uint32_t>(out, processId);
+    appendRaw<uint64_t>(out, time);
+    appendRaw<uint8_t> (out, static_cast<uint8_t>(level));
+    appendRaw<uint32_t>(out, static_cast<uint32_t>(source.size()));
+    out.append(source);
+    out.append(message);
+
+    uint32_t length = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t));
+    std::memcpy(&out[start], &length, sizeof(uint32_t));
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::beginEntry(std::string       &out,
+                             uint64_t           time,
+                             int                level,
+                             const char        *source,
+                             const std::string &source_str,
+                             const char        *format)
+  {
+    out.clear();
+    appendRaw<uint32_t>(out, 0);
+    appendRaw<uint8_t> (out, BLR_ENTRY);
+    appendRaw<uint32_t>(out, processId);
+    appendRaw<uint64_t>(out, time);
+    appendRaw<uint8_t> (out, static_cast<uint8_t>(level));
+
+    if(source != NULL) {
+      appendStringRef(out, source);
+    } else {
+      appendRaw<uint32_t>(out, BINARY_LOG_NO_ID);
+      appendRaw<uint32_t>(out, static_cast<uint32_t>(source_str.size()));
+      out.append(source_str);
+    }
+
+    appendStringRef(out, format);
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::addInt(std::string &out, int64_t v)
+  {
+    appendRaw<uint8_t>(out, BLA_INT);
+    appendRaw<int64_t>(out, v);
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::addUInt(std::string &out, uint64_t v)
+  {
+    appendRaw<uint8_t> (out, BLA_UINT);
+    appendRaw<uint64_t>(out, v);
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::addDouble(std::string &out, double v)
+  {
+    appendRaw<uint8_t>(out, BLA_DOUBLE);
+    appendRaw<double> (out, v);
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::addString(std::string &out, const std::string &v)
+  {
+    appendRaw<uint8_t> (out, BLA_STRING);
+    appendRaw<uint32_t>(out, static_cast<uint32_t>(v.size()));
+    out.append(v);
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::addString(std::string &out, const char *v)
+  {
+    std::size_t length = std::strlen(v);
+
+    appendRaw<uint8_t> (out, BLA_STRING);
+    appendRaw<uint32_t>(out, static_cast<uint32_t>(length));
+    out.append(v, length);
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::endRecord(std::string &out)
+  {
+    uint32_t length = static_cast<uint32_t>(out.size() - sizeof(uint32_t));
+    std::memcpy(&out[0], &length, sizeof(uint32_t));
+  }
+
+  //--------------------------------------------------------------------------------
+  // Open addressing on the pointer: a string is found where it was first put, or in
+  // one of the slots after it. Slots are only ever filled, never emptied.
+  uint32_t BinaryLog::intern(const char *s)
+  {
+    uint64_t h = (reinterpret_cast<uintptr_t>(s) >> 3) * 0x9E3779B97F4A7C15ULL;
+
+    for(uint32_t probe = 0; probe < BINARY_LOG_MAX_STRINGS; ++probe) {
+      uint32_t    slot     = static_cast<uint32_t>((h >> 32) + probe) & (BINARY_LOG_MAX_STRINGS - 1);
+      const char *existing = internedStrings[slot].load(boost::memory_order_acquire);
+
+      if(existing == s) {
+        return slot;
+      }
+
+      if(existing == NULL) {
+        if(internedStrings[slot].compare_exchange_strong(existing, s, boost::memory_order_acq_rel) || existing == s) {
+          return slot;
+        }
+      }
+    }
+
+    return BINARY_LOG_NO_ID;
+  }
+
+  //--------------------------------------------------------------------------------
+  const char *BinaryLog::lookup(uint32_t id)
+  {
+    return (id < BINARY_LOG_MAX_STRINGS) ? internedStrings[id].load(boost::memory_order_acquire) : NULL;
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLog::afterFork()
+  {
+    processId = static_cast<uint32_t>(getpid());
+  }
+
+  //--------------------------------------------------------------------------------
+  uint64_t BinaryLog::now(bool coarse /* = false */)
+  {
+    struct timespec ts;
+
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime((coarse) ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME, &ts);
+#else
+    clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+  }
+
+  //--------------------------------------------------------------------------------
+  std::string BinaryLog::formatTime(uint64_t time)
+  {
+    time_t    seconds = static_cast<time_t>(time / 1000000000ULL);
+    struct tm local;
+    char      text[32];
+
+    localtime_r(&seconds, &local);
+    std::size_t length = strftime(text, sizeof(text), "%Y%m%dT%H%M%S", &local);
+    std::snprintf(text + length, sizeof(text) - length, ".%06lu", static_cast<unsigned long>((time % 1000000000ULL) / 1000));
+
+    return text;
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLogDefinitions::reset()
+  {
+    written.assign(BINARY_LOG_MAX_STRINGS, false);
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLogDefinitions::define(uint32_t id, std::string &out)
+  {
+    const char *s = BinaryLog::lookup(id);
+
+    if(s == NULL || written[id]) {
+      return;
+    }
+
+    std::size_t length = std::strlen(s);
+
+    appendRaw<uint32_t>(out, static_cast<uint32_t>(sizeof(uint8_t) + 2 * sizeof(uint32_t) + length));
+    appendRaw<uint8_t> (out, BLR_STRING);
+    appendRaw<uint32_t>(out, processId);
+    appendRaw<uint32_t>(out, id);
+    out.append(s, length);
+
+    written[id] = true;
+  }
+
+  //--------------------------------------------------------------------------------
+  void BinaryLogDefinitions::prepare(const std::string &records, std::string &out)
+  {
+    std::size_t pos = 0;
+
+    while(pos + sizeof(uint32_t) + sizeof(uint8_t) <= records.size()) {
+      std::size_t start  = pos;
+      uint32_t    length = readRaw<uint32_t>(records, pos);
+      std::size_t end    = pos + length;
+
+      if(end > records.size()) {
+        break;
+      }
+
+      if(readRaw<uint8_t>(records, pos) == BLR_ENTRY) {
+        pos += sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t);
+
+        for(int ref = 0; ref < 2; ++ref) {               // source, then format.
+          uint32_t id = readRaw<uint32_t>(records, pos);
+
+          if(id == BINARY_LOG_NO_ID) {
+            pos += readRaw<uint32_t>(records, pos);
+          } else {
+            define(id, out);
+          }
+        }
+      }
+
+      out.append(records, start, end - start);
+      pos = end;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  std::string BinaryLogArg::toString() const
+  {
+    std::ostringstream ss;
+
+    switch(type) {
+      case BLA_INT   : ss << i; break;
+      case BLA_UINT  : ss << u; break;
+      case BLA_DOUBLE: ss << d; break;
+      case BLA_STRING:
+      default        : return s;
+    }
+
+    return ss.str();
+  }
+
+  //--------------------------------------------------------------------------------
+  bool BinaryLogReader::next(BinaryLogEntry &entry)
+  {
+    std::string record;
+
+    while(true) {
+      char length_bytes[sizeof(uint32_t)];
+
+      if(!input.read(length_bytes, sizeof(length_bytes))) {
+        return false;
+      }
+
+      if(std::memcmp(length_bytes, BINARY_LOG_MAGIC, sizeof(length_bytes)) == 0) {
+        char rest[BINARY_LOG_MAGIC_LENGTH - sizeof(uint32_t) + sizeof(uint16_t)];
+
+        if(!input.read(rest, sizeof(rest)) || std::memcmp(rest, BINARY_LOG_MAGIC + sizeof(uint32_t), BINARY_LOG_MAGIC_LENGTH - sizeof(uint32_t)) != 0) {
+          throw std::runtime_error("Not a binary log.");
+        }
+
+        uint16_t version;
+        std::memcpy(&version, rest + BINARY_LOG_MAGIC_LENGTH - sizeof(uint32_t), sizeof(version));
+
+        if(version != BINARY_LOG_VERSION) {
+          throw std::runtime_error("Unsupported binary log version.");
+        }
+
+        continue;                                        // Strings stay defined: other processes may write on after a reopen.
+
+      }
+
+      uint32_t length;
+      std::memcpy(&length, length_bytes, sizeof(length));
+
+      record.resize(length);
+
+      if(length == 0 || !input.read(&record[0], length)) {
+        throw std::runtime_error("Truncated binary log record.");
+      }
+
+      std::size_t pos  = 0;
+      uint8_t     type = readRaw<uint8_t> (record, pos);
+      uint64_t    pid  = readRaw<uint32_t>(record, pos);
+
+      if(type == BLR_STRING) {
+        uint32_t id = readRaw<uint32_t>(record, pos);
+        strings[(pid << 32) | id] = record.substr(pos);
+        continue;
+      }
+
+      if(type != BLR_TEXT && type != BLR_ENTRY) {
+        throw std::runtime_error("Unknown binary log record type.");
+      }
+
+      entry.time      = readRaw<uint64_t>(record, pos);
+      entry.pid       = static_cast<uint32_t>(pid);
+      entry.level     = readRaw<uint8_t> (record, pos);
+      entry.formatted = (type == BLR_ENTRY);
+      entry.format.clear();
+      entry.args.clear();
+
+      if(type == BLR_TEXT) {
+        entry.source  = readString(record, pos);
+        entry.message = record.substr(pos);
+        return true;
+      }
+
+      for(int ref = 0; ref < 2; ++ref) {
+        std::string &target = (ref == 0) ? entry.source : entry.format;
+        uint32_t     id     = readRaw<uint32_t>(record, pos);
+
+        if(id == BINARY_LOG_NO_ID) {
+          target = readString(record, pos);
+        } else {
+          std::map<uint64_t, std::string>::const_iterator it = strings.find((pid << 32) | id);
+          target = (it != strings.end()) ? it->second : "?";
+        }
+      }
+
+      while(pos < record.size()) {
+        BinaryLogArg arg;
+
+        arg.type = static_cast<binary_log_arg_type>(readRaw<uint8_t>(record, pos));
+        arg.i    = 0;
+        arg.u    = 0;
+        arg.d    = 0;
+
+        switch(arg.type) {
+          case BLA_INT   : arg.i = readRaw<int64_t> (record, pos); break;
+          case BLA_UINT  : arg.u = readRaw<uint64_t>(record, pos); break;
+          case BLA_DOUBLE: arg.d = readRaw<double>  (record, pos); break;
+          case BLA_STRING: arg.s = readString(record, pos);      break;
+          default        : throw std::runtime_error("Unknown binary log argument type.");
+        }
+
+        entry.args.push_back(arg);
+      }
+
+      std::size_t next_arg = 0;
+      std::size_t start    = 0;
+      std::size_t found;
+
+      entry.message.clear();
+
+      while((found = entry.format.find("{}", start)) != std::string::npos && next_arg < entry.args.size()) {
+        entry.message.append(entry.format, start, found - start);
+        entry.message.append(entry.args[next_arg++].toString());
+        start = found + 2;
+      }
+
+      entry.message.append(entry.format, start, std::string::npos);
+
+      return true;
+    }
+  }
+}
@@ -0,0 +1,155 @@
+// File  : binary_log.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _BINARY_LOG_HPP_
+#define _BINARY_LOG_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <istream>
+#include <stdint.h>
+
+#define BINARY_LOG_MAGIC        "KCPPBLOG"
+#define BINARY_LOG_MAGIC_LENGTH 8
+#define BINARY_LOG_VERSION      2
+#define BINARY_LOG_MAX_STRINGS  4096  // Distinct format strings and sources that get an id. Must be a power of 2.
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  // The binary log format.
+  //
+  // A file starts with BINARY_LOG_MAGIC and a uint16_t version, written every time
+  // the file is opened. Records follow, each a uint32_t length (of what follows it),
+  // a uint8_t binary_log_record_type, and the uint32_t pid of the process writing it:
+  //
+  //   BLR_STRING : uint32_t id, the string.
+  //   BLR_TEXT   : uint64_t time, uint8_t level, string source, the message.
+  //   BLR_ENTRY  : uint64_t time, uint8_t level, string-ref source, string-ref format,
+  //                then per argument a uint8_t binary_log_arg_type and its value.
+  //
+  // Time is in nanoseconds since the epoch. A string is a uint32_t length and the
+  // characters. A string-ref is a uint32_t id, defined by a BLR_STRING record of the
+  // same pid before it in the same file, or BINARY_LOG_NO_ID followed by a string.
+  // Everything is in host byte order. Pre-forked workers share a file, each with ids
+  // of its own, and write every record with a single write(), so records never mix.
+
+  enum binary_log_record_type {
+    BLR_STRING = 1,
+    BLR_TEXT   = 2,
+    BLR_ENTRY  = 3
+  };
+
+  enum binary_log_arg_type {
+    BLA_INT    = 1, // int64_t
+    BLA_UINT   = 2, // uint64_t
+    BLA_DOUBLE = 3, // double
+    BLA_STRING = 4  // string
+  };
+
+  const uint32_t BINARY_LOG_NO_ID = 0xFFFFFFFF;
+
+  //--------------------------------------------------------------------------------
+  // Builds binary log records.
+  class BinaryLog
+  {
+    public:
+      static void header    (std::string &out);
+      static void textRecord(std::string &out, uint64_t time, int level, const std::string &source, const std::string &message);
+      static void beginEntry(std::string &out, uint64_t time, int level, const char *source, const std::string &source_str, const char *format);
+      static void addInt    (std::string &out, int64_t            v);
+      static void addUInt   (std::string &out, uint64_t           v);
+      static void addDouble (std::string &out, double             v);
+      static void addString (std::string &out, const std::string &v);
+      static void addString (std::string &out, const char        *v);
+      static void endRecord (std::string &out);                 // Fills in the length of the record begun last.
+
+      // Strings with static storage (format strings, __PRETTY_FUNCTION__) are logged by id.
+      // The id is handed out the first time a string is seen, lock-free. BINARY_LOG_NO_ID once all are taken.
+      static uint32_t    intern(const char *s);
+      static const char *lookup(uint32_t id);
+
+      static void        afterFork  ();                          // In a forked child: records carry the pid, which changed.
+
+      static uint64_t    now        (bool coarse = false);      // Nanoseconds since the epoch.
+      static std::string formatTime (uint64_t time);            // Local time, like the text log: YYYYMMDDTHHMMSS.ffffff
+  };
+
+  //--------------------------------------------------------------------------------
+  // Adds the BLR_STRING records that entries refer to, the first time each id is
+  // used in a file. Used by whoever writes the file, so the file always defines
+  // what is in it, whatever was dropped or rotated.
+  class BinaryLogDefinitions
+  {
+    public:
+      BinaryLogDefinitions() : written(BINARY_LOG_MAX_STRINGS, false) {}
+
+      void reset  ();                                            // A new file was started.
+      void prepare(const std::string &records, std::string &out); // Appends records to out, with the definitions they need before them.
+
+    private:
+      void define(uint32_t id, std::string &out);
+
+      std::vector<bool> written;
+  };
+
+  //--------------------------------------------------------------------------------
+  struct BinaryLogArg
+  {
+    binary_log_arg_type type;
+    int64_t             i;
+    uint64_t            u;
+    double              d;
+    std::string         s;
+
+    std::string toString() const;
+  };
+
+  struct BinaryLogEntry
+  {
+    uint64_t                  time;
+    uint32_t                  pid;
+    int                       level;
+    bool                      formatted;  // A BLR_ENTRY, false for a BLR_TEXT.
+    std::string               source;
+    std::string               format;
+    std::vector<BinaryLogArg> args;
+    std::string               message;    // The format, with {} replaced by the arguments, or the text.
+  };
+
+  //--------------------------------------------------------------------------------
+  // Reads a binary log back. Throws std::runtime_error when the input is not one.
+  class BinaryLogReader
+  {
+    public:
+      explicit BinaryLogReader(std::istream &in) : input(in) {}
+
+      bool next(BinaryLogEntry &entry);   // false at the end of the input.
+
+    private:
+      BinaryLogReader(const BinaryLogReader&);
+      BinaryLogReader& operator=(const BinaryLogReader&);
+
+      std::istream                    &input;
+      std::map<uint64_t, std::string>  strings;   // By pid and id.
+  };
+}
+
+#endif // _BINARY_LOG_HPP_
@@ -60,7 +60,7 @@ namespace kisscpp
 
       write_json(ss, request_, false);
 
-      log << manip::debug_normal << "Sending JSON request: " << ss.str() << endl;
+      KISSCPP_DEBUG(log, LS_NORMAL) << "Sending JSON request: " << ss.str() << endl;
 
       request_stream << ss.str();
 
@@ -105,11 +105,11 @@ namespace kisscpp
 
       std::getline(raw_request_, ts, '\n');
 
-      log << manip::debug_normal << "Raw socket read : " << ts << endl;
+      KISSCPP_DEBUG(log, LS_NORMAL) << "Raw socket read : " << ts << endl;
       
       ss << ts;
 
-      log << manip::debug_normal << "Done reading from socket." << endl;
+      KISSCPP_DEBUG(log, LS_NORMAL) << "Done reading from socket." << endl;
 
       read_json(ss, *response_);
 
@@ -130,7 +130,7 @@ namespace kisscpp
         }
       } else {
         timeout_timer_.cancel();
-        log << manip::debug_normal << "Excellent!" << endl;
+        KISSCPP_DEBUG(log, LS_NORMAL) << "Excellent!" << endl;
       }
 
     } else {
@@ -0,0 +1,135 @@
+// File  : client_white_list.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include "client_white_list.hpp"
+
+namespace kisscpp
+{
+  const int ClientWhiteList::NOT_FOUND;
+
+  //--------------------------------------------------------------------------------
+  ClientWhiteList::ClientWhiteList() :
+    slots    (1, NOT_FOUND),
+    slot_mask(0)
+  {
+  }
+
+  //--------------------------------------------------------------------------------
+  void ClientWhiteList::addApplication(const std::string &app_id, bool all_instances)
+  {
+    int interned_id = intern(app_id);
+    applications[interned_id].all_instances = applications[interned_id].all_instances || all_instances;
+  }
+
+  //--------------------------------------------------------------------------------
+  void ClientWhiteList::addInstance(const std::string &app_id, const std::string &instance_id)
+  {
+    applications[intern(app_id)].instances.push_back(instance_id);
+  }
+
+  //--------------------------------------------------------------------------------
+  // Sorts the instance lists, and builds the hash table at a load factor of at most a half.
+  void ClientWhiteList::compile()
+  {
+    std::size_t slot_count = 2;
+
+    while(slot_count < applications.size() * 2) {
+      slot_count *= 2;
+    }
+
+    slots.assign(slot_count, NOT_FOUND);
+    slot_mask = slot_count - 1;
+
+    for(std::size_t i = 0; i < applications.size(); ++i) {
+      std::vector<std::string> &instances = applications[i].instances;
+
+      std::sort(instances.begin(), instances.end());
+      instances.erase(std::unique(instances.begin(), instances.end()), instances.end());
+
+      std::size_t slot = applications[i].hash & slot_mask;
+
+      while(slots[slot] != NOT_FOUND) {
+        slot = (slot + 1) & slot_mask;
+      }
+
+      slots[slot] = static_cast<int>(i);
+    }
+
+    interned_ids.clear();
+  }
+
+  //--------------------------------------------------------------------------------
+  int ClientWhiteList::findApplication(const std::string &app_id) const
+  {
+    std::size_t hash = boost::hash<std::string>()(app_id);
+    std::size_t slot = hash & slot_mask;
+
+    while(slots[slot] != NOT_FOUND) {
+      const Application &application = applications[slots[slot]];
+
+      if(application.hash == hash && application.id == app_id) {
+        return slots[slot];
+      }
+
+      slot = (slot + 1) & slot_mask;
+    }
+
+    return NOT_FOUND;
+  }
+
+  //--------------------------------------------------------------------------------
+  bool ClientWhiteList::isAllowed(int interned_id, const std::string &instance_id) const
+  {
+    if(interned_id < 0 || static_cast<std::size_t>(interned_id) >= applications.size()) {
+      return false;
+    }
+
+    const Application &application = applications[interned_id];
+
+    return (application.all_instances || std::binary_search(application.instances.begin(), application.instances.end(), instance_id));
+  }
+
+  //--------------------------------------------------------------------------------
+  bool ClientWhiteList::isAllowed(const std::string &app_id, const std::string &instance_id) const
+  {
+    return isAllowed(findApplication(app_id), instance_id);
+  }
+
+  //--------------------------------------------------------------------------------
+  int ClientWhiteList::intern(const std::string &app_id)
+  {
+    std::map<std::string, int>::iterator itr = interned_ids.find(app_id);
+
+    if(itr != interned_ids.end()) {
+      return itr->second;
+    }
+
+    Application application;
+
+    application.id            = app_id;
+    application.hash          = boost::hash<std::string>()(app_id);
+    application.all_instances = false;
+
+    applications.push_back(application);
+
+    return (interned_ids[app_id] = static_cast<int>(applications.size() - 1));
+  }
+}
@@ -0,0 +1,72 @@
+// File  : client_white_list.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _CLIENT_WHITE_LIST_HPP_
+#define _CLIENT_WHITE_LIST_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  // The application white-list, compiled for lookups: every application id is
+  // interned into an index into a vector, found through a flat, open addressing
+  // hash table. The allowed instances of an application are kept sorted.
+  //
+  // Built once per configuration snapshot, and never modified after that.
+  class ClientWhiteList
+  {
+    public:
+      static const int NOT_FOUND = -1;
+
+      ClientWhiteList();
+
+      void addApplication(const std::string &app_id, bool all_instances);  // Adding an application twice, merges the two.
+      void addInstance   (const std::string &app_id, const std::string &instance_id);
+      void compile       ();                                                // Call once all applications were added, before any lookups.
+
+      int  findApplication(const std::string &app_id) const;              // Interned id of app_id, or NOT_FOUND.
+      bool isAllowed      (int interned_id, const std::string &instance_id) const;
+      bool isAllowed      (const std::string &app_id, const std::string &instance_id) const;
+
+      std::size_t size() const throw() { return applications.size(); }
+
+    protected:
+    private:
+      struct Application
+      {
+        std::string              id;
+        std::size_t              hash;
+        bool                     all_instances;
+        std::vector<std::string> instances;
+      };
+
+      int  intern(const std::string &app_id);
+
+      std::vector<Application> applications;
+      std::vector<int>         slots;        // Indexes into applications, NOT_FOUND for empty slots.
+      std::size_t              slot_mask;
+      std::map<std::string, int> interned_ids; // Only used while building.
+  };
+}
+
+#endif // _CLIENT_WHITE_LIST_HPP_
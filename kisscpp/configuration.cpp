@@ -63,54 +63,94 @@ namespace kisscpp
         << "] and common ["                             << config_path_common
         << kisscpp::manip::flush;
 
-    loadConfig();
+    publish(loadConfig());
   }
 
   //--------------------------------------------------------------------------------
-  bool Config::isAllowedIp(const std::string &ip_address)
+  void Config::reload()
   {
-    bool retval = false;
+    kisscpp::LogStream log(__PRETTY_FUNCTION__);
 
-    if(allow_all_ip_addrs) {
-      retval = true;
-    } else {
-      retval = (comms_white_list_ip_addrs.find(ip_address) != comms_white_list_ip_addrs.end());
-    }
+    log << kisscpp::manip::info_normal
+        << "Reloading configuration for instance [" << config_path_instance
+        << "] and common ["                         << config_path_common << "]"
+        << kisscpp::manip::flush;
 
-    return retval;
+    publish(loadConfig());
+
+    log << kisscpp::manip::info_normal
+        << "Configuration generation [" << snapshot()->getGeneration() << "] is now in use."
+        << kisscpp::manip::flush;
   }
 
   //--------------------------------------------------------------------------------
-  bool Config::isAllowedClient(const std::string &app_id, const std::string &app_instance)
+  // Readers do not tell when they are done with a snapshot, so the replaced one is
+  // kept instead of deleted. Reloads are an operator's doing, a handful over the
+  // life of a process, which makes that cheaper than counting every reader.
+  void Config::publish(ConfigSnapshot *snap)
   {
-    bool retval = false;
+    boost::mutex::scoped_lock  lock(reload_mutex);
+    const ConfigSnapshot      *previous = current_snapshot.load(boost::memory_order_relaxed);
 
-    if(allow_all_applications) {
-      retval = true;
-    } else if (comms_white_list_applications.find(app_id) != comms_white_list_applications.end()) {
-      retval = ((comms_white_list_applications[app_id]).isAllowedInstance(app_instance));
+    snap->generation = (previous) ? previous->generation + 1 : 1;
+
+    current_snapshot.store(snap, boost::memory_order_release);
+
+    if(previous) {
+      retired.push_back(previous);
     }
+  }
 
-    return retval;
+  //--------------------------------------------------------------------------------
+  bool ConfigSnapshot::isAllowedIp(const std::string &ip_address) const
+  {
+    boost::system::error_code error_code;
+    boost::asio::ip::address  address = boost::asio::ip::address::from_string(ip_address, error_code);
+
+    return (allow_all_ip_addrs || (!error_code && comms_white_list_ip_addrs.contains(address)));
   }
 
   //--------------------------------------------------------------------------------
-  void Config::loadConfig()
+  bool ConfigSnapshot::isAllowedIp(const boost::asio::ip::address &ip_address) const
   {
-    if(loadConfig(config_path_common, cfg_data)) {          // If the common configuration could be loaded.
+    return (allow_all_ip_addrs || comms_white_list_ip_addrs.contains(ip_address));
+  }
+
+  //--------------------------------------------------------------------------------
+  bool ConfigSnapshot::isAllowedClient(const std::string &app_id, const std::string &app_instance) const
+  {
+    return (allow_all_applications || comms_white_list_applications.isAllowed(app_id, app_instance));
+  }
+
+  //--------------------------------------------------------------------------------
+  // Builds a new snapshot from the configuration files. Throws, without side effects,
+  // if a file exists but can not be parsed.
+  ConfigSnapshot *Config::loadConfig()
+  {
+    ConfigSnapshot *snap     = new ConfigSnapshot();
+    BoostPtree     &cfg_data = snap->cfg_data;
+
+    try {
+      if(loadConfig(config_path_common, cfg_data)) {          // If the common configuration could be loaded.
 
-      BoostPtree cfg_instance;
+        BoostPtree cfg_instance;
+
+        if(loadConfig(config_path_instance, cfg_instance)) {  // Try to load the instance configuration into a local BoostPtree
+          ptreeMerge(cfg_data, cfg_instance);                 // Merge the local BoostPtree into the configuration BoostPrtee
+        }
 
-      if(loadConfig(config_path_instance, cfg_instance)) {  // Try to load the instance configuration into a local BoostPtree
-        ptreeMerge(cfg_data, cfg_instance);                 // Merge the local BoostPtree into the configuration BoostPrtee
+      } else {                                                // If we could not load the common config.
+        loadConfig(config_path_instance, cfg_data);           // Try to load the instance config.
       }
 
-    } else {                                                // If we could not load the common config.
-      loadConfig(config_path_instance, cfg_data);           // Try to load the instance config.
+      populateWhiteLists (*snap);
+      populateDefaultDirs(cfg_data);
+    } catch (...) {
+      delete snap;
+      throw;
     }
 
-    populateWhiteLists();
-    populateDefaultDirs();
+    return snap;
   }
 
   //--------------------------------------------------------------------------------
@@ -135,8 +175,14 @@ namespace kisscpp
   }
 
   //--------------------------------------------------------------------------------
-  void Config::populateWhiteLists()
+  void Config::populateWhiteLists(ConfigSnapshot &snap)
   {
+    BoostPtree          &cfg_data                      = snap.cfg_data;
+    bool                &allow_all_ip_addrs            = snap.allow_all_ip_addrs;
+    bool                &allow_all_applications        = snap.allow_all_applications;
+    IpPrefixTrie        &comms_white_list_ip_addrs     = snap.comms_white_list_ip_addrs;
+    ClientWhiteList     &comms_white_list_applications = snap.comms_white_list_applications;
+
     if(cfg_data.find("kcc-white-list") != cfg_data.not_found()) {
 
       allow_all_ip_addrs     = (cfg_data.get<std::string>("kcc-white-list.all-ip-addrs","false") == "true")?true:false;
@@ -144,7 +190,7 @@ namespace kisscpp
 
       if(!allow_all_ip_addrs) {
         BOOST_FOREACH(boost::property_tree::ptree::value_type &v, cfg_data.get_child("kcc-white-list.ip-list")) {
-          comms_white_list_ip_addrs.insert(v.second.data());
+          comms_white_list_ip_addrs.insert(v.second.data()); // Single addresses, or networks in CIDR notation.
         }
       }
 
@@ -153,12 +199,14 @@ namespace kisscpp
 
           if(v.first == "application") {
 
-            std::string app_id                                    = v.second.get<std::string>("id");
-            (comms_white_list_applications[app_id]).all_instances = (v.second.get<std::string>("all-instances","false") == "true")?true:false;
+            std::string app_id        = v.second.get<std::string>("id");
+            bool        all_instances = (v.second.get<std::string>("all-instances","false") == "true")?true:false;
+
+            comms_white_list_applications.addApplication(app_id, all_instances);
 
-            if(!(comms_white_list_applications[app_id]).all_instances) {
+            if(!all_instances) {
               BOOST_FOREACH(boost::property_tree::ptree::value_type &app_data, v.second.get_child("instance-list")) {
-                (comms_white_list_applications[app_id]).addAppInstance(app_data.second.data());
+                comms_white_list_applications.addInstance(app_id, app_data.second.data());
               }
             }
           }
@@ -166,6 +214,8 @@ namespace kisscpp
         }
       }
 
+      comms_white_list_applications.compile();
+
     } else {
 
       allow_all_ip_addrs     = true;
@@ -175,7 +225,7 @@ namespace kisscpp
   }
 
   //--------------------------------------------------------------------------------
-  void Config::populateDefaultDirs()
+  void Config::populateDefaultDirs(BoostPtree &cfg_data)
   {
     std::string  cache_dir       = "/tmp";
     std::string  queue_dir       = "/tmp";
@@ -22,28 +22,61 @@
 #include <string>
 #include <sstream>
 #include <cstdlib>
-#include <set>
+#include <vector>
 #include <boost/filesystem.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
 #include "boost_ptree.hpp"
 #include "logstream.hpp"
+#include "ip_prefix_trie.hpp"
+#include "client_white_list.hpp"
 
 namespace bfs = boost::filesystem;
 
 namespace kisscpp
 {
-  typedef std::set<std::string> WhiteListType;
+  //--------------------------------------------------------------------------------
+  // An immutable view of the configuration, as loaded at one point in time.
+  // Config publishes a new snapshot on every reload. A snapshot is never freed,
+  // so readers may hold on to one for as long as they like, and never wait for
+  // a reload.
+  class ConfigSnapshot
+  {
+    public:
+      //--------------------------------------------------------------------------------
+      BoostPtree                              get_child   (const std::string &s)                  const { return cfg_data.get_child      (s);               }
+      template<typename T> T                  get         (const std::string &s)                  const { return cfg_data.get         <T>(s);               }
+      template<typename T> T                  get         (const std::string &s, T default_value) const { return cfg_data.get         <T>(s,default_value); }
+      template<typename T> boost::optional<T> get_optional(const std::string &s)                  const { return cfg_data.get_optional<T>(s);               }
+
+      bool          isAllowedIp    (const std::string &ip_address) const;
+      bool          isAllowedIp    (const boost::asio::ip::address &ip_address) const;
+      bool          isAllowedClient(const std::string &app_id, const std::string &app_instance) const;
+
+      unsigned long getGeneration  () const throw() { return generation; } // Incremented with every reload.
+
+    protected:
+    private:
+      friend class Config;
 
-  typedef struct
-          {
-            bool          all_instances;
-            WhiteListType instances;
-            
-            void addAppInstance   (const std::string &instanceId) { instances.insert(instanceId); }
-            bool isAllowedInstance(const std::string &instanceId) { return (all_instances)?true:(instances.find(instanceId) != instances.end()); }
-          } InstanceListType;
+      ConfigSnapshot() :
+        generation            (0),
+        allow_all_ip_addrs    (false),
+        allow_all_applications(false)
+      {
+      }
 
-  typedef std::map<std::string, InstanceListType> MappedWhiteListType;
+      BoostPtree          cfg_data;
+      unsigned long       generation;
+
+      bool                allow_all_ip_addrs;
+      bool                allow_all_applications;
 
+      IpPrefixTrie        comms_white_list_ip_addrs;
+      ClientWhiteList     comms_white_list_applications;
+  };
+
+  //--------------------------------------------------------------------------------
   class Config
   {
     public:
@@ -59,23 +92,31 @@ namespace kisscpp
       };
 
       //--------------------------------------------------------------------------------
-      BoostPtree                              get_child   (const std::string &s)                  { return cfg_data.get_child      (s);               }
-      template<typename T> T                  get         (const std::string &s)                  { return cfg_data.get         <T>(s);               }
-      template<typename T> T                  get         (const std::string &s, T default_value) { return cfg_data.get         <T>(s,default_value); }
-      template<typename T> boost::optional<T> get_optional(const std::string &s)                  { return cfg_data.get_optional<T>(s);               }
+      BoostPtree                              get_child   (const std::string &s)                  { return snapshot()->get_child      (s);               }
+      template<typename T> T                  get         (const std::string &s)                  { return snapshot()->get         <T>(s);               }
+      template<typename T> T                  get         (const std::string &s, T default_value) { return snapshot()->get         <T>(s,default_value); }
+      template<typename T> boost::optional<T> get_optional(const std::string &s)                  { return snapshot()->get_optional<T>(s);               }
 
       std::string getAppId()       const throw() { return application_id; }
       std::string getAppInstance() const throw() { return application_instance; }
 
-      bool        isAllowedIp    (const std::string &ip_address);
-      bool        isAllowedClient(const std::string &app_id, const std::string &app_instance);
+      bool        isAllowedIp    (const std::string &ip_address)                               { return snapshot()->isAllowedIp    (ip_address);             }
+      bool        isAllowedIp    (const boost::asio::ip::address &ip_address)                  { return snapshot()->isAllowedIp    (ip_address);             }
+      bool        isAllowedClient(const std::string &app_id, const std::string &app_instance) { return snapshot()->isAllowedClient(app_id, app_instance); }
+
+      //--------------------------------------------------------------------------------
+      // The snapshot in use right now. It stays valid after reloads; hold on to it
+      // for the duration of a call to see one consistent configuration throughout.
+      const ConfigSnapshot *snapshot() const { return current_snapshot.load(boost::memory_order_acquire); }
 
       //--------------------------------------------------------------------------------
-      // TODO: Add method for reloading configuration.
+      // Re-read the configuration files, and publish them as a new snapshot. Throws if
+      // the files can not be parsed, in which case the current snapshot stays in use.
+      void        reload();
 
     protected:
     private:
-      Config           ()              { kisscpp::LogStream log(__PRETTY_FUNCTION__); };
+      Config           () : current_snapshot(NULL) { kisscpp::LogStream log(__PRETTY_FUNCTION__); };
       Config           (Config const&) { kisscpp::LogStream log(__PRETTY_FUNCTION__); };
       Config& operator=(Config const&);
 //      Config& operator=(Config const&) { kisscpp::LogStream log(__PRETTY_FUNCTION__); };
@@ -83,8 +124,7 @@ namespace kisscpp
       Config(const std::string &app_id,
              const std::string &app_instance,
              const std::string &explicit_config_path) :
-        allow_all_ip_addrs    (false),
-        allow_all_applications(false)
+        current_snapshot(NULL)
       {
         kisscpp::LogStream log(__PRETTY_FUNCTION__);
 
@@ -94,26 +134,119 @@ namespace kisscpp
         initiate(explicit_config_path);
       }
 
-             void loadConfig         ();
-      static bool loadConfig         (std::string &cfg_path, BoostPtree &pt);
-             void populateWhiteLists ();
-             void populateDefaultDirs();
+             ConfigSnapshot *loadConfig         ();
+      static bool            loadConfig         (std::string &cfg_path, BoostPtree &pt);
+      static void            populateWhiteLists (ConfigSnapshot &snap);
+             void            populateDefaultDirs(BoostPtree     &pt);
+             void            publish            (ConfigSnapshot *snap);
 
       static Config      *singleton_instance;
                              
       std::string         config_path_instance; // path to the configuration for this instance of the application
       std::string         config_path_common;   // path to the common configuration for applications with this application id
                              
-      BoostPtree          cfg_data;
-                             
       std::string         application_id;
       std::string         application_instance;
 
-      bool                allow_all_ip_addrs;
-      bool                allow_all_applications;
+      boost::atomic<const ConfigSnapshot*> current_snapshot;
+      std::vector<const ConfigSnapshot*>   retired;          // Every snapshot current_snapshot replaced.
+      boost::mutex                         reload_mutex;     // Serialises reloads, readers never take it.
+  };
+
+  //--------------------------------------------------------------------------------
+  // A configuration value, looked up and converted once per configuration
+  // generation, instead of on every call:
+  //
+  //   ConfigKey<unsigned int> timeout("my-app.timeout", 500);
+  //   ...
+  //   wait(timeout.get());
+  //
+  // get() compares the cached generation with that of the current snapshot, and
+  // only resolves the path again after a reload. It takes no lock: as with
+  // snapshots, the values a reload replaces are kept, until the key is destroyed.
+  template<typename T>
+  class ConfigKey
+  {
+    public:
+      explicit ConfigKey(const std::string &path) :
+        key_path    (path),
+        current_slot(NULL)
+      {
+      }
+
+      ConfigKey(const std::string &path, const T &default_value) :
+        key_path     (path),
+        default_value(default_value),
+        current_slot (NULL)
+      {
+      }
+
+      ~ConfigKey()
+      {
+        delete current_slot.load(boost::memory_order_acquire);
+
+        for(std::size_t i = 0; i < retired.size(); ++i) {
+          delete retired[i];
+        }
+      }
+
+      //--------------------------------------------------------------------------------
+      // Without a default value, throws boost::property_tree::ptree_bad_path if the
+      // path is not configured, just like Config::get.
+      T get()
+      {
+        const ConfigSnapshot *snap = Config::instance()->snapshot();
+        const Slot           *slot = current_slot.load(boost::memory_order_acquire);
+
+        if(slot && slot->generation == snap->getGeneration()) {
+          return slot->value;
+        }
+
+        return refresh(snap)->value;
+      }
+
+      const std::string &path() const throw() { return key_path; }
+
+    protected:
+    private:
+      ConfigKey(const ConfigKey&);
+      ConfigKey& operator=(const ConfigKey&);
+
+      struct Slot
+      {
+        Slot(unsigned long g, const T &v) : generation(g), value(v) {}
+
+        unsigned long generation;
+        T             value;
+      };
+
+      //--------------------------------------------------------------------------------
+      const Slot *refresh(const ConfigSnapshot *snap)
+      {
+        boost::mutex::scoped_lock  lock(refresh_mutex);
+        const Slot                *slot = current_slot.load(boost::memory_order_relaxed);
+
+        if(slot && slot->generation >= snap->getGeneration()) {   // Another thread beat us to it.
+          return slot;
+        }
+
+        const Slot *fresh = new Slot(snap->getGeneration(), (default_value) ? snap->get<T>(key_path, *default_value)
+                                                                             : snap->get<T>(key_path));
+
+        current_slot.store(fresh, boost::memory_order_release);
+
+        if(slot) {
+          retired.push_back(slot);
+        }
+
+        return fresh;
+      }
 
-      WhiteListType       comms_white_list_ip_addrs;
-      MappedWhiteListType comms_white_list_applications;
+      std::string                key_path;
+      boost::optional<T>         default_value;
+      boost::atomic<const Slot*> current_slot;
+      std::vector<const Slot*>   retired;       // Every slot current_slot replaced, under refresh_mutex.
+      boost::mutex               refresh_mutex;
   };
 }
 
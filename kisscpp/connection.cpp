@@ -20,6 +20,65 @@
 
 namespace kisscpp
 {
+  namespace
+  {
+    //--------------------------------------------------------------------------------
+    // What connections carry, and where their time goes. Registered by the first
+    // connection, after the server set up the StatsKeeper.
+    struct ConnectionStats
+    {
+      ConnectionStats() :
+        accepted     (StatsKeeper::instance()->registerStat     ("kcs-transport.accepted")),
+        active       (StatsKeeper::instance()->registerStat     ("kcs-transport.active"   , ST_GAUGE)),
+        bytes_in     (StatsKeeper::instance()->registerStat     ("kcs-transport.bytes-in" )),
+        bytes_out    (StatsKeeper::instance()->registerStat     ("kcs-transport.bytes-out")),
+        request_size (StatsKeeper::instance()->registerHistogram("kcs-transport.request-size" , HU_BYTES)),
+        response_size(StatsKeeper::instance()->registerHistogram("kcs-transport.response-size", HU_BYTES)),
+        read         (StatsKeeper::instance()->registerHistogram("kcs-latency.connection.read"     )),
+        parse        (StatsKeeper::instance()->registerHistogram("kcs-latency.connection.parse"    )),
+        route        (StatsKeeper::instance()->registerHistogram("kcs-latency.connection.route"    )),
+        serialize    (StatsKeeper::instance()->registerHistogram("kcs-latency.connection.serialize")),
+        write        (StatsKeeper::instance()->registerHistogram("kcs-latency.connection.write"    ))
+      {
+      }
+
+      StatHandle        accepted;
+      StatHandle        active;
+      StatHandle        bytes_in;
+      StatHandle        bytes_out;
+      LatencyHistogram *request_size;
+      LatencyHistogram *response_size;
+      LatencyHistogram *read;
+      LatencyHistogram *parse;
+      LatencyHistogram *route;
+      LatencyHistogram *serialize;
+      LatencyHistogram *write;
+    };
+
+    const ConnectionStats& connectionStats()
+    {
+      static ConnectionStats stats;
+      return stats;
+    }
+
+    //--------------------------------------------------------------------------------
+    // Counts a connection as active for as long as it is in scope.
+    class ActiveConnection
+    {
+      public:
+        explicit ActiveConnection(const ConnectionStats &s) : stats(s)
+        {
+          StatsKeeper::instance()->increment(stats.accepted);
+          StatsKeeper::instance()->increment(stats.active);
+        }
+
+        ~ActiveConnection() { StatsKeeper::instance()->decrement(stats.active); }
+
+      private:
+        const ConnectionStats &stats;
+    };
+  }
+
   //--------------------------------------------------------------------------------
   Connection::Connection(boost::asio::io_service& io_service, RequestRouter& handler) :
     socket_(io_service),
@@ -48,32 +107,38 @@ namespace kisscpp
 
     try {
 
-      std::string       client_ip = socket_.remote_endpoint().address().to_string();
-      std::string       ts;
-      std::stringstream ss;
-      std::stringstream response;
+      boost::asio::ip::tcp::endpoint client   = socket_.remote_endpoint();
+      std::string                    ts;
+      std::stringstream              ss;
+      std::stringstream              response;
 
-      boost::asio::read_until(socket_, incomming_stream_buffer_, '\n');
+      const ConnectionStats         &stats    = connectionStats();
+      ActiveConnection               active   (stats);
+      uint64_t                       started  = LatencyHistogram::now();
+      std::size_t                    received = boost::asio::read_until(socket_, incomming_stream_buffer_, '\n');
 
       std::getline(raw_request_, ts, '\n');
 
-      log << manip::info_normal
-          << "Recieved request from ["
-          << client_ip
-          << ":"
-          << socket_.remote_endpoint().port()
-          << "] > "
-          << ts
-          << manip::endl;
+      InFlightRequest in_flight(request_router_); // Taken once the request is in, so a draining server does not wait on idle clients, held until the response is written.
+
+      stats.read->record(LatencyHistogram::now() - started);
+      stats.request_size->record(received);
+      StatsKeeper::instance()->increment(stats.bytes_in, received);
 
-      if(allowedIpAddress(client_ip)) {
+      KISSCPP_LOGF(log, LT_INFO, LS_NORMAL, "Recieved request from [{}:{}] > {}") << client.address().to_string() << client.port() << ts;
+
+      if(allowedIpAddress(client.address())) {
 
         ss << ts;
 
-        read_json(ss, parsed_request_);
+        {
+          LatencyTimer timer(stats.parse);
+          read_json(ss, parsed_request_);
+        }
 
         try {
           if(allowedClient()) {
+            LatencyTimer timer(stats.route);
             request_router_.route_request(parsed_request_, raw_response_);
           } else {
          
@@ -91,7 +156,7 @@ namespace kisscpp
           }
         } catch (boost::property_tree::ptree_bad_path &e) {
 
-          log << manip::error_normal << "Reqest does not contain kcm-client data." << e.what() << manip::endl;
+          KISSCPP_ERROR(log, LS_NORMAL) << "Reqest does not contain kcm-client data." << e.what() << manip::endl;
 
           raw_response_.put("kcm-sts", RQST_CLIENT_DENIED);
           raw_response_.put("kcm-erm", "Request denied: Your request does not contain kcm-client data.");
@@ -99,12 +164,12 @@ namespace kisscpp
         } catch(std::exception& e) {
           std::stringstream tmsg;
           tmsg << "std::exception: " << e.what();
-          log << manip::error_normal << tmsg.str() << manip::endl;
+          KISSCPP_ERROR(log, LS_NORMAL) << tmsg.str() << manip::endl;
           raw_response_.put("kcm-sts", RQST_UNKNOWN);
           raw_response_.put("kcm-erm", tmsg.str());
         } catch (...) {
           std::string tmsg = "Unhandled exception while routing request!";
-          log << manip::error_normal << tmsg << manip::endl;
+          KISSCPP_ERROR(log, LS_NORMAL) << tmsg << manip::endl;
           raw_response_.put("kcm-sts", RQST_UNKNOWN);
           raw_response_.put("kcm-erm", tmsg);
         }
@@ -114,7 +179,7 @@ namespace kisscpp
 
         log << manip::info_normal
             << "Request denied for ip address ["
-            << client_ip
+            << client.address().to_string()
             << "]"
             << manip::endl;
 
@@ -123,42 +188,46 @@ namespace kisscpp
 
       }
 
-      write_json(response, raw_response_, false);
+      {
+        LatencyTimer timer(stats.serialize);
+        write_json(response, raw_response_, false);
+      }
+
+      KISSCPP_LOGF(log, LT_INFO, LS_NORMAL, "Sending response: {}") << response.str();
 
-      log << manip::info_normal
-          << "Sending response: "
-          << response.str()
-          << manip::endl;
+      LatencyTimer timer(stats.write);
 
       encoded_response_ << response.str();
 
-      boost::asio::write(socket_, outgoing_stream_buffer_, boost::asio::transfer_all());
+      std::size_t sent = boost::asio::write(socket_, outgoing_stream_buffer_, boost::asio::transfer_all());
+
+      stats.response_size->record(sent);
+      StatsKeeper::instance()->increment(stats.bytes_out, sent);
 
     } catch(boost::property_tree::json_parser::json_parser_error &je) {
-      log << manip::error_normal << "json parsing Error: " << je.message() << manip::endl;
+      KISSCPP_ERROR(log, LS_NORMAL) << "json parsing Error: " << je.message() << manip::endl;
     } catch(std::exception& e) {
       std::stringstream tmsg;
       tmsg << "std::exception: " << e.what();
-      log << manip::error_normal << tmsg.str() << manip::endl;
+      KISSCPP_ERROR(log, LS_NORMAL) << tmsg.str() << manip::endl;
     } catch (...) {
-      log << manip::error_normal << "Unhandled exception while routing request!" << manip::endl;
+      KISSCPP_ERROR(log, LS_NORMAL) << "Unhandled exception while routing request!" << manip::endl;
     }
 
   }
 
   //--------------------------------------------------------------------------------
-  bool Connection::allowedIpAddress(const std::string &ip_address)
+  bool Connection::allowedIpAddress(const boost::asio::ip::address &ip_address)
   {
     LogStream log(__PRETTY_FUNCTION__);
-    return (Config::instance()->isAllowedIp(ip_address));
+    return (Config::instance()->snapshot()->isAllowedIp(ip_address));
   }
 
   //--------------------------------------------------------------------------------
   bool Connection::allowedClient()
   {
     LogStream log(__PRETTY_FUNCTION__);
-    return (Config::instance()->isAllowedClient(parsed_request_.get<std::string>("kcm-client.id"),
-                                                parsed_request_.get<std::string>("kcm-client.instance")));
+    return (Config::instance()->snapshot()->isAllowedClient(parsed_request_.get<std::string>("kcm-client.id"),
+                                                            parsed_request_.get<std::string>("kcm-client.instance")));
   }
 }
-
@@ -51,7 +51,7 @@ namespace kisscpp
       void start();
 
     private:
-      bool allowedIpAddress(const std::string &ip_address);
+      bool allowedIpAddress(const boost::asio::ip::address &ip_address);
       bool allowedClient   ();
 
       boost::asio::ip::tcp::socket socket_;
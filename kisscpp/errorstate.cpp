@@ -16,10 +16,175 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
 
+#include <time.h>
 #include "errorstate.hpp"
+#include "openmetrics.hpp"
+#include "latency_histogram.hpp"
 
 namespace kisscpp
 {
+  namespace
+  {
+    const unsigned int ERROR_SLOT_SHIFT = 24;                                 // A rate slot holds the second above, the count below.
+    const uint64_t     ERROR_SLOT_MASK  = (uint64_t(1) << ERROR_SLOT_SHIFT) - 1;
+
+    uint64_t monotonicSecond() { return LatencyHistogram::now() / 1000000; }
+  }
+
+  //--------------------------------------------------------------------------------
+  ErrorState::ErrorState(const std::string &_id, const std::string &_description /* = "" */) :
+    id          (_id),
+    description (_description),
+    count       (0),
+    total       (0),
+    firstSeen   (0),
+    lastSeen    (0),
+    hasThreshold(false),
+    armed       (true),
+    historyNext (0)
+  {
+    for(unsigned int i = 0; i < ERROR_RATE_SECONDS; ++i) {
+      slots[i].store(0, boost::memory_order_relaxed);
+    }
+
+    for(unsigned int i = 0; i < ERROR_HISTORY_LENGTH; ++i) {
+      history[i].when = 0;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void ErrorState::set(const std::string &detail /* = "" */)
+  {
+    uint64_t                 when   = wallNow();
+    uint64_t                 second = monotonicSecond();
+    boost::atomic<uint64_t> &slot   = slots[second % ERROR_RATE_SECONDS];
+    uint64_t                 old    = slot.load(boost::memory_order_relaxed);
+    uint64_t                 next;
+    uint64_t                 never  = 0;
+
+    do { // A slot last used a minute or more ago, starts over.
+      if((old >> ERROR_SLOT_SHIFT) == second) {
+        next = ((old & ERROR_SLOT_MASK) < ERROR_SLOT_MASK) ? old + 1 : old;
+      } else {
+        next = (second << ERROR_SLOT_SHIFT) | 1;
+      }
+    } while(!slot.compare_exchange_weak(old, next, boost::memory_order_relaxed));
+
+    count.fetch_add(1, boost::memory_order_relaxed);
+    total.fetch_add(1, boost::memory_order_relaxed);
+    firstSeen.compare_exchange_strong(never, when, boost::memory_order_relaxed);
+    lastSeen.store(when, boost::memory_order_relaxed);
+
+    {
+      boost::unique_lock<boost::mutex> lock(historyMutex, boost::try_to_lock);
+
+      if(lock.owns_lock()) {
+        history[historyNext].when   = when;
+        history[historyNext].detail = detail;
+        historyNext                 = (historyNext + 1) % ERROR_HISTORY_LENGTH;
+      }
+    }
+
+    if(hasThreshold.load(boost::memory_order_acquire)) {
+      checkThreshold();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void ErrorState::clear(const unsigned int &amount /*= 1*/)
+  {
+    unsigned int old = count.load(boost::memory_order_relaxed);
+
+    while(!count.compare_exchange_weak(old, (old > amount) ? old - amount : 0, boost::memory_order_relaxed)) {}
+  }
+
+  //--------------------------------------------------------------------------------
+  unsigned int ErrorState::countInWindow(unsigned int seconds) const
+  {
+    uint64_t     now    = monotonicSecond();
+    unsigned int retval = 0;
+
+    for(unsigned int i = 0; i < ERROR_RATE_SECONDS; ++i) {
+      uint64_t value  = slots[i].load(boost::memory_order_relaxed);
+      uint64_t second = value >> ERROR_SLOT_SHIFT;
+
+      if(second <= now && now - second < seconds) {
+        retval += static_cast<unsigned int>(value & ERROR_SLOT_MASK);
+      }
+    }
+
+    return retval;
+  }
+
+  //--------------------------------------------------------------------------------
+  void ErrorState::getHistory(ErrorHistory &occurrences) const
+  {
+    boost::lock_guard<boost::mutex> guard(historyMutex);
+
+    occurrences.clear();
+
+    for(unsigned int i = 0; i < ERROR_HISTORY_LENGTH; ++i) {
+      const ErrorOccurrence &occurrence = history[(historyNext + i) % ERROR_HISTORY_LENGTH];
+
+      if(occurrence.when > 0) {
+        occurrences.push_back(occurrence);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void ErrorState::setThreshold(SharedErrorThreshold t)
+  {
+    boost::atomic_store(&threshold, t);
+    armed.store(true, boost::memory_order_relaxed);
+    hasThreshold.store(static_cast<bool>(t), boost::memory_order_release);
+  }
+
+  //--------------------------------------------------------------------------------
+  uint64_t ErrorState::wallNow()
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Fires once on reaching the threshold, and re-arms once below it again. Shedding
+  // is extended by every occurrence that finds the count still at the threshold.
+  void ErrorState::checkThreshold()
+  {
+    SharedErrorThreshold t = boost::atomic_load(&threshold);
+
+    if(!t) {
+      return;
+    }
+
+    unsigned int n = countInWindow(t->window);
+
+    if(n < t->count) {
+      armed.store(true, boost::memory_order_relaxed);
+      return;
+    }
+
+    if(t->shed) {
+      ErrorStateList::instance()->shedFor(t->window);
+    }
+
+    if(armed.exchange(false, boost::memory_order_relaxed)) {
+      LogStream log(__PRETTY_FUNCTION__);
+
+      KISSCPP_LOGF(log, LT_ERROR, LS_HIGH, "Error state [{}] was set {} times in {}s, reaching its threshold of {}.{}")
+        << id << n << t->window << t->count << ((t->shed) ? " Shedding requests." : "");
+
+      if(t->callback) {
+        t->callback(*this, n);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
   ErrorStateList* ErrorStateList::singleton_instance;
 
   //--------------------------------------------------------------------------------
@@ -33,57 +198,43 @@ namespace kisscpp
   }
 
   //--------------------------------------------------------------------------------
-  void ErrorStateList::set(const std::string &id, const std::string &description /* = ""*/)
+  // Ids are not case sensitive, they are kept in lower case.
+  SharedErrorState ErrorStateList::registerState(const std::string &id, const std::string &description /* = ""*/)
   {
     boost::lock_guard<boost::mutex> guard(errorMutex);
     std::string                     err_id = id;
 
     boost::algorithm::to_lower(err_id);
 
-    if(errorStateMap.find(err_id) != errorStateMap.end()) {
-      errorStateMap[id]->set();
-    } else {
-      SharedErrorState tempErrorState;
-      tempErrorState.reset(new ErrorState(err_id,description));
-      errorStateMap[id] = tempErrorState;
-      errorStateMap[id]->set();
+    ErrorStateMapTypeIterator itr = errorStateMap.find(err_id);
+
+    if(itr != errorStateMap.end()) {
+      return itr->second;
     }
+
+    SharedErrorState tempErrorState;
+    tempErrorState.reset(new ErrorState(err_id,description));
+    errorStateMap[err_id] = tempErrorState;
+
+    return tempErrorState;
   }
 
   //--------------------------------------------------------------------------------
-  void ErrorStateList::clear(const std::string &id, const unsigned int &amount /*= 1*/)
+  void ErrorStateList::set(const std::string &id, const std::string &description /* = ""*/)
   {
-    boost::lock_guard<boost::mutex> guard(errorMutex);
-    std::string                     err_id = id;
-
-    boost::algorithm::to_lower(err_id);
+    registerState(id, description)->set(description);
+  }
 
-    if(errorStateMap.find(err_id) != errorStateMap.end()) {
-      errorStateMap[err_id]->clear(amount);
-    } else {
-      SharedErrorState tempErrorState;
-      tempErrorState.reset(new ErrorState(err_id));
-      errorStateMap[err_id] = tempErrorState;
-      errorStateMap[err_id]->clear(amount);
-    }
+  //--------------------------------------------------------------------------------
+  void ErrorStateList::clear(const std::string &id, const unsigned int &amount /*= 1*/)
+  {
+    registerState(id)->clear(amount);
   }
 
   //--------------------------------------------------------------------------------
   void ErrorStateList::clear_all(const std::string &id)
   {
-    boost::lock_guard<boost::mutex> guard(errorMutex);
-    std::string                     err_id = id;
-
-    boost::algorithm::to_lower(err_id);
-
-    if(errorStateMap.find(err_id) != errorStateMap.end()) {
-      errorStateMap[err_id]->clear_all();
-    } else {
-      SharedErrorState tempErrorState;
-      tempErrorState.reset(new ErrorState(err_id));
-      errorStateMap[err_id] = tempErrorState;
-      errorStateMap[err_id]->clear_all();
-    }
+    registerState(id)->clear_all();
   }
 
   //--------------------------------------------------------------------------------
@@ -102,5 +253,61 @@ namespace kisscpp
 
     return retval;
   }
-}
 
+  //--------------------------------------------------------------------------------
+  void ErrorStateList::setThreshold(const std::string     &id,
+                                    unsigned int           count,
+                                    unsigned int           window,
+                                    bool                   shed,
+                                    ErrorThresholdCallback callback /* = ErrorThresholdCallback() */)
+  {
+    SharedErrorState                  state = registerState(id);
+    boost::shared_ptr<ErrorThreshold> t;
+
+    if(count > 0) {
+      t.reset(new ErrorThreshold());
+      t->count    = count;
+      t->window   = (window < 1) ? 1 : (window > ERROR_RATE_SECONDS) ? ERROR_RATE_SECONDS : window;
+      t->shed     = shed;
+      t->callback = callback;
+    }
+
+    state->setThreshold(t);
+  }
+
+  //--------------------------------------------------------------------------------
+  void ErrorStateList::shedFor(unsigned int seconds)
+  {
+    uint64_t until = LatencyHistogram::now() + static_cast<uint64_t>(seconds) * 1000000;
+    uint64_t old   = shedUntil.load(boost::memory_order_relaxed);
+
+    while(old < until && !shedUntil.compare_exchange_weak(old, until, boost::memory_order_relaxed)) {}
+  }
+
+  //--------------------------------------------------------------------------------
+  bool ErrorStateList::isShedding() const
+  {
+    uint64_t until = shedUntil.load(boost::memory_order_relaxed);
+
+    return (until > 0 && LatencyHistogram::now() < until);
+  }
+
+  //--------------------------------------------------------------------------------
+  void ErrorStateList::writeOpenMetrics(std::string &out)
+  {
+    boost::lock_guard<boost::mutex> guard(errorMutex);
+
+    OpenMetrics::family(out, "kcs_error_state", "gauge");
+
+    for(ErrorStateMapTypeIterator itr = errorStateMap.begin(); itr != errorStateMap.end(); ++itr) {
+      OpenMetrics::sample(out, "kcs_error_state", (itr->second)->getSetCount(),
+                          OpenMetrics::label("id", itr->first) + "," + OpenMetrics::label("description", (itr->second)->getDescription()));
+    }
+
+    OpenMetrics::family(out, "kcs_error_occurrences", "counter");
+
+    for(ErrorStateMapTypeIterator itr = errorStateMap.begin(); itr != errorStateMap.end(); ++itr) {
+      OpenMetrics::sample(out, "kcs_error_occurrences_total", (itr->second)->getTotal(), OpenMetrics::label("id", itr->first));
+    }
+  }
+}
@@ -26,32 +26,89 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
 #include "boost_ptree.hpp"
 #include "logstream.hpp"
 
+#define ERROR_RATE_SECONDS   60 // Longest window rates are counted over, in one second slots.
+#define ERROR_HISTORY_LENGTH 8  // Most recent occurrences kept per error state.
+
 namespace kisscpp
 {
   //--------------------------------------------------------------------------------
-  class ErrorState
+  struct ErrorOccurrence
+  {
+    uint64_t    when;   // Microseconds since the epoch.
+    std::string detail;
+  };
+
+  typedef std::vector<ErrorOccurrence>            ErrorHistory;
+
+  class ErrorState;
+
+  // Called on the thread that set the error, when its count in the window reaches
+  // the threshold. Called again only once the count has dropped below it.
+  typedef boost::function<void (const ErrorState &state, unsigned int count)> ErrorThresholdCallback;
+
+  struct ErrorThreshold
+  {
+    unsigned int           count;
+    unsigned int           window;   // Seconds, up to ERROR_RATE_SECONDS.
+    bool                   shed;     // Answer requests with RQST_APPLICATION_BUSY while over the threshold.
+    ErrorThresholdCallback callback;
+  };
+
+  typedef boost::shared_ptr<const ErrorThreshold> SharedErrorThreshold;
+
+  //--------------------------------------------------------------------------------
+  // Setting, clearing and counting take no lock. The history is best effort: an
+  // occurrence that finds another one being recorded is counted, not kept.
+  class ErrorState : private boost::noncopyable
   {
     public:
-       ErrorState(const std::string &_id, const std::string &_description = "") : id(_id), description(_description), count(0) {}
+       ErrorState(const std::string &_id, const std::string &_description = "");
 
       ~ErrorState() {};
 
-      void         set           ()                               { count++;                }
-      void         clear         (const unsigned int &amount = 1) { count = count - amount; }
+      void         set           (const std::string  &detail = "");
+      void         clear         (const unsigned int &amount = 1);
       void         clear_all     ()                               { count = 0;              }
       unsigned int getSetCount   () const throw()                 { return count;           }
       bool         isSet         () const throw()                 { return (count > 0);     }
       std::string  getId         () const throw()                 { return id;              }
       std::string  getDescription() const throw()                 { return description;     }
 
+      uint64_t     getTotal      () const throw()                 { return total;           } // Since start up, clearing leaves it be.
+      uint64_t     getFirstSeen  () const throw()                 { return firstSeen;       } // Microseconds since the epoch, 0 if never set.
+      uint64_t     getLastSeen   () const throw()                 { return lastSeen;        }
+      unsigned int countInWindow (unsigned int seconds) const;    // Occurrences in the last seconds, up to ERROR_RATE_SECONDS.
+      double       getRate       (unsigned int seconds) const     { return (seconds) ? static_cast<double>(countInWindow(seconds)) / seconds : 0; }
+      void         getHistory    (ErrorHistory &history) const;   // Oldest first.
+
+      void         setThreshold  (SharedErrorThreshold t);        // An empty pointer removes it.
+
+      static uint64_t wallNow    ();                              // Microseconds since the epoch.
+
     protected:
     private:
-      std::string  id;
-      std::string  description;
-      unsigned int count;
+      void         checkThreshold();
+
+      std::string                  id;
+      std::string                  description;
+      boost::atomic<unsigned int>  count;
+      boost::atomic<uint64_t>      total;
+      boost::atomic<uint64_t>      firstSeen;
+      boost::atomic<uint64_t>      lastSeen;
+      boost::atomic<uint64_t>      slots[ERROR_RATE_SECONDS]; // Monotonic second << 24 | count in that second.
+      SharedErrorThreshold         threshold;                 // Only through boost::atomic_load and atomic_store.
+      boost::atomic<bool>          hasThreshold;
+      boost::atomic<bool>          armed;                     // Below the threshold, so reaching it fires again.
+      mutable boost::mutex         historyMutex;
+      ErrorOccurrence              history[ERROR_HISTORY_LENGTH];
+      unsigned int                 historyNext;
   };
 
   typedef boost::shared_ptr<ErrorState>           SharedErrorState;
@@ -70,21 +127,36 @@ namespace kisscpp
 
       ~ErrorStateList() { kisscpp::LogStream log(__PRETTY_FUNCTION__); }
 
+      SharedErrorState registerState(const std::string &id, const std::string  &description = ""); // Keep it, to set without looking id up.
       void            set      (const std::string &id, const std::string  &description = "");
       void            clear    (const std::string &id, const unsigned int &amount = 1);
       void            clear_all(const std::string &id);
       SharedErrorList getStates();
+      void            writeOpenMetrics(std::string &out); // Appends the set count of every error state, in the OpenMetrics text format.
+
+      // When id is set count times within window seconds, callback is called, and
+      // with shed, requests are refused for as long as that keeps up. A count of 0
+      // removes the threshold.
+      void            setThreshold(const std::string      &id,
+                                   unsigned int            count,
+                                   unsigned int            window,
+                                   bool                    shed,
+                                   ErrorThresholdCallback  callback = ErrorThresholdCallback());
+
+      void            shedFor    (unsigned int seconds); // Called when a shedding threshold is reached.
+      bool            isShedding () const;
 
     protected:
     private:
-      ErrorStateList           ()                     { kisscpp::LogStream log(__PRETTY_FUNCTION__); }  // Private to prevent copying.
+      ErrorStateList           () : shedUntil(0)      { kisscpp::LogStream log(__PRETTY_FUNCTION__); }  // Private to prevent copying.
       ErrorStateList           (ErrorStateList const&){ kisscpp::LogStream log(__PRETTY_FUNCTION__); }; // Private to prevent copying.
       ErrorStateList& operator=(ErrorStateList const&); //{ kisscpp::LogStream log(__PRETTY_FUNCTION__); }; // Private to prevent assignment.
 
       static ErrorStateList *singleton_instance;
 
-      ErrorStateMapType      errorStateMap;
-      boost::mutex           errorMutex;
+      ErrorStateMapType       errorStateMap;
+      boost::mutex            errorMutex;
+      boost::atomic<uint64_t> shedUntil;     // Monotonic microseconds, 0 when never shed.
   };
 }
 
@@ -0,0 +1,128 @@
+// File  : inflight_table.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <cstring>
+#include "inflight_table.hpp"
+#include "latency_histogram.hpp"
+
+namespace kisscpp
+{
+  namespace
+  {
+    //--------------------------------------------------------------------------------
+    void copyField(char *field, const std::string &value)
+    {
+      std::size_t length = (value.size() < INFLIGHT_FIELD_SIZE - 1) ? value.size() : INFLIGHT_FIELD_SIZE - 1;
+
+      std::memcpy(field, value.data(), length);
+      field[length] = '\0';
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  InFlightTable::InFlightTable() : slots(new Slot[INFLIGHT_SLOTS]), tickets(0)
+  {
+    for(unsigned int i = 0; i < INFLIGHT_SLOTS; ++i) {
+      slots[i].state.store(SLOT_FREE, boost::memory_order_relaxed);
+      slots[i].ticket.store(0, boost::memory_order_relaxed);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // Threads start looking at a slot of their own, so they seldom contend for one.
+  int InFlightTable::enter(const std::string &command, const std::string &client)
+  {
+    long         thread = threadId();
+    unsigned int first  = static_cast<unsigned long>(thread) % INFLIGHT_SLOTS;
+
+    for(unsigned int i = 0; i < INFLIGHT_SLOTS; ++i) {
+      Slot &slot     = slots[(first + i) % INFLIGHT_SLOTS];
+      int   expected = SLOT_FREE;
+
+      if(slot.state.load(boost::memory_order_relaxed) == SLOT_FREE &&
+         slot.state.compare_exchange_strong(expected, SLOT_WRITING, boost::memory_order_acquire)) {
+
+        slot.ticket.store(tickets.fetch_add(1, boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+        slot.started = LatencyHistogram::now();
+        slot.thread  = thread;
+        copyField(slot.command, command);
+        copyField(slot.client , client);
+        slot.state.store(SLOT_LIVE, boost::memory_order_release);
+
+        return (first + i) % INFLIGHT_SLOTS;
+      }
+    }
+
+    return -1;
+  }
+
+  //--------------------------------------------------------------------------------
+  void InFlightTable::leave(int slot)
+  {
+    if(slot >= 0) {
+      slots[slot].state.store(SLOT_FREE, boost::memory_order_release);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void InFlightTable::list(InFlightList &requests) const
+  {
+    for(unsigned int i = 0; i < INFLIGHT_SLOTS; ++i) {
+      const Slot &slot = slots[i];
+
+      if(slot.state.load(boost::memory_order_acquire) != SLOT_LIVE) {
+        continue;
+      }
+
+      uint64_t     ticket = slot.ticket.load(boost::memory_order_acquire);
+      InFlightInfo info;
+      char         command[INFLIGHT_FIELD_SIZE];
+      char         client [INFLIGHT_FIELD_SIZE];
+
+      info.started = slot.started;
+      info.thread  = slot.thread;
+      std::memcpy(command, slot.command, INFLIGHT_FIELD_SIZE);
+      std::memcpy(client , slot.client , INFLIGHT_FIELD_SIZE);
+
+      boost::atomic_thread_fence(boost::memory_order_acquire);
+
+      if(slot.state.load(boost::memory_order_relaxed) == SLOT_LIVE && slot.ticket.load(boost::memory_order_relaxed) == ticket) {
+        command[INFLIGHT_FIELD_SIZE - 1] = '\0';
+        client [INFLIGHT_FIELD_SIZE - 1] = '\0';
+        info.command = command;
+        info.client  = client;
+        requests.push_back(info);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  long InFlightTable::threadId()
+  {
+    static __thread long id = 0;
+
+    if(id == 0) {
+      id = syscall(SYS_gettid);
+    }
+
+    return id;
+  }
+}
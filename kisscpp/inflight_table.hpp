@@ -0,0 +1,92 @@
+// File  : inflight_table.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _INFLIGHT_TABLE_HPP_
+#define _INFLIGHT_TABLE_HPP_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+#define INFLIGHT_SLOTS      256   // Requests tracked at once, those beyond are not listed.
+#define INFLIGHT_FIELD_SIZE 64    // Command and client ids are cut to this, terminator included.
+
+namespace kisscpp
+{
+  struct InFlightInfo
+  {
+    std::string command;
+    std::string client;
+    uint64_t    started;  // LatencyHistogram::now()
+    long        thread;   // As shown by top -H, and gdb.
+  };
+
+  typedef std::vector<InFlightInfo> InFlightList;
+
+  //--------------------------------------------------------------------------------
+  // The requests being handled right now, in a fixed table of slots. Entering
+  // claims a free slot with a compare and swap, and leaving frees it: neither
+  // locks, or allocates. Readers copy a slot, and keep the copy only when the
+  // slot still holds the same request afterwards.
+  class InFlightTable : private boost::noncopyable
+  {
+    public:
+      InFlightTable();
+
+      int  enter(const std::string &command, const std::string &client); // The slot, or -1 when the table is full.
+      void leave(int slot);
+      void list (InFlightList &requests) const;
+
+      static long threadId(); // Of the calling thread.
+
+    private:
+      enum SlotState { SLOT_FREE, SLOT_WRITING, SLOT_LIVE };
+
+      struct Slot
+      {
+        boost::atomic<int>      state;
+        boost::atomic<uint64_t> ticket;   // Tells the requests that used the slot apart.
+        uint64_t                started;
+        long                    thread;
+        char                    command[INFLIGHT_FIELD_SIZE];
+        char                    client [INFLIGHT_FIELD_SIZE];
+      };
+
+      boost::scoped_array<Slot> slots;
+      boost::atomic<uint64_t>   tickets;
+  };
+
+  //--------------------------------------------------------------------------------
+  // Lists a request in the table, for as long as it is in scope.
+  class InFlightEntry : private boost::noncopyable
+  {
+    public:
+      InFlightEntry(InFlightTable &t, const std::string &command, const std::string &client) : table(t), slot(t.enter(command, client)) {}
+      ~InFlightEntry() { table.leave(slot); }
+
+    private:
+      InFlightTable &table;
+      int            slot;
+  };
+}
+
+#endif // _INFLIGHT_TABLE_HPP_
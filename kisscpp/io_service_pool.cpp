@@ -21,7 +21,7 @@
 namespace kisscpp
 {
   //--------------------------------------------------------------------------------
-  IoServicePool::IoServicePool(std::size_t pool_size) : next_io_service_(0)
+  IoServicePool::IoServicePool(std::size_t pool_size) : next_io_service_(0), probe_interval_(0)
   {
     if (pool_size == 0) {
       throw std::runtime_error("IoServicePool size is 0");
@@ -39,6 +39,17 @@ namespace kisscpp
   //--------------------------------------------------------------------------------
   void IoServicePool::run()
   {
+    // Probes are only created here, so a pre-forked worker gets its own.
+    if(probe_interval_ > 0 && probes_.empty()) {
+      boost::lock_guard<boost::mutex> guard(probes_mutex_);
+
+      for(std::size_t i = 0; i < io_services_.size(); ++i) {
+        probe_ptr probe(new LoopProbe(*io_services_[i], i, probe_interval_));
+        probe->start();
+        probes_.push_back(probe);
+      }
+    }
+
     // Create a pool of threads to run all of the io_services.
     std::vector<boost::shared_ptr<boost::thread> > threads;
     for(std::size_t i = 0; i < io_services_.size(); ++i) {
@@ -61,6 +72,30 @@ namespace kisscpp
     }
   }
 
+  //--------------------------------------------------------------------------------
+  void IoServicePool::notify_fork(boost::asio::io_service::fork_event event)
+  {
+    for (std::size_t i = 0; i < io_services_.size(); ++i) {
+      io_services_[i]->notify_fork(event);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void IoServicePool::set_probe_interval(unsigned long int milliseconds)
+  {
+    probe_interval_ = milliseconds;
+  }
+
+  //--------------------------------------------------------------------------------
+  void IoServicePool::heartbeats(std::vector<LoopHeartbeat> &beats)
+  {
+    boost::lock_guard<boost::mutex> guard(probes_mutex_);
+
+    for(std::size_t i = 0; i < probes_.size(); ++i) {
+      beats.push_back(probes_[i]->heartbeat());
+    }
+  }
+
   //--------------------------------------------------------------------------------
   boost::asio::io_service& IoServicePool::get_io_service()
   {
@@ -26,6 +26,9 @@
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include "loop_probe.hpp"
 
 namespace kisscpp
 {
@@ -36,14 +39,22 @@ namespace kisscpp
       void                     run();                                  /// Run all io_service objects in the pool.
       void                     stop();                                 /// Stop all io_service objects in the pool.
       boost::asio::io_service &get_io_service();                       /// Get an io_service to use.
+      void                     notify_fork(boost::asio::io_service::fork_event event); /// Pass fork notifications on to all io_service objects in the pool.
+      void                     set_probe_interval(unsigned long int milliseconds);     /// Probe every io_service this often once running, 0 for never.
+      unsigned long int        probe_interval() const { return probe_interval_; }
+      void                     heartbeats(std::vector<LoopHeartbeat> &beats);           /// One for every io_service, none before running or without probes.
 
     private:
       typedef boost::shared_ptr<boost::asio::io_service>       io_service_ptr;
       typedef boost::shared_ptr<boost::asio::io_service::work> work_ptr;
+      typedef boost::shared_ptr<LoopProbe>                     probe_ptr;
 
       std::vector<io_service_ptr> io_services_;     /// The pool of io_services.
       std::vector<work_ptr>       work_;            /// The work that keeps the io_services running.
       std::size_t                 next_io_service_; /// The next io_service to use for a connection.
+      unsigned long int           probe_interval_;  /// Milliseconds between event loop probes.
+      std::vector<probe_ptr>      probes_;          /// One for every io_service, once running.
+      boost::mutex                probes_mutex_;    /// For the watchdog, reading heartbeats while run() creates the probes.
   };
 
 } // namespace server
@@ -0,0 +1,241 @@
+// File  : ip_prefix_trie.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include "ip_prefix_trie.hpp"
+
+namespace kisscpp
+{
+  namespace
+  {
+    //--------------------------------------------------------------------------------
+    inline unsigned int bitAt(const unsigned char *bytes, unsigned int bit)
+    {
+      return (bytes[bit >> 3] >> (7 - (bit & 7))) & 1;
+    }
+
+    //--------------------------------------------------------------------------------
+    // Number of leading bits a and b have in common, up to limit.
+    unsigned int commonPrefixLength(const unsigned char *a, const unsigned char *b, unsigned int limit)
+    {
+      unsigned int bit = 0;
+
+      while(bit + 8 <= limit && a[bit >> 3] == b[bit >> 3]) {
+        bit += 8;
+      }
+
+      while(bit < limit && bitAt(a, bit) == bitAt(b, bit)) {
+        ++bit;
+      }
+
+      return bit;
+    }
+
+    //--------------------------------------------------------------------------------
+    void clearHostBits(unsigned char *bytes, std::size_t byte_count, unsigned int prefix_length)
+    {
+      for(unsigned int bit = prefix_length; bit < byte_count * 8; ++bit) {
+        bytes[bit >> 3] &= ~(0x80 >> (bit & 7));
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    inline bool isV4Mapped(const unsigned char *bytes)
+    {
+      static const unsigned char mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+      return (std::memcmp(bytes, mapped_prefix, sizeof(mapped_prefix)) == 0);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  IpPrefixTrie::IpPrefixTrie() :
+    ipv4_trie(1),
+    ipv6_trie(1),
+    entries  (0)
+  {
+  }
+
+  //--------------------------------------------------------------------------------
+  void IpPrefixTrie::insert(const std::string &cidr)
+  {
+    std::string::size_type    separator = cidr.find('/');
+    boost::system::error_code error_code;
+    boost::asio::ip::address  network   = boost::asio::ip::address::from_string(cidr.substr(0, separator), error_code);
+
+    if(error_code) {
+      throw std::invalid_argument("Invalid ip address in white-list entry [" + cidr + "]");
+    }
+
+    unsigned int max_length    = (network.is_v4()) ? 32 : 128;
+    unsigned int prefix_length = max_length;
+
+    if(separator != std::string::npos) {
+      std::string  length_str = cidr.substr(separator + 1);
+      char        *end        = NULL;
+      long         length     = std::strtol(length_str.c_str(), &end, 10);
+
+      if(length_str.empty() || *end != '\0' || length < 0 || length > static_cast<long>(max_length)) {
+        throw std::invalid_argument("Invalid prefix length in white-list entry [" + cidr + "]");
+      }
+
+      prefix_length = static_cast<unsigned int>(length);
+    }
+
+    insert(network, prefix_length);
+  }
+
+  //--------------------------------------------------------------------------------
+  void IpPrefixTrie::insert(const boost::asio::ip::address &network, unsigned int prefix_length)
+  {
+    bool added = false;
+
+    if(network.is_v4()) {
+      boost::asio::ip::address_v4::bytes_type bytes = network.to_v4().to_bytes();
+      added = insert(ipv4_trie, bytes.data(), std::min(prefix_length, 32u));
+    } else {
+      boost::asio::ip::address_v6::bytes_type bytes = network.to_v6().to_bytes();
+
+      if(isV4Mapped(bytes.data()) && prefix_length >= 96) {
+        added = insert(ipv4_trie, bytes.data() + 12, prefix_length - 96);
+      } else {
+        added = insert(ipv6_trie, bytes.data(), std::min(prefix_length, 128u));
+      }
+    }
+
+    if(added) {
+      entries++;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  bool IpPrefixTrie::contains(const boost::asio::ip::address &address) const
+  {
+    if(address.is_v4()) {
+      return contains(address.to_v4().to_bytes().data(), 4);
+    }
+
+    return contains(address.to_v6().to_bytes().data(), 16);
+  }
+
+  //--------------------------------------------------------------------------------
+  bool IpPrefixTrie::contains(const unsigned char *address_bytes, std::size_t address_length) const
+  {
+    if(address_length == 4) {
+      return contains(ipv4_trie, address_bytes, 32);
+    }
+
+    if(address_length == 16) {
+      if(isV4Mapped(address_bytes)) {
+        return contains(ipv4_trie, address_bytes + 12, 32);
+      }
+
+      return contains(ipv6_trie, address_bytes, 128);
+    }
+
+    return false;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Returns false if the network was already in the trie.
+  bool IpPrefixTrie::insert(NodeList &trie, const unsigned char *prefix, unsigned int prefix_length)
+  {
+    Node         leaf;
+    unsigned int current = 0;
+
+    std::memcpy(leaf.prefix, prefix, (prefix_length + 7) / 8);
+    clearHostBits(leaf.prefix, MAX_ADDRESS_BYTES, prefix_length);
+    leaf.prefix_length = prefix_length;
+    leaf.terminal      = true;
+
+    while(true) {
+      // Invariant: leaf matches trie[current] on all of trie[current].prefix_length bits.
+      if(trie[current].prefix_length == prefix_length) {
+        bool added = !trie[current].terminal;
+        trie[current].terminal = true;
+        return added;
+      }
+
+      unsigned int direction = bitAt(leaf.prefix, trie[current].prefix_length);
+      unsigned int next      = trie[current].child[direction];
+
+      if(next == NO_CHILD) {
+        trie.push_back(leaf);
+        trie[current].child[direction] = trie.size() - 1;
+        return true;
+      }
+
+      unsigned int common = commonPrefixLength(leaf.prefix, trie[next].prefix, std::min(prefix_length, trie[next].prefix_length));
+
+      if(common == trie[next].prefix_length) {
+        current = next;
+        continue;
+      }
+
+      // leaf and the child part ways before the child's prefix ends: insert a node where they do.
+      Node fork;
+
+      std::memcpy(fork.prefix, leaf.prefix, MAX_ADDRESS_BYTES);
+      clearHostBits(fork.prefix, MAX_ADDRESS_BYTES, common);
+      fork.prefix_length = common;
+      fork.child[bitAt(trie[next].prefix, common)] = next;
+
+      if(common == prefix_length) {
+        fork.terminal = true;
+      } else {
+        trie.push_back(leaf);
+        fork.child[bitAt(leaf.prefix, common)] = trie.size() - 1;
+      }
+
+      trie.push_back(fork);
+      trie[current].child[direction] = trie.size() - 1;
+
+      return true;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  bool IpPrefixTrie::contains(const NodeList &trie, const unsigned char *address, unsigned int address_bits)
+  {
+    unsigned int current = 0;
+
+    while(true) {
+      const Node &node = trie[current];
+
+      if(commonPrefixLength(node.prefix, address, node.prefix_length) != node.prefix_length) {
+        return false;
+      }
+
+      if(node.terminal) {
+        return true;                                        // Any network containing the address will do.
+      }
+
+      if(node.prefix_length >= address_bits) {
+        return false;
+      }
+
+      current = node.child[bitAt(address, node.prefix_length)];
+
+      if(current == NO_CHILD) {
+        return false;
+      }
+    }
+  }
+}
@@ -0,0 +1,80 @@
+// File  : ip_prefix_trie.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _IP_PREFIX_TRIE_HPP_
+#define _IP_PREFIX_TRIE_HPP_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <boost/asio/ip/address.hpp>
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  // A set of IPv4 and IPv6 networks (CIDR notation), kept in two path compressed
+  // binary tries. Lookups take the raw address bytes, so a connection never has to
+  // turn its peer address into a string to be checked against a white-list.
+  //
+  // IPv4 mapped IPv6 addresses (::ffff:a.b.c.d) are matched against the IPv4 networks.
+  class IpPrefixTrie
+  {
+    public:
+      IpPrefixTrie();
+
+      //--------------------------------------------------------------------------------
+      // Adds "10.1.0.0/16", "2001:db8::/32", or a single address ("10.1.2.3").
+      // Throws std::invalid_argument if cidr can not be parsed.
+      void insert  (const std::string &cidr);
+      void insert  (const boost::asio::ip::address &network, unsigned int prefix_length);
+
+      bool contains(const boost::asio::ip::address &address) const;
+      bool contains(const unsigned char *address_bytes, std::size_t address_length) const; // 4 or 16 bytes, network byte order.
+
+      bool empty   () const throw() { return (entries == 0); }
+      std::size_t size() const throw() { return entries; }
+
+    protected:
+    private:
+      static const std::size_t  MAX_ADDRESS_BYTES = 16;
+      static const unsigned int NO_CHILD          = 0;     // The root is never anybody's child.
+
+      struct Node
+      {
+        Node() : prefix_length(0), terminal(false) { child[0] = child[1] = NO_CHILD; std::fill(prefix, prefix + MAX_ADDRESS_BYTES, 0); }
+
+        unsigned char prefix[MAX_ADDRESS_BYTES];
+        unsigned int  prefix_length;                       // In bits, counted from the root of the trie.
+        bool          terminal;                            // A network in the set ends here.
+        unsigned int  child[2];                            // Indexes into the node vector, by the bit after prefix_length.
+      };
+
+      typedef std::vector<Node> NodeList;
+
+      static bool insert  (NodeList &trie, const unsigned char *prefix, unsigned int prefix_length); // false if already present.
+      static bool contains(const NodeList &trie, const unsigned char *address, unsigned int address_bits);
+
+      NodeList    ipv4_trie;
+      NodeList    ipv6_trie;
+      std::size_t entries;
+  };
+}
+
+#endif // _IP_PREFIX_TRIE_HPP_
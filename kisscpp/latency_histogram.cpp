@@ -0,0 +1,196 @@
+// File  : latency_histogram.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <time.h>
+#include "latency_histogram.hpp"
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  LatencyHistogram::LatencyHistogram() : maximum(0), sum(0), takenCount(0), takenSum(0)
+  {
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      counts[i].store(0, boost::memory_order_relaxed);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void LatencyHistogram::record(uint64_t microseconds)
+  {
+    counts[bucketOf(microseconds)].fetch_add(1, boost::memory_order_relaxed);
+    sum.fetch_add(microseconds, boost::memory_order_relaxed);
+
+    uint64_t current = maximum.load(boost::memory_order_relaxed);
+
+    while(microseconds > current && !maximum.compare_exchange_weak(current, microseconds, boost::memory_order_relaxed)) {
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void LatencyHistogram::snapshot(LatencySummary &summary) const
+  {
+    LatencyCounts copy;
+
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      copy.buckets[i] = counts[i].load(boost::memory_order_relaxed);
+    }
+
+    copy.max = maximum.load(boost::memory_order_relaxed);
+    copy.sum = sum    .load(boost::memory_order_relaxed);
+    copy.summarize(summary);
+
+    summary.total_count = takenCount.load(boost::memory_order_relaxed) + summary.count;
+    summary.total_sum   = takenSum  .load(boost::memory_order_relaxed) + summary.sum;
+  }
+
+  //--------------------------------------------------------------------------------
+  void LatencyHistogram::take(LatencySummary &summary)
+  {
+    LatencyCounts copy;
+
+    take(copy);
+    copy.summarize(summary);
+
+    summary.total_count = takenCount.load(boost::memory_order_relaxed);
+    summary.total_sum   = takenSum  .load(boost::memory_order_relaxed);
+  }
+
+  //--------------------------------------------------------------------------------
+  // Bucket by bucket, so a value recorded meanwhile is counted now or next time.
+  void LatencyHistogram::take(LatencyCounts &copy)
+  {
+    uint64_t taken = 0;
+
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      copy.buckets[i] = counts[i].exchange(0, boost::memory_order_relaxed);
+      taken          += copy.buckets[i];
+    }
+
+    copy.max = maximum.exchange(0, boost::memory_order_relaxed);
+    copy.sum = sum    .exchange(0, boost::memory_order_relaxed);
+
+    takenCount.fetch_add(taken   , boost::memory_order_relaxed);
+    takenSum  .fetch_add(copy.sum, boost::memory_order_relaxed);
+  }
+
+  //--------------------------------------------------------------------------------
+  uint64_t LatencyHistogram::now()
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  //--------------------------------------------------------------------------------
+  uint64_t LatencyHistogram::cpuNow()
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  //--------------------------------------------------------------------------------
+  unsigned int LatencyHistogram::bucketOf(uint64_t value)
+  {
+    if(value < HISTOGRAM_SUB_BUCKETS) {
+      return value;
+    }
+
+    unsigned int magnitude = 63 - __builtin_clzll(value);
+
+    if(magnitude > HISTOGRAM_MAX_MAGNITUDE) {
+      return HISTOGRAM_BUCKETS - 1;
+    }
+
+    unsigned int shift = magnitude - HISTOGRAM_SUB_BUCKET_BITS;
+
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+  }
+
+  //--------------------------------------------------------------------------------
+  uint64_t LatencyHistogram::highestValueOf(unsigned int bucket)
+  {
+    if(bucket < HISTOGRAM_SUB_BUCKETS) {
+      return bucket;
+    }
+
+    unsigned int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t     sub   = bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+
+    return ((sub + 1) << shift) - 1;
+  }
+
+  //--------------------------------------------------------------------------------
+  void LatencyCounts::clear()
+  {
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      buckets[i] = 0;
+    }
+
+    max = 0;
+    sum = 0;
+  }
+
+  //--------------------------------------------------------------------------------
+  void LatencyCounts::add(const LatencyCounts &other)
+  {
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      buckets[i] += other.buckets[i];
+    }
+
+    max  = (other.max > max) ? other.max : max;
+    sum += other.sum;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Percentiles are reported as the highest value of the bucket they fall in, but
+  // never more than the largest value recorded.
+  void LatencyCounts::summarize(LatencySummary &summary) const
+  {
+    static const double  quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    uint64_t            *results  [] = { &summary.p50, &summary.p90, &summary.p99, &summary.p999 };
+    uint64_t             seen        = 0;
+    unsigned int         q           = 0;
+
+    summary.count = 0;
+    summary.max   = max;
+    summary.sum   = sum;
+
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      summary.count += buckets[i];
+    }
+
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS && q < 4; ++i) {
+      seen += buckets[i];
+
+      while(q < 4 && seen > 0 && seen >= quantiles[q] * summary.count) {
+        uint64_t value = LatencyHistogram::highestValueOf(i);
+        *results[q++]  = (value < max) ? value : max;
+      }
+    }
+
+    while(q < 4) {
+      *results[q++] = 0;
+    }
+  }
+}
@@ -0,0 +1,108 @@
+// File  : latency_histogram.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _LATENCY_HISTOGRAM_HPP_
+#define _LATENCY_HISTOGRAM_HPP_
+
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace kisscpp
+{
+  const unsigned int HISTOGRAM_SUB_BUCKET_BITS = 4;                                         // 16 buckets per power of 2, i.e. within 6.25%.
+  const unsigned int HISTOGRAM_SUB_BUCKETS     = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+  const unsigned int HISTOGRAM_MAX_MAGNITUDE   = 40;                                        // Values up to 2^41 - 1 microseconds, larger ones are counted there.
+  const unsigned int HISTOGRAM_BUCKETS         = (HISTOGRAM_MAX_MAGNITUDE - HISTOGRAM_SUB_BUCKET_BITS + 2) * HISTOGRAM_SUB_BUCKETS;
+
+  //--------------------------------------------------------------------------------
+  // What a histogram held, in microseconds.
+  struct LatencySummary
+  {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+    uint64_t sum;
+    uint64_t total_count; // Since the histogram was created, for monitoring that wants counters.
+    uint64_t total_sum;
+  };
+
+  //--------------------------------------------------------------------------------
+  // A plain copy of a histogram's buckets. Copies add up, to summarize longer periods.
+  struct LatencyCounts
+  {
+    LatencyCounts() { clear(); }
+
+    void clear    ();
+    void add      (const LatencyCounts &other);
+    void summarize(LatencySummary &summary) const;  // Leaves the totals alone.
+
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t max;
+    uint64_t sum;
+  };
+
+  //--------------------------------------------------------------------------------
+  // A latency histogram with log-linear buckets, in the style of HdrHistogram:
+  // values below 16 have a bucket each, above that every power of 2 is split in
+  // 16. Recording is a couple of atomic operations, without locking, so any
+  // number of threads can record into the same histogram.
+  class LatencyHistogram : private boost::noncopyable
+  {
+    public:
+      LatencyHistogram();
+
+      void            record  (uint64_t microseconds);
+      void            snapshot(LatencySummary &summary) const;
+      void            take    (LatencySummary &summary);       // Snapshot, and start over.
+      void            take    (LatencyCounts  &counts);        // Copy the buckets, and start over.
+
+      static uint64_t now     ();                              // Monotonic, in microseconds.
+      static uint64_t cpuNow  ();                              // CPU time of the calling thread, in microseconds.
+
+      static uint64_t highestValueOf(unsigned int bucket);     // The largest value that goes in bucket.
+
+    private:
+      static unsigned int bucketOf(uint64_t value);
+
+      boost::atomic<uint64_t> counts [HISTOGRAM_BUCKETS];
+      boost::atomic<uint64_t> maximum;
+      boost::atomic<uint64_t> sum;
+      boost::atomic<uint64_t> takenCount;                 // What take() started over from.
+      boost::atomic<uint64_t> takenSum;
+  };
+
+  //--------------------------------------------------------------------------------
+  // Records the time it was in scope.
+  class LatencyTimer : private boost::noncopyable
+  {
+    public:
+      explicit LatencyTimer(LatencyHistogram *h) : histogram(h), started(LatencyHistogram::now()) {}
+      ~LatencyTimer() { if(histogram) { histogram->record(LatencyHistogram::now() - started); } }
+
+    private:
+      LatencyHistogram *histogram;
+      uint64_t          started;
+  };
+}
+
+#endif // _LATENCY_HISTOGRAM_HPP_
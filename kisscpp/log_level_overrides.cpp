@@ -0,0 +1,159 @@
+// File  : log_level_overrides.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <boost/thread/locks.hpp>
+#include "log_level_overrides.hpp"
+
+namespace kisscpp
+{
+  boost::atomic<const LogLevelOverrides::OverrideList*> LogLevelOverrides::current(NULL);
+  std::vector<const LogLevelOverrides::OverrideList*>   LogLevelOverrides::retired;
+  boost::atomic<uint32_t>                               LogLevelOverrides::changes(1);
+  boost::mutex                                          LogLevelOverrides::updateMutex;
+
+  namespace
+  {
+    //--------------------------------------------------------------------------------
+    bool sourceMatches(const std::string &source, const std::string &key)
+    {
+      std::string::size_type pos = 0;
+
+      while(pos != std::string::npos) {
+        if(source.compare(pos, key.size(), key) == 0) {
+          return true;
+        }
+
+        pos = source.find(' ', pos);
+        pos = (pos == std::string::npos) ? pos : pos + 1;
+      }
+
+      return false;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  int LogLevelOverrides::find(const std::string &source, const std::string &entity)
+  {
+    const OverrideList *list         = current.load(boost::memory_order_acquire);
+    int                 level        = 0;
+    std::size_t         matched      = 0;
+    bool                entity_match = false;
+
+    if(list == NULL) {
+      return 0;
+    }
+
+    for(OverrideList::const_iterator it = list->begin(); it != list->end(); ++it) {
+      if(it->kind == LOK_ENTITY) {
+        if(!entity.empty() && it->key == entity) {
+          level        = it->level;
+          entity_match = true;
+        }
+      } else if(!entity_match && it->key.size() > matched && sourceMatches(source, it->key)) {
+        level   = it->level;
+        matched = it->key.size();
+      }
+    }
+
+    return level;
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogLevelOverrides::set(log_override_kind kind, const std::string &key, int level)
+  {
+    boost::lock_guard<boost::mutex> guard(updateMutex);
+
+    const OverrideList *old  = current.load();
+    OverrideList       *list = (old) ? new OverrideList(*old) : new OverrideList();
+    LogLevelOverride    entry;
+
+    entry.kind  = kind;
+    entry.key   = key;
+    entry.level = level;
+
+    for(OverrideList::iterator it = list->begin(); it != list->end(); ++it) {
+      if(it->kind == kind && it->key == key) {
+        it->level = level;
+        publish(list);
+        return;
+      }
+    }
+
+    list->push_back(entry);
+    publish(list);
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogLevelOverrides::remove(log_override_kind kind, const std::string &key)
+  {
+    boost::lock_guard<boost::mutex> guard(updateMutex);
+
+    const OverrideList *old = current.load();
+
+    if(old == NULL) {
+      return;
+    }
+
+    OverrideList *list = new OverrideList();
+
+    for(OverrideList::const_iterator it = old->begin(); it != old->end(); ++it) {
+      if(it->kind != kind || it->key != key) {
+        list->push_back(*it);
+      }
+    }
+
+    if(list->empty()) {
+      delete list;
+      list = NULL;
+    }
+
+    publish(list);
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogLevelOverrides::clear()
+  {
+    boost::lock_guard<boost::mutex> guard(updateMutex);
+
+    publish(NULL);
+  }
+
+  //--------------------------------------------------------------------------------
+  std::vector<LogLevelOverride> LogLevelOverrides::list()
+  {
+    boost::lock_guard<boost::mutex> guard(updateMutex);
+
+    const OverrideList *list = current.load();
+
+    return (list) ? *list : OverrideList();
+  }
+
+  //--------------------------------------------------------------------------------
+  // updateMutex must be held.
+  void LogLevelOverrides::publish(OverrideList *list)
+  {
+    const OverrideList *old = current.exchange(list, boost::memory_order_acq_rel);
+
+    changes.fetch_add(1, boost::memory_order_release);
+
+    if(old) {
+      retired.push_back(old);
+    }
+  }
+}
@@ -0,0 +1,76 @@
+// File  : log_level_overrides.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _LOG_LEVEL_OVERRIDES_HPP_
+#define _LOG_LEVEL_OVERRIDES_HPP_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  //! What a log level override applies to.
+  enum log_override_kind {
+    LOK_SOURCE = 0, //!< Log sources starting with the key, or with a word starting with it: "kisscpp::Connection::" matches "void kisscpp::Connection::start()".
+    LOK_ENTITY = 1  //!< The entity name equal to the key.
+  };
+
+  struct LogLevelOverride
+  {
+    log_override_kind kind;
+    std::string       key;
+    int               level;  // See logLevel().
+  };
+
+  //--------------------------------------------------------------------------------
+  // Log levels that apply to some log sources or entities, instead of the global
+  // level. Read without locking: every change publishes a new, immutable list.
+  // Replaced lists are never freed, readers do not tell when they are done with
+  // one; they are a few entries each, and only replaced by kch-loglevel.
+  class LogLevelOverrides
+  {
+    public:
+      // The level for source and entity, or 0 when no override applies. An entity
+      // override goes before a source override; of those, the longest key wins.
+      static int      find      (const std::string &source, const std::string &entity);
+      static bool     empty     ()                                { return (current.load(boost::memory_order_acquire) == NULL); }
+      static uint32_t generation()                                { return changes.load(boost::memory_order_acquire); }
+
+      static void     set       (log_override_kind kind, const std::string &key, int level);
+      static void     remove    (log_override_kind kind, const std::string &key);
+      static void     clear     ();
+      static std::vector<LogLevelOverride> list();
+
+    private:
+      typedef std::vector<LogLevelOverride> OverrideList;
+
+      static void publish(OverrideList *list);            // NULL when there are none.
+
+      static boost::atomic<const OverrideList*> current;
+      static std::vector<const OverrideList*>    retired; // Every list current replaced.
+      static boost::atomic<uint32_t>             changes;
+      static boost::mutex                        updateMutex;
+  };
+}
+
+#endif // _LOG_LEVEL_OVERRIDES_HPP_
@@ -0,0 +1,112 @@
+// File  : log_limiter.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <time.h>
+#include "binary_log.hpp"
+#include "logstream.hpp"
+#include "log_limiter.hpp"
+
+namespace kisscpp
+{
+  boost::atomic<uint32_t> LogLimiter::rateLimit(0);
+  boost::atomic<uint32_t> LogLimiter::samplePpm(LOG_SAMPLE_ALL);
+
+  namespace
+  {
+    struct SiteState
+    {
+      boost::atomic<uint32_t> second;                       // The second count applies to.
+      boost::atomic<uint32_t> count;
+      boost::atomic<uint32_t> suppressed;
+    };
+
+    SiteState         sites[BINARY_LOG_MAX_STRINGS];        // By the id BinaryLog::intern() hands out for the call site.
+    __thread uint64_t randomState = 0;
+
+    //--------------------------------------------------------------------------------
+    // xorshift64*, good enough for sampling, and nothing shared between threads.
+    uint32_t nextRandom()
+    {
+      if(randomState == 0) {
+        randomState = (reinterpret_cast<uintptr_t>(&randomState) ^ static_cast<uint64_t>(time(NULL))) | 1;
+      }
+
+      randomState ^= randomState >> 12;
+      randomState ^= randomState << 25;
+      randomState ^= randomState >> 27;
+
+      return static_cast<uint32_t>((randomState * 0x2545F4914F6CDD1DULL) >> 32);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogLimiter::setSample(double fraction)
+  {
+    if(fraction < 0.0) { fraction = 0.0; }
+    if(fraction > 1.0) { fraction = 1.0; }
+
+    samplePpm.store(static_cast<uint32_t>(fraction * LOG_SAMPLE_ALL + 0.5));
+  }
+
+  //--------------------------------------------------------------------------------
+  bool LogLimiter::limit(const char *site, int type, int severity)
+  {
+    uint32_t ppm  = samplePpm.load(boost::memory_order_relaxed);
+    uint32_t rate = rateLimit.load(boost::memory_order_relaxed);
+
+    if(ppm < LOG_SAMPLE_ALL && (nextRandom() % LOG_SAMPLE_ALL) >= ppm) {
+      return false;
+    }
+
+    if(rate == 0) {
+      return true;
+    }
+
+    uint32_t id = BinaryLog::intern(site);
+
+    if(id == BINARY_LOG_NO_ID) {
+      return true;                                          // Too many call sites to keep track of.
+    }
+
+    SiteState &state  = sites[id];
+    uint32_t   now    = static_cast<uint32_t>(time(NULL));
+    uint32_t   second = state.second.load(boost::memory_order_relaxed);
+
+    if(second != now && state.second.compare_exchange_strong(second, now)) {
+      uint32_t suppressed = state.suppressed.exchange(0);
+
+      state.count.store(0);
+
+      if(suppressed > 0) {
+        LogStream log("kisscpp::LogLimiter");
+
+        log.setLevel(static_cast<log_type>(type), static_cast<log_severity>(severity))
+           << "[" << suppressed << "] log lines suppressed at " << std::string(site) << manip::endl;
+      }
+    }
+
+    if(state.count.fetch_add(1, boost::memory_order_relaxed) < rate) {
+      return true;
+    }
+
+    state.suppressed.fetch_add(1, boost::memory_order_relaxed);
+
+    return false;
+  }
+}
@@ -0,0 +1,64 @@
+// File  : log_limiter.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _LOG_LIMITER_HPP_
+#define _LOG_LIMITER_HPP_
+
+#include <stdint.h>
+#include <boost/atomic.hpp>
+
+#define LOG_SAMPLE_ALL 1000000   // Parts per million: keep every line.
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  // Rate limiting and sampling of log lines, per call site of the KISSCPP_LOG macros.
+  //
+  // A call site may write rateLimit lines per second, the rest are counted and
+  // reported, with the next line that call site writes. Sampling keeps a random
+  // fraction of the lines, before rate limiting. Both are off by default, and then
+  // cost a single check.
+  //
+  // Call sites are told apart by the address of their "file:line" string literal.
+  class LogLimiter
+  {
+    public:
+      static bool admit(const char *site, int type, int severity) // type and severity of the line, for the suppressed summary.
+      {
+        if(rateLimit.load(boost::memory_order_relaxed) == 0 && samplePpm.load(boost::memory_order_relaxed) >= LOG_SAMPLE_ALL) {
+          return true;
+        }
+
+        return limit(site, type, severity);
+      }
+
+      static void     setRateLimit(uint32_t lines_per_second) { rateLimit.store(lines_per_second); } // 0: no limit.
+      static void     setSample   (double   fraction);                                           // 0.0 to 1.0
+      static uint32_t getRateLimit()                           { return rateLimit.load(); }
+      static double   getSample   ()                           { return samplePpm.load() / static_cast<double>(LOG_SAMPLE_ALL); }
+
+    private:
+      static bool limit(const char *site, int type, int severity);
+
+      static boost::atomic<uint32_t> rateLimit;
+      static boost::atomic<uint32_t> samplePpm;
+  };
+}
+
+#endif // _LOG_LIMITER_HPP_
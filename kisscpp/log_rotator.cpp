@@ -0,0 +1,202 @@
+// File  : log_rotator.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <cstdio>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include "log_rotator.hpp"
+
+extern char **environ;
+
+namespace kisscpp
+{
+  namespace
+  {
+    boost::mutex finishMutex;                               // One rotated file is finished at a time, so removing old files never races compressing them.
+
+    //--------------------------------------------------------------------------------
+    void compressFile(const std::string &path)
+    {
+      pid_t  pid;
+      int    status;
+      char   gzip[]  = "gzip";
+      char   force[] = "-f";
+      char  *argv[]  = { gzip, force, const_cast<char*>(path.c_str()), NULL };
+
+      if(posix_spawnp(&pid, "gzip", NULL, NULL, argv, environ) == 0) {
+        waitpid(pid, &status, 0);                           // A pre-fork master only reaps its workers, by pid, so this is ours to wait for.
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    // Removes the oldest rotated files of path, beyond the newest keep.
+    void removeOldFiles(const std::string &path, unsigned int keep)
+    {
+      std::string::size_type slash     = path.rfind('/');
+      std::string            directory = (slash == std::string::npos) ? "." : path.substr(0, slash);
+      std::string            prefix    = ((slash == std::string::npos) ? path : path.substr(slash + 1)) + ".";
+      DIR                   *dir       = opendir(directory.c_str());
+      struct dirent         *entry;
+
+      std::vector<std::pair<time_t, std::string> > rotated;
+
+      if(dir == NULL) {
+        return;
+      }
+
+      while((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        struct stat st;
+
+        if(name.compare(0, prefix.size(), prefix) == 0 && stat((directory + "/" + name).c_str(), &st) == 0) {
+          rotated.push_back(std::make_pair(st.st_mtime, directory + "/" + name));
+        }
+      }
+
+      closedir(dir);
+
+      if(rotated.size() <= keep) {
+        return;
+      }
+
+      std::sort(rotated.begin(), rotated.end());
+
+      for(std::size_t i = 0; i < rotated.size() - keep; ++i) {
+        unlink(rotated[i].second.c_str());
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    void finishRotation(const std::string path, const std::string rotated, bool compress, unsigned int keep)
+    {
+      boost::lock_guard<boost::mutex> guard(finishMutex);
+
+      if(compress) {
+        compressFile(rotated);
+      }
+
+      if(keep > 0) {
+        removeOldFiles(path, keep);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  LogRotator::LogRotator(const LogRotation &r /* = LogRotation() */) :
+    rotation    (r),
+    fileSize    (0),
+    fileDevice  (0),
+    fileInode   (0),
+    lastCheck   (0),
+    nextRotation(0)
+  {
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogRotator::opened(const std::string &path)
+  {
+    struct stat st;
+
+    if(stat(path.c_str(), &st) == 0) {
+      fileSize   = st.st_size;
+      fileDevice = st.st_dev;
+      fileInode  = st.st_ino;
+    }
+
+    lastCheck = time(NULL);
+
+    if(rotation.interval > 0 && nextRotation == 0) {
+      nextRotation = (lastCheck / rotation.interval + 1) * rotation.interval;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  bool LogRotator::check(const std::string &path, std::size_t bytes)
+  {
+    if(!rotation.enabled()) {
+      return false;
+    }
+
+    time_t now = time(NULL);
+
+    if(now != lastCheck) {
+      struct stat st;
+
+      lastCheck = now;
+
+      if(stat(path.c_str(), &st) != 0 || st.st_dev != fileDevice || st.st_ino != fileInode) {
+        return true;                                        // Rotated, or removed, by someone else.
+      }
+
+      fileSize = st.st_size;
+
+      if(!rotation.follow_only && rotation.interval > 0 && now >= nextRotation) {
+        nextRotation = (now / rotation.interval + 1) * rotation.interval;
+
+        if(fileSize > 0) {
+          rotate(path, now);
+          return true;
+        }
+      }
+    }
+
+    if(!rotation.follow_only && rotation.max_bytes > 0 && fileSize > 0 && fileSize + bytes > rotation.max_bytes) {
+      rotate(path, now);
+      return true;
+    }
+
+    return false;
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogRotator::rotate(const std::string &path, time_t now)
+  {
+    struct tm   local;
+    struct stat st;
+    char        suffix[32];
+
+    localtime_r(&now, &local);
+    strftime(suffix, sizeof(suffix), ".%Y%m%dT%H%M%S", &local);
+
+    std::string rotated = path + suffix;
+
+    for(unsigned int n = 1; stat(rotated.c_str(), &st) == 0 || stat((rotated + ".gz").c_str(), &st) == 0; ++n) {
+      rotated = path + suffix + "-" + boost::lexical_cast<std::string>(n);
+    }
+
+    if(std::rename(path.c_str(), rotated.c_str()) != 0) {
+      return;
+    }
+
+    if(rotation.compress || rotation.keep > 0) {
+      boost::thread(boost::bind(&finishRotation, path, rotated, rotation.compress, rotation.keep)).detach();
+    }
+  }
+}
@@ -0,0 +1,77 @@
+// File  : log_rotator.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _LOG_ROTATOR_HPP_
+#define _LOG_ROTATOR_HPP_
+
+#include <string>
+#include <sys/types.h>
+#include <time.h>
+#include <stdint.h>
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  //! When, and how, log files are rotated. Nothing is rotated with the defaults.
+  struct LogRotation
+  {
+    LogRotation() : max_bytes(0), interval(0), keep(0), compress(false), follow_only(false) {}
+
+    uint64_t     max_bytes;   //!< Rotate when the file would grow beyond this. 0: no limit.
+    unsigned int interval;    //!< Rotate every this many seconds, on multiples of it since the epoch. 0: never.
+    unsigned int keep;        //!< Rotated files to keep, the oldest are removed. 0: keep them all.
+    bool         compress;    //!< gzip rotated files, in the background.
+    bool         follow_only; //!< Never rotate, only notice another process rotating the file (pre-forked workers).
+
+    bool enabled() const { return (max_bytes > 0 || interval > 0 || follow_only); }
+  };
+
+  //--------------------------------------------------------------------------------
+  // Rotates a log file on behalf of the one thread that writes it: the writer thread
+  // when logging asynchronously, or whoever holds LogStream's mutex.
+  //
+  // A rotated file is renamed to <path>.<YYYYMMDDTHHMMSS>, and the writer opens a new
+  // one at path. Compression and removing old files happen on a thread of their own,
+  // so the writer never waits for either. The file is looked at (stat) at most once a
+  // second, which also notices another process rotating it.
+  class LogRotator
+  {
+    public:
+      explicit LogRotator(const LogRotation &r = LogRotation());
+
+      void configure(const LogRotation &r) { rotation = r; nextRotation = 0; }
+      bool enabled  () const               { return rotation.enabled(); }
+
+      void opened   (const std::string &path);              // The writer (re)opened path.
+      bool check    (const std::string &path, std::size_t bytes); // Before writing bytes: true when the file has to be closed and opened again.
+      void wrote    (std::size_t bytes) { fileSize += bytes; }
+
+    private:
+      void rotate   (const std::string &path, time_t now);
+
+      LogRotation rotation;
+      uint64_t    fileSize;                                 // Last seen size, plus what was written since.
+      dev_t       fileDevice;
+      ino_t       fileInode;
+      time_t      lastCheck;
+      time_t      nextRotation;
+  };
+}
+
+#endif // _LOG_ROTATOR_HPP_
@@ -16,6 +16,11 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
 
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
 #include "logstream.hpp"
 
 namespace kisscpp
@@ -25,9 +30,50 @@ namespace kisscpp
   bool                    LogStream::log2consoleFlag;
   boost::mutex            LogStream::objMutex;
   std::string             LogStream::outFilePath;
-  std::ofstream           LogStream::outFile;
+  int                     LogStream::outFd               = -1;
   std::deque<std::string> LogStream::stringPool;
   unsigned int            LogStream::maxBufferSize;
+  AsyncLogWriter         *LogStream::asyncWriter         = NULL;
+  std::size_t             LogStream::asyncQueueSize      = DEFAULT_ASYNC_LOG_QUEUE;
+  log_overflow_policy     LogStream::asyncOverflowPolicy = LO_COUNT;
+  bool                    LogStream::coarseClock         = false;
+  bool                    LogStream::binaryFormat        = false;
+  BinaryLogDefinitions    LogStream::binaryDefinitions;
+  LogRotation             LogStream::rotation;
+  LogRotator              LogStream::rotator;
+
+  namespace
+  {
+    // The last timestamp formatted by a thread. Only the fraction changes within a second.
+    struct TimestampCache
+    {
+      time_t second;
+      char   text[LOG_TIMESTAMP_LENGTH + 1];
+    };
+
+    __thread TimestampCache timestampCache = { -1, { 0 } };
+
+    // Writes out whatever is still queued for the writer thread, when the process exits.
+    struct AsyncLogStopper
+    {
+      ~AsyncLogStopper() { LogStream::stopAsync(); }
+    } asyncLogStopper;
+
+    //--------------------------------------------------------------------------------
+    void writeAll(int fd, const std::string &data)
+    {
+      std::size_t written = 0;
+
+      while(written < data.size()) {
+        ssize_t rc = ::write(fd, data.data() + written, data.size() - written);
+
+        if(rc < 0 && errno == EINTR) { continue; }
+        if(rc <= 0)                  { return;   } // Nowhere to report it, the log is where we would.
+
+        written += rc;
+      }
+    }
+  }
 
   //--------------------------------------------------------------------------------
   LogStream& LogStream::setMessageType(std::string mt, const bool permanent /*= false*/)
@@ -55,8 +101,97 @@ namespace kisscpp
   void LogStream::set2ReOpen()
   {
     boost::lock_guard<boost::mutex> guard(objMutex);
-    outFile.close();
-    // TODO: Rename the file.
+
+    if(outFd >= 0) {
+      ::close(outFd);
+      outFd = -1;
+    }
+
+    if(asyncWriter) {
+      asyncWriter->reopen();
+    }
+    // Rotated by an external tool. See setRotation() for rotating it ourselves.
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogStream::setRotation(const LogRotation &r)
+  {
+    boost::lock_guard<boost::mutex> guard(objMutex);
+
+    rotation = r;
+    rotator.configure(r);
+  }
+
+  //--------------------------------------------------------------------------------
+  // The writer thread checks on its own while idle, when logging asynchronously.
+  void LogStream::checkRotation()
+  {
+    if(asyncWriter || !rotator.enabled()) {
+      return;
+    }
+
+    try {
+      boost::lock_guard<boost::mutex> guard(objMutex);
+
+      if(outFd < 0) {
+        openLogFile();
+      }
+
+      writePool();
+    } catch(std::runtime_error &e) {
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogStream::startAsync(std::size_t queue_size /* = DEFAULT_ASYNC_LOG_QUEUE */, log_overflow_policy policy /* = LO_COUNT */)
+  {
+    boost::lock_guard<boost::mutex> guard(objMutex);
+
+    if(asyncWriter) {
+      return;
+    }
+
+    if(outFd >= 0) {                                        // Whatever was logged so far goes first.
+      writePool();
+      ::close(outFd);
+      outFd = -1;
+    }
+
+    asyncQueueSize      = queue_size;
+    asyncOverflowPolicy = policy;
+    asyncWriter         = new AsyncLogWriter(outFilePath, log2consoleFlag, asyncQueueSize, asyncOverflowPolicy, binaryFormat, rotation);
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogStream::stopAsync()
+  {
+    AsyncLogWriter *writer = asyncWriter;
+
+    asyncWriter = NULL;
+    delete writer;
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogStream::afterFork()
+  {
+    BinaryLog::afterFork();
+    binaryDefinitions.reset();                              // The parent's definitions are by its pid.
+    stringPool.clear();                                     // The parent writes those out.
+
+    rotation.follow_only = true;
+    rotator.configure(rotation);
+
+    if(asyncWriter) {
+      // The old writer's thread only exists in the parent, so it can not be joined
+      // here: it is left behind, and the parent writes out what it had queued.
+      asyncWriter = new AsyncLogWriter(outFilePath, log2consoleFlag, asyncQueueSize, asyncOverflowPolicy, binaryFormat, rotation);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  uint64_t LogStream::getDroppedRecords()
+  {
+    return (asyncWriter) ? asyncWriter->droppedRecords() : 0;
   }
 
   //--------------------------------------------------------------------------------
@@ -64,7 +199,7 @@ namespace kisscpp
   {
     doFlush = b;
     write();
-    mBuf.str("");
+    if(mBuf) { mBuf->str(""); }
     lssTemp.setMessageType(lssPerm.getMessageType());
     lssTemp.setSeverity   (lssPerm.getSeverity()   );
   };
@@ -72,79 +207,268 @@ namespace kisscpp
   //--------------------------------------------------------------------------------
   void LogStream::start_write() const
   {
-    if(lssPerm.getMessageType() <= LT_DEBUG &&
-       lssPerm.getSeverity   () <= LS_LOW) {
-      std::string msg  = "+ [" + getSource() + "]";
-      locked_write(msg);
-    }
+    std::string msg  = "+ [" + getSource() + "]";
+    locked_write(msg, logLevel(LT_DEBUG, LS_LOW));
   }
 
   //--------------------------------------------------------------------------------
   void LogStream::end_write() const
   {
-    if(lssPerm.getMessageType() <= LT_DEBUG &&
-       lssPerm.getSeverity   () <= LS_LOW) {
-      std::string msg  = "- [" + getSource() + "]";
-      locked_write(msg);
-    }
+    std::string msg  = "- [" + getSource() + "]";
+    locked_write(msg, logLevel(LT_DEBUG, LS_LOW));
   }
 
   //--------------------------------------------------------------------------------
   void LogStream::write() const
   {
-    if        (lssPerm.getMessageType() <  lssTemp.getMessageType()) {
-      std::string msg = ": " + mBuf.str();
-      locked_write(msg);
-    } else if (lssPerm.getMessageType() == lssTemp.getMessageType() &&
-               lssPerm.getSeverity   () <= lssTemp.getSeverity   ()) {
-      std::string msg = ": " + mBuf.str();
-      locked_write(msg);
+    if(isEnabled()) {
+      std::string msg = ": " + ((mBuf) ? mBuf->str() : std::string());
+      locked_write(msg, logLevel(lssTemp.getMessageType(), lssTemp.getSeverity()));
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // Matching the overrides is done once per LogStream, and again when they changed.
+  int LogStream::overriddenThreshold() const
+  {
+    uint32_t generation = LogLevelOverrides::generation();
+
+    if(generation != overrideGeneration) {
+      overrideLevel      = LogLevelOverrides::find(getSource(), getEntityName());
+      overrideGeneration = generation;
+    }
+
+    return (overrideLevel > 0) ? overrideLevel : logLevel(lssPerm.getMessageType(), lssPerm.getSeverity());
+  }
+
+  //--------------------------------------------------------------------------------
+  const std::string& LogStream::getSource() const
+  {
+    if(!lssTemp.getSource().empty()) {
+      return lssTemp.getSource();
+    } else if(rawSource != NULL) {
+      if(sourceCache.empty()) {
+        sourceCache = rawSource;
+      }
+      return sourceCache;
+    } else {
+      return lssPerm.getSource();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  const char *LogStream::timestamp()
+  {
+    struct timespec  now;
+    TimestampCache  &cache = timestampCache;
+
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime((coarseClock) ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME, &now);
+#else
+    clock_gettime(CLOCK_REALTIME, &now);
+#endif
+
+    if(now.tv_sec != cache.second) {
+      struct tm local;
+
+      localtime_r(&now.tv_sec, &local);
+      strftime(cache.text, sizeof(cache.text), "%Y%m%dT%H%M%S.", &local);
+      cache.second = now.tv_sec;
+    }
+
+    long  usec = now.tv_nsec / 1000;
+    char *frac = cache.text + LOG_TIMESTAMP_LENGTH;
+
+    for(int i = 0; i < 6; ++i) {
+      *--frac = static_cast<char>('0' + (usec % 10));
+      usec   /= 10;
+    }
+
+    return cache.text;
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogStream::locked_write(std::string &s, int level) const
+  {
+    const std::string &source = getSource();
+    std::string        str;
+
+    if(binaryFormat) {
+      BinaryLog::textRecord(str, BinaryLog::now(coarseClock), level, source, s);
+    } else {
+      str.reserve(LOG_TIMESTAMP_LENGTH + source.size() + s.size() + 4);
+      str.append(timestamp(), LOG_TIMESTAMP_LENGTH);
+      str.append(" [");
+      str.append(source);
+      str.append("] ");
+      str.append(s);
     }
+
+    store(str);
   }
 
   //--------------------------------------------------------------------------------
-  void LogStream::locked_write(std::string &s) const
+  void LogStream::store(std::string &str) const
   {
-    boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
-    std::string              str = boost::posix_time::to_iso_string(now) + " [" + getSource() + "] " + s;
+    if(asyncWriter) {
+      asyncWriter->push(str, doFlush);
+      return;
+    }
 
     try {
       boost::lock_guard<boost::mutex> guard(objMutex);
-      if(!outFile.is_open()) {
+      if(outFd < 0) {
         openLogFile();
       }
 
       stringPool.push_back(str);
 
-      if((stringPool.size() > maxBufferSize || doFlush) && outFile.is_open()) {
-        while(stringPool.size() > 0) {
-          outFile << stringPool.front() << std::endl;
-          if(log2consoleFlag) {
-            std::cout << stringPool.front() << std::endl;
-          }
-          stringPool.pop_front();
-        }
-        outFile << std::flush;
+      if((stringPool.size() > maxBufferSize || doFlush) && outFd >= 0) {
+        writePool();
       }
     } catch(std::runtime_error &e) {
       stringPool.push_back(str);
     }
   }
 
+  //--------------------------------------------------------------------------------
+  // objMutex must be held. The pool goes out in a single write(), of whole lines.
+  void LogStream::writePool()
+  {
+    std::string out;
+
+    if(rotator.enabled()) {
+      std::size_t bytes = 0;
+
+      for(std::deque<std::string>::const_iterator it = stringPool.begin(); it != stringPool.end(); ++it) {
+        bytes += it->size() + 1;
+      }
+
+      if(rotator.check(outFilePath, bytes)) {
+        ::close(outFd);
+        outFd = -1;
+        openLogFile();
+      }
+    }
+
+    while(stringPool.size() > 0) {
+      if(binaryFormat) {
+        binaryDefinitions.prepare(stringPool.front(), out);
+      } else {
+        out.append(stringPool.front());
+        out.push_back('\n');
+        if(log2consoleFlag) {
+          std::cout << stringPool.front() << std::endl;
+        }
+      }
+      stringPool.pop_front();
+    }
+
+    writeAll(outFd, out);
+    rotator.wrote(out.size());
+  }
+
   //--------------------------------------------------------------------------------
   void LogStream::openLogFile()
   {
     if(outFilePath.size() <= 0) {
       throw std::runtime_error("Log System has no file path set!");
     } else {
-      try {
-        outFile.open(outFilePath.c_str(), std::ios::out | std::ios::app);
-      } catch(const std::ios_base::failure& e) {
+      outFd = ::open(outFilePath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+
+      if(outFd < 0) {
         std::stringstream tss;
-        tss << "Failed to open log file [" << outFilePath << "]" << "(" << e.what() << ")";
+        tss << "Failed to open log file [" << outFilePath << "]" << "(" << std::strerror(errno) << ")";
         throw std::runtime_error(tss.str());
       }
+
+      rotator.opened(outFilePath);
+
+      if(binaryFormat) {
+        std::string header;
+
+        BinaryLog::header(header);
+        writeAll(outFd, header);
+        binaryDefinitions.reset();
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  LogRecord::LogRecord(LogStream &s, log_type type, log_severity severity, const char *format) :
+    stream(s),
+    rest  (format)
+  {
+    if(LogStream::binaryFormat) {
+      BinaryLog::beginEntry(record,
+                            BinaryLog::now(LogStream::coarseClock),
+                            logLevel(type, severity),
+                            (s.lssTemp.getSource().empty()) ? s.rawSource : NULL,
+                            s.getSource(),
+                            format);
+    } else {
+      stream.setLevel(type, severity);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  LogRecord::~LogRecord()
+  {
+    if(LogStream::binaryFormat) {
+      BinaryLog::endRecord(record);
+      stream.store(record);
+    } else {
+      stream << std::string(rest);
+      stream.endl();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void LogRecord::nextText()
+  {
+    const char *mark = std::strstr(rest, "{}");
+
+    if(mark == NULL) {
+      stream << std::string(rest) << std::string(" ");
+      rest += std::strlen(rest);
+    } else {
+      stream << std::string(rest, mark - rest);
+      rest = mark + 2;
     }
   }
-}
 
+  //--------------------------------------------------------------------------------
+  LogRecord& LogRecord::operator<< (const std::string &v)
+  {
+    if(LogStream::binaryFormat) { BinaryLog::addString(record, v); } else { nextText(); stream << v; }
+    return *this;
+  }
+
+  //--------------------------------------------------------------------------------
+  LogRecord& LogRecord::operator<< (const char *v)
+  {
+    if(LogStream::binaryFormat) { BinaryLog::addString(record, v); } else { nextText(); stream << std::string(v); }
+    return *this;
+  }
+
+  //--------------------------------------------------------------------------------
+  LogRecord& LogRecord::operator<< (const double v)
+  {
+    if(LogStream::binaryFormat) { BinaryLog::addDouble(record, v); } else { nextText(); stream << v; }
+    return *this;
+  }
+
+  //--------------------------------------------------------------------------------
+  LogRecord& LogRecord::signedArg(long long v)
+  {
+    if(LogStream::binaryFormat) { BinaryLog::addInt(record, v); } else { nextText(); stream << static_cast<long>(v); }
+    return *this;
+  }
+
+  //--------------------------------------------------------------------------------
+  LogRecord& LogRecord::unsignedArg(unsigned long long v)
+  {
+    if(LogStream::binaryFormat) { BinaryLog::addUInt(record, v); } else { nextText(); stream << v; }
+    return *this;
+  }
+}
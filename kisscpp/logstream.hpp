@@ -29,8 +29,52 @@
 #include <boost/thread/locks.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "async_log_writer.hpp"
+#include "binary_log.hpp"
+#include "log_rotator.hpp"
+#include "log_limiter.hpp"
+#include "log_level_overrides.hpp"
+
+#define DEFAULT_MAX_BUFF_SIZE   5000
+#define DEFAULT_ASYNC_LOG_QUEUE 65536
+#define LOG_TIMESTAMP_LENGTH    22    // YYYYMMDDTHHMMSS.ffffff
+
+//--------------------------------------------------------------------------------
+// Log levels below this (see logLevel()) are compiled out of the KISSCPP_LOG
+// macros, and never written. i.e. -DKISSCPP_LOG_MIN_LEVEL=4 removes all debug logging.
+// Use the same value for the library and the application.
+#ifndef KISSCPP_LOG_MIN_LEVEL
+#define KISSCPP_LOG_MIN_LEVEL 1
+#endif
+
+//--------------------------------------------------------------------------------
+// Level checked logging. Nothing after the macro is evaluated, when the level is disabled,
+// or the line is rate limited or not sampled (see LogLimiter):
+//
+//   KISSCPP_LOG(log, kisscpp::LT_DEBUG, kisscpp::LS_NORMAL) << "state: " << describe(state) << kisscpp::manip::endl;
+//   KISSCPP_DEBUG(log, LS_LOW) << "entered loop" << kisscpp::manip::endl;
+#define KISSCPP_LOG_STRINGIFY_(x) #x
+#define KISSCPP_LOG_STRINGIFY(x)  KISSCPP_LOG_STRINGIFY_(x)
+#define KISSCPP_LOG_SITE          __FILE__ ":" KISSCPP_LOG_STRINGIFY(__LINE__)
+
+#define KISSCPP_LOG_ADMIT(stream, type, severity) \
+  ((stream).isEnabled((type), (severity)) && kisscpp::LogLimiter::admit(KISSCPP_LOG_SITE, (type), (severity)))
+
+#define KISSCPP_LOG(stream, type, severity) \
+  if(!KISSCPP_LOG_ADMIT(stream, type, severity)) {} else (stream).setLevel((type), (severity))
 
-#define DEFAULT_MAX_BUFF_SIZE 5000
+#define KISSCPP_DEBUG(stream, severity) KISSCPP_LOG(stream, kisscpp::LT_DEBUG, kisscpp::severity)
+#define KISSCPP_INFO(stream, severity)  KISSCPP_LOG(stream, kisscpp::LT_INFO , kisscpp::severity)
+#define KISSCPP_ERROR(stream, severity) KISSCPP_LOG(stream, kisscpp::LT_ERROR, kisscpp::severity)
+
+//--------------------------------------------------------------------------------
+// Level checked logging with a format string literal, {} marking where arguments go.
+// In the binary log format, only the arguments are recorded (see LogRecord):
+//
+//   KISSCPP_LOGF(log, kisscpp::LT_INFO, kisscpp::LS_NORMAL, "Request from [{}:{}]") << address << port;
+#define KISSCPP_LOGF(stream, type, severity, format) \
+  if(!KISSCPP_LOG_ADMIT(stream, type, severity)) {} else kisscpp::LogRecord((stream), (type), (severity), ("" format))
 
 namespace kisscpp
 {
@@ -49,8 +93,12 @@ namespace kisscpp
     LS_HIGH   = 2    //!< High
   };
 
+  //! The log level (1 to 9) of a type and severity combination.
+  inline int logLevel(log_type type, log_severity severity) { return (type * 3) + severity + 1; }
+
   //--------------------------------------------------------------------------------
   class LogStream;
+  class LogRecord;
 
   #pragma GCC visibility push(default)
 
@@ -151,7 +199,7 @@ namespace kisscpp
       // constructors
       // ------------
       explicit
-      LogStream(manip_func1  manip = info_normal)
+      LogStream(manip_func1  manip = info_normal) : rawSource(NULL), overrideGeneration(0), overrideLevel(0)
       {
         manip(*this, false);
         lssTemp = lssPerm;
@@ -159,7 +207,7 @@ namespace kisscpp
       }
 
       // ------------
-      LogStream(manip_func1 manip, const std::string &src)
+      LogStream(manip_func1 manip, const std::string &src) : rawSource(NULL), overrideGeneration(0), overrideLevel(0)
       {
         lssTemp = lssPerm;
         doFlush = false;
@@ -168,20 +216,31 @@ namespace kisscpp
       }
 
       // ------------
-      explicit LogStream(const std::string &src)
+      explicit LogStream(const std::string &src) : rawSource(NULL), overrideGeneration(0), overrideLevel(0)
       {
         lssTemp = lssPerm;
         doFlush = false;
         info_normal(*this, false);
         setSource(src);
-        start_write();
+        if(isEnabled(LT_DEBUG, LS_LOW)) { start_write(); }
+      }
+
+      // ------------
+      // The usual LogStream log(__PRETTY_FUNCTION__); Only keeps the pointer, the source
+      // string is not built unless something is actually written.
+      explicit LogStream(const char *src) : rawSource(src), overrideGeneration(0), overrideLevel(0)
+      {
+        lssTemp = lssPerm;
+        doFlush = false;
+        info_normal(*this, false);
+        if(isEnabled(LT_DEBUG, LS_LOW)) { start_write(); }
       }
 
       // ------------
       LogStream(const std::string &src,
                 const std::string &path,
                 const bool         log2console = false,
-                const unsigned int i           = DEFAULT_MAX_BUFF_SIZE)
+                const unsigned int i           = DEFAULT_MAX_BUFF_SIZE) : rawSource(NULL), overrideGeneration(0), overrideLevel(0)
       {
         lssTemp = lssPerm;
         doFlush = false;
@@ -190,66 +249,86 @@ namespace kisscpp
         log2consoleFlag = log2console;
         outFilePath     = path;
         maxBufferSize   = i;
-        start_write();
+        if(isEnabled(LT_DEBUG, LS_LOW)) { start_write(); }
       }
 
-      LogStream(const LogStream &o) : lssTemp(o.lssTemp)
+      LogStream(const LogStream &o) : lssTemp(o.lssTemp), rawSource(o.rawSource), overrideGeneration(0), overrideLevel(0)
       {
 //        lssTemp       = o.lssTemp;
         doFlush       = false;
         maxBufferSize = o.maxBufferSize;
-        start_write();
+        if(isEnabled(LT_DEBUG, LS_LOW)) { start_write(); }
       }
 
       ~LogStream()
       {
-        end_write();
-        if(mBuf.tellp() > 0) { flush(); }
+        if(isEnabled(LT_DEBUG, LS_LOW)) { end_write(); }
+        if(mBuf && mBuf->tellp() > 0) { flush(); }
       };
 
       LogStream& operator=(const LogStream& o)
       { 
         if(&o != this) {
           lssTemp       = o.lssTemp;
+          rawSource     = o.rawSource;
+          overrideGeneration = 0;
           maxBufferSize = o.maxBufferSize;
         }
         return *this;
       }
 
+      // Would a line of this type and severity be written? Cheap enough to call before building a log line.
+      bool isEnabled(log_type type, log_severity severity) const
+      {
+        return (logLevel(type, severity) >= KISSCPP_LOG_MIN_LEVEL && logLevel(type, severity) >= threshold());
+      }
+
+      // The lowest level written: the global level, unless an override applies to this source or entity (see LogLevelOverrides).
+      int threshold() const
+      {
+        if(LogLevelOverrides::empty()) {
+          return logLevel(lssPerm.getMessageType(), lssPerm.getSeverity());
+        }
+
+        return overriddenThreshold();
+      }
+
+      bool isEnabled() const { return isEnabled(lssTemp.getMessageType(), lssTemp.getSeverity()); } // For the current line.
+
       // Output operator for manipulators
       LogStream& operator<< (manip_func1 f) { return f(*this, false); }; // with one argument (other than the implicit LogStream).
       LogStream& operator<< (manip_func  f) { return f(*this); };        // with no arguments (other than the implicit LogStream).
 
-      LogStream& operator<< (const std::string&       v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const char               v) { mBuf <<   static_cast<short>(v); return *this; }
-      LogStream& operator<< (const short              v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const int                v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const long               v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const float              v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const double             v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const long double        v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const u_char             v) { mBuf << static_cast<u_short>(v); return *this; }
-      LogStream& operator<< (const u_short            v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const u_int              v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const u_long             v) { mBuf <<                      v ; return *this; }
-      LogStream& operator<< (const unsigned long long v) { mBuf <<                      v ; return *this; }
+      LogStream& operator<< (const std::string&       v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const char               v) { if(isEnabled()) { buf() <<   static_cast<short>(v); } return *this; }
+      LogStream& operator<< (const short              v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const int                v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const long               v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const float              v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const double             v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const long double        v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const u_char             v) { if(isEnabled()) { buf() << static_cast<u_short>(v); } return *this; }
+      LogStream& operator<< (const u_short            v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const u_int              v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const u_long             v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
+      LogStream& operator<< (const unsigned long long v) { if(isEnabled()) { buf() <<                      v ; } return *this; }
 
       LogStream& flush() { do_write(true);  return *this; }; // Forced Flush buffer to log, empties buffer and stringPool.
       LogStream& endl () { do_write(false); return *this; }; // Suggested Flush buffer to log, empties mBuf into stringPool
 
       // Print numbers in 
-      LogStream& dec  () { mBuf << std::dec;      return *this; }; // decimal.
-      LogStream& hex  () { mBuf << std::hex;      return *this; }; // hex.
-      LogStream& oct  () { mBuf << std::oct;      return *this; }; // octal.
+      LogStream& dec  () { buf() << std::dec;      return *this; }; // decimal.
+      LogStream& hex  () { buf() << std::hex;      return *this; }; // hex.
+      LogStream& oct  () { buf() << std::oct;      return *this; }; // octal.
 
-      LogStream& base () { mBuf << std::showbase; return *this; }; // Show the base when printing numbers.
+      LogStream& base () { buf() << std::showbase; return *this; }; // Show the base when printing numbers.
 
       // getter methods
       static log_type           getMessageType () throw() { return lssPerm.getMessageType(); }
       static log_severity       getSeverity    () throw() { return lssPerm.getSeverity(); }
                                
       const  std::string&       getEntityName  () const throw() { if(!lssTemp.getEntityName().empty()) return lssTemp.getEntityName(); else return lssPerm.getEntityName(); }
-      const  std::string&       getSource      () const throw() { if(!lssTemp.getSource    ().empty()) return lssTemp.getSource();     else return lssPerm.getSource();     }
+      const  std::string&       getSource      () const;
              LogStreamSettings& getPermSettings()               { return lssTemp; }
              LogStreamSettings& getTempSettings()               { return lssPerm; }
 
@@ -258,38 +337,115 @@ namespace kisscpp
       LogStream& setSeverity       (std::string        ms, const bool permanent = false);
       LogStream& setMessageType    (log_type           mt, const bool permanent = false) { if(permanent) { lssPerm.setMessageType(mt);} lssTemp.setMessageType(mt); return *this; }
       LogStream& setSeverity       (log_severity       ms, const bool permanent = false) { if(permanent) { lssPerm.setSeverity   (ms);} lssTemp.setSeverity   (ms); return *this; }
-      LogStream& setEntityName     (const std::string& en, const bool permanent = false) { if(permanent) { lssPerm.setEntityName (en);} lssTemp.setEntityName (en); return *this; }
-      LogStream& setSource         (const std::string& s , const bool permanent = false) { if(permanent) { lssPerm.setSource     (s) ;} lssTemp.setSource     (s) ; return *this; }
+      LogStream& setEntityName     (const std::string& en, const bool permanent = false) { if(permanent) { lssPerm.setEntityName (en);} lssTemp.setEntityName (en); overrideGeneration = 0; return *this; }
+      LogStream& setSource         (const std::string& s , const bool permanent = false) { if(permanent) { lssPerm.setSource     (s) ;} lssTemp.setSource     (s) ; overrideGeneration = 0; return *this; }
       LogStream& setLevel          (manip_func1        f)                                { f(*this, true); return *this; }
+      LogStream& setLevel          (log_type mt, log_severity ms)                        { lssTemp.setMessageType(mt); lssTemp.setSeverity(ms); return *this; } // For this line only.
 
       static void setOutFilePath    (std::string        path) throw() { outFilePath     = path; }
       static void setLog2consoleFlag(bool               b)    throw() { log2consoleFlag = b;    }
       static void set2ReOpen        ();
       static void setMaxBufferSize  (unsigned int       i)    throw() { maxBufferSize   = i;    }
+      static void setCoarseClock    (bool               b)    throw() { coarseClock     = b;    } // Cheaper clock, a few milliseconds resolution.
+
+      // The current local time, as LOG_TIMESTAMP_LENGTH characters, in a buffer owned by the calling thread.
+      // Only the fraction is formatted each time, the rest once a second.
+      static const char *timestamp();
+
+      // Asynchronous logging: lines are handed to a writer thread, instead of being written by the thread that logs.
+      // Start it once the log file path is set, and before other threads log. Stopping happens at exit.
+      static void     startAsync       (std::size_t queue_size = DEFAULT_ASYNC_LOG_QUEUE, log_overflow_policy policy = LO_COUNT);
+      static void     stopAsync        ();  // Writes out what is queued. No other thread may be logging.
+      static void     afterFork        ();  // In a forked child: the writer thread did not survive fork(), start a new one. The parent rotates the file.
+      static bool     isAsync          ()    throw() { return (asyncWriter != NULL); }
+      static uint64_t getDroppedRecords();  // Lines discarded because the queue to the writer thread was full.
+
+      // Binary log format (see binary_log.hpp), read with kclogdecode. Set before anything is logged.
+      static void     setBinaryFormat  (bool b) throw() { binaryFormat = b; }
+      static bool     isBinaryFormat   ()       throw() { return binaryFormat; }
+
+      // Rotating the log file (see log_rotator.hpp). Set before anything is logged.
+      static void     setRotation      (const LogRotation &r);
+      static void     checkRotation    ();  // Rotates the file if it is due, also when nothing is being logged. For a process that hardly logs.
 
     private:
+      friend class LogRecord;
+
       template<typename T>
-             void put         (const T            t)         { mBuf << t; } // Writes a value (template)
-             void put         (const std::string &s)         { mBuf << s; } // Writes a value
+             void put         (const T            t)         { buf() << t; } // Writes a value (template)
+             void put         (const std::string &s)         { buf() << s; } // Writes a value
+             std::ostringstream &buf()                       { if(!mBuf) { mBuf.reset(new std::ostringstream()); } return *mBuf; } // Created on first use, disabled log lines never need it.
              void do_write    (bool               b = false);
              void start_write ()               const;
              void end_write   ()               const;
              void write       ()               const; // Writes to the underlying logging object. This results in a new, timestamped line in the logfile.
-             void locked_write(std::string &s) const;
+             void locked_write(std::string &s, int level) const;
+             int  overriddenThreshold()      const;
+             void store       (std::string &str) const;  // Hands a finished line, or binary record, to the file.
+      static void writePool   ();
       static void openLogFile ();
              void writeLogFile();
 
       LogStreamSettings              lssTemp;         // temporary settings
-      std::ostringstream             mBuf;            // The buffer where the log message is built up in.
+      boost::scoped_ptr<std::ostringstream> mBuf;     // The buffer where the log message is built up in.
+      const char                    *rawSource;       // Source passed as a C string, only turned into sourceCache when needed.
+      mutable std::string            sourceCache;
+      mutable uint32_t               overrideGeneration; // LogLevelOverrides::generation() overrideLevel is for, 0 for none.
+      mutable int                    overrideLevel;
 
       static bool                    doFlush;
       static LogStreamSettings       lssPerm;         // perminant settings
       static bool                    log2consoleFlag;
       static boost::mutex            objMutex;
       static std::string             outFilePath;
-      static std::ofstream           outFile;
+      static int                     outFd;           // Opened O_APPEND, and written a whole batch of lines at a time, so processes sharing the file never split each other's lines.
       static std::deque<std::string> stringPool;
       static unsigned int            maxBufferSize;   // the maximum number of log lines in stringPool, before a write is forced.
+      static bool                    coarseClock;
+      static bool                    binaryFormat;
+      static BinaryLogDefinitions    binaryDefinitions; // What the current file defines, when not asynchronous.
+      static LogRotation             rotation;
+      static LogRotator              rotator;         // When not asynchronous.
+      static AsyncLogWriter         *asyncWriter;     // Set when logging asynchronously, stringPool and outFd are then unused.
+      static std::size_t             asyncQueueSize;
+      static log_overflow_policy     asyncOverflowPolicy;
+  };
+
+  //--------------------------------------------------------------------------------
+  // One log line, built from a format string literal and the arguments streamed into it.
+  // Written when it goes out of scope, at the end of the statement. Use KISSCPP_LOGF.
+  //
+  // In the text format, each {} in the format is replaced by the next argument. In the
+  // binary format, the format string is logged by id, and the arguments as they are.
+  class LogRecord
+  {
+    public:
+      LogRecord(LogStream &s, log_type type, log_severity severity, const char *format);
+      ~LogRecord();
+
+      LogRecord& operator<< (const std::string       &v);
+      LogRecord& operator<< (const char              *v);
+      LogRecord& operator<< (const int                v) { return signedArg  (v); }
+      LogRecord& operator<< (const long               v) { return signedArg  (v); }
+      LogRecord& operator<< (const long long          v) { return signedArg  (v); }
+      LogRecord& operator<< (const unsigned int       v) { return unsignedArg(v); }
+      LogRecord& operator<< (const unsigned long      v) { return unsignedArg(v); }
+      LogRecord& operator<< (const unsigned long long v) { return unsignedArg(v); }
+      LogRecord& operator<< (const unsigned short     v) { return unsignedArg(v); }
+      LogRecord& operator<< (const short              v) { return signedArg  (v); }
+      LogRecord& operator<< (const double             v);
+
+    private:
+      LogRecord(const LogRecord&);
+      LogRecord& operator=(const LogRecord&);
+
+      LogRecord& signedArg  (long long          v);
+      LogRecord& unsignedArg(unsigned long long v);
+      void       nextText   ();                      // Text format: copies the format up to the next {}.
+
+      LogStream   &stream;
+      const char  *rest;                             // What is left of the format, in the text format.
+      std::string  record;                           // The binary record.
   };
 
   //--------------------------------------------------------------------------------
@@ -0,0 +1,101 @@
+// File  : loop_probe.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "loop_probe.hpp"
+#include "inflight_table.hpp"
+
+namespace kisscpp
+{
+  namespace
+  {
+    __thread uint64_t busyMicros = 0; // Since this thread's probe last ran.
+  }
+
+  //--------------------------------------------------------------------------------
+  LoopProbe::LoopProbe(boost::asio::io_service &io_service, std::size_t index, unsigned long int interval) :
+    timer_     (io_service),
+    interval_  (interval),
+    scheduled_ (0),
+    last_wall_ (0),
+    beat_      (LatencyHistogram::now()),
+    thread_    (0)
+  {
+    std::string id = "kcs-loop." + boost::lexical_cast<std::string>(index);
+
+    lag_  = StatsKeeper::instance()->registerHistogram(id + ".lag");
+    busy_ = StatsKeeper::instance()->registerStat     (id + ".busy-ms");
+    idle_ = StatsKeeper::instance()->registerStat     (id + ".idle-ms");
+  }
+
+  //--------------------------------------------------------------------------------
+  void LoopProbe::start()
+  {
+    scheduled_ = LatencyHistogram::now() + static_cast<uint64_t>(interval_) * 1000;
+
+    timer_.expires_from_now(boost::posix_time::milliseconds(interval_));
+    timer_.async_wait(boost::bind(&LoopProbe::handle_timer, this, boost::asio::placeholders::error));
+  }
+
+  //--------------------------------------------------------------------------------
+  LoopHeartbeat LoopProbe::heartbeat() const
+  {
+    LoopHeartbeat heartbeat;
+
+    heartbeat.beat   = beat_.load(boost::memory_order_relaxed);
+    heartbeat.thread = thread_.load(boost::memory_order_relaxed);
+
+    return heartbeat;
+  }
+
+  //--------------------------------------------------------------------------------
+  void LoopProbe::addBusy(uint64_t micros)
+  {
+    busyMicros += micros;
+  }
+
+  //--------------------------------------------------------------------------------
+  // A handler blocking the thread holds up this one too, so the lateness against
+  // the expiry covers it, however long it blocked.
+  void LoopProbe::handle_timer(const boost::system::error_code &e)
+  {
+    if(e) {
+      return;
+    }
+
+    uint64_t wall = LatencyHistogram::now();
+
+    lag_->record((wall > scheduled_) ? wall - scheduled_ : 0);
+
+    if(last_wall_ > 0) {
+      uint64_t elapsed = wall - last_wall_;
+      uint64_t busy    = (busyMicros < elapsed) ? busyMicros : elapsed;
+
+      StatsKeeper::instance()->increment(busy_, busy / 1000.0);
+      StatsKeeper::instance()->increment(idle_, (elapsed - busy) / 1000.0);
+    }
+
+    busyMicros = 0;
+    last_wall_ = wall;
+
+    beat_  .store(wall, boost::memory_order_relaxed);
+    thread_.store(InFlightTable::threadId(), boost::memory_order_relaxed);
+
+    start();
+  }
+}
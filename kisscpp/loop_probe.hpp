@@ -0,0 +1,89 @@
+// File  : loop_probe.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _LOOP_PROBE_HPP_
+#define _LOOP_PROBE_HPP_
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include "statskeeper.hpp"
+#include "latency_histogram.hpp"
+
+namespace kisscpp
+{
+  struct LoopHeartbeat
+  {
+    uint64_t beat;    // LatencyHistogram::now() when the probe last ran.
+    long     thread;  // The thread running the io_service, 0 until the probe first ran.
+  };
+
+  //--------------------------------------------------------------------------------
+  // Watches how busy the thread running an io_service is. Every interval a timer
+  // expires, and how late its handler runs against the expiry is recorded as
+  // kcs-loop.<index>.lag. A blocking handler, or a thread with more connections
+  // than it can serve, shows up there first.
+  //
+  // The wall time spent in handlers timed with a LoopBusyTimer since the last
+  // probe, is added to kcs-loop.<index>.busy-ms, and the rest of the wall time to
+  // kcs-loop.<index>.idle-ms. The server times accepting and serving connections.
+  //
+  // Every time the probe runs, it also stamps a heartbeat, for the watchdog.
+  class LoopProbe : private boost::noncopyable
+  {
+    public:
+      LoopProbe(boost::asio::io_service &io_service, std::size_t index, unsigned long int interval); // interval in milliseconds.
+
+      void          start    ();
+      LoopHeartbeat heartbeat() const;
+
+      static void   addBusy  (uint64_t micros);   // To the calling thread's busy time.
+
+    private:
+      void handle_timer(const boost::system::error_code &e);
+
+      boost::asio::deadline_timer  timer_;
+      unsigned long int            interval_;
+      LatencyHistogram            *lag_;
+      StatHandle                   busy_;
+      StatHandle                   idle_;
+      uint64_t                     scheduled_;  // When timer_ should expire, on the LatencyHistogram::now() clock.
+      uint64_t                     last_wall_;
+      boost::atomic<uint64_t>      beat_;
+      boost::atomic<long>          thread_;
+  };
+
+  //--------------------------------------------------------------------------------
+  // Counts the time it is in scope, as busy time of the calling io_service thread.
+  class LoopBusyTimer : private boost::noncopyable
+  {
+    public:
+      LoopBusyTimer() : started(LatencyHistogram::now()) {}
+      ~LoopBusyTimer() { LoopProbe::addBusy(LatencyHistogram::now() - started); }
+
+    private:
+      uint64_t started;
+  };
+}
+
+#endif // _LOOP_PROBE_HPP_
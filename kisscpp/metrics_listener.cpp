@@ -0,0 +1,255 @@
+// File  : metrics_listener.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <boost/asio/ip/address.hpp>
+#include <boost/bind.hpp>
+#include "metrics_listener.hpp"
+#include "openmetrics.hpp"
+#include "configuration.hpp"
+#include "latency_histogram.hpp"
+#include "logstream.hpp"
+
+namespace kisscpp
+{
+  namespace
+  {
+    //--------------------------------------------------------------------------------
+    // Waits for fd to be ready for events, until deadline (monotonic microseconds).
+    bool waitFor(int fd, short events, uint64_t deadline)
+    {
+      struct pollfd pfd;
+      uint64_t      now;
+
+      pfd.fd     = fd;
+      pfd.events = events;
+
+      while((now = LatencyHistogram::now()) < deadline) {
+        pfd.revents = 0;
+
+        int rc = poll(&pfd, 1, static_cast<int>((deadline - now + 999) / 1000));
+
+        if(rc > 0)                   { return true;  }
+        if(rc < 0 && errno != EINTR) { return false; }
+      }
+
+      return false;
+    }
+
+    //--------------------------------------------------------------------------------
+    void sendAll(int fd, const std::string &data, uint64_t deadline)
+    {
+      std::size_t sent = 0;
+
+      while(sent < data.size()) {
+        ssize_t rc = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+        if(rc < 0 && errno == EINTR)                                    { continue; }
+        if(rc < 0 && errno == EAGAIN && waitFor(fd, POLLOUT, deadline)) { continue; }
+        if(rc <= 0)                                                     { return;   }
+
+        sent += rc;
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    void respond(int fd, uint64_t deadline, const char *status, const char *content_type, const std::string &body)
+    {
+      std::ostringstream header;
+
+      header << "HTTP/1.1 "          << status       << "\r\n"
+             << "Content-Type: "     << content_type << "\r\n"
+             << "Content-Length: "   << body.size()  << "\r\n"
+             << "Connection: close\r\n"
+             << "\r\n";
+
+      sendAll(fd, header.str() + body, deadline);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  bool MetricsListener::open(const std::string &address, const std::string &port)
+  {
+    LogStream        log(__PRETTY_FUNCTION__);
+    struct addrinfo  hints;
+    struct addrinfo *found = NULL;
+    int              on    = 1;
+
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    if(getaddrinfo(address.empty() ? NULL : address.c_str(), port.c_str(), &hints, &found) != 0 || found == NULL) {
+      log << manip::error_normal << "Metrics listener: could not resolve [" << address << ":" << port << "]" << manip::endl;
+      return false;
+    }
+
+    listenSocket = ::socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+
+    if(listenSocket < 0 ||
+       setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+       bind      (listenSocket, found->ai_addr, found->ai_addrlen) != 0 ||
+       listen    (listenSocket, SOMAXCONN) != 0) {
+
+      log << manip::error_normal << "Metrics listener: could not listen on [" << address << ":" << port << "]: " << std::strerror(errno) << manip::endl;
+      freeaddrinfo(found);
+      close();
+      return false;
+    }
+
+    freeaddrinfo(found);
+
+    fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL) | O_NONBLOCK); // A scraper that went away before accept(), must not block us.
+    fcntl(listenSocket, F_SETFD, FD_CLOEXEC);
+
+    log << manip::info_normal << "Metrics listener: serving /metrics on [" << address << ":" << port << "]" << manip::endl;
+
+    return true;
+  }
+
+  //--------------------------------------------------------------------------------
+  void MetricsListener::close()
+  {
+    if(listenSocket >= 0) {
+      ::close(listenSocket);
+      listenSocket = -1;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void MetricsListener::serve(unsigned long int timeout_ms /* = METRICS_IO_TIMEOUT_MS */)
+  {
+    uint64_t deadline = LatencyHistogram::now() + static_cast<uint64_t>(timeout_ms) * 1000;
+    int      client;
+
+    do {
+      client = accept(listenSocket, NULL, NULL);
+    } while(client < 0 && errno == EINTR);
+
+    if(client >= 0) {
+      answer(client, deadline);
+      ::close(client);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void MetricsListener::start()
+  {
+    if(listenSocket >= 0 && !running.exchange(true)) {
+      thread.reset(new boost::thread(boost::bind(&MetricsListener::run, this)));
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void MetricsListener::stop()
+  {
+    if(running.exchange(false)) {
+      thread->join();
+      thread.reset();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void MetricsListener::run()
+  {
+    while(running) {
+      struct pollfd pfd;
+
+      pfd.fd      = listenSocket;
+      pfd.events  = POLLIN;
+      pfd.revents = 0;
+
+      if(poll(&pfd, 1, METRICS_POLL_INTERVAL_MS) > 0) {
+        serve();
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // The client socket is non-blocking, and every wait on it ends at deadline, so
+  // a slow scraper costs no more than that all told.
+  void MetricsListener::answer(int client, uint64_t deadline)
+  {
+    std::string request;
+    char        chunk[1024];
+
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+
+    if(!allowedPeer(client)) {
+      respond(client, deadline, "403 Forbidden", "text/plain", "Your IP address is not in my white-list.\n");
+      return;
+    }
+
+    while(request.find("\r\n\r\n") == std::string::npos && request.size() < METRICS_MAX_REQUEST) {
+      ssize_t rc = recv(client, chunk, sizeof(chunk), 0);
+
+      if(rc < 0 && errno == EINTR)                                       { continue; }
+      if(rc < 0 && errno == EAGAIN && waitFor(client, POLLIN, deadline)) { continue; }
+      if(rc <= 0)                                                        { return;   }
+
+      request.append(chunk, rc);
+    }
+
+    if(request.compare(0, 4, "GET ") != 0) {
+      respond(client, deadline, "405 Method Not Allowed", "text/plain", "Only GET is supported.\n");
+    } else if(request.compare(4, 9, "/metrics ") != 0 && request.compare(4, 9, "/metrics?") != 0) {
+      respond(client, deadline, "404 Not Found", "text/plain", "Metrics are served at /metrics.\n");
+    } else {
+      std::string body;
+      renderer(body);
+      respond(client, deadline, "200 OK", OPENMETRICS_CONTENT_TYPE, body);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  bool MetricsListener::allowedPeer(int client)
+  {
+    struct sockaddr_storage peer;
+    socklen_t               length = sizeof(peer);
+
+    if(getpeername(client, reinterpret_cast<struct sockaddr*>(&peer), &length) != 0) {
+      return false;
+    }
+
+    if(peer.ss_family == AF_INET) {
+      const struct sockaddr_in *v4 = reinterpret_cast<const struct sockaddr_in*>(&peer);
+      return Config::instance()->isAllowedIp(boost::asio::ip::address_v4(ntohl(v4->sin_addr.s_addr)));
+    }
+
+    if(peer.ss_family == AF_INET6) {
+      const struct sockaddr_in6              *v6 = reinterpret_cast<const struct sockaddr_in6*>(&peer);
+      boost::asio::ip::address_v6::bytes_type bytes;
+
+      std::memcpy(bytes.data(), v6->sin6_addr.s6_addr, bytes.size());
+      return Config::instance()->isAllowedIp(boost::asio::ip::address_v6(bytes));
+    }
+
+    return false;
+  }
+}
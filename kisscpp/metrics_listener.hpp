@@ -0,0 +1,70 @@
+// File  : metrics_listener.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _METRICS_LISTENER_HPP_
+#define _METRICS_LISTENER_HPP_
+
+#include <string>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#define METRICS_POLL_INTERVAL_MS 250
+#define METRICS_IO_TIMEOUT_MS    1000   // A scraper gets this long to send its request, and read the response.
+#define METRICS_MAX_REQUEST      8192
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  // A minimal HTTP listener, that answers "GET /metrics" with the OpenMetrics text
+  // exposition, so monitoring can scrape an application without speaking its JSON
+  // protocol. Requests are answered one at a time, and the connection is closed
+  // after each response. Clients have to be in the IP white-list.
+  class MetricsListener : private boost::noncopyable
+  {
+    public:
+      typedef boost::function<void (std::string&)> Renderer; // Appends the exposition, "# EOF" included.
+
+      explicit MetricsListener(const Renderer &r) : renderer(r), listenSocket(-1), running(false) {}
+      ~MetricsListener() { stop(); close(); }
+
+      bool open  (const std::string &address, const std::string &port); // false when it could not listen there.
+      void close ();
+      int  socket() const { return listenSocket; }
+
+      void serve (unsigned long int timeout_ms = METRICS_IO_TIMEOUT_MS); // Answer a scrape waiting on socket(), if there is one, giving up after timeout_ms.
+      void start ();  // Serve from a thread of its own.
+      void stop  ();
+
+    private:
+      void run        ();
+      void answer     (int client, uint64_t deadline);
+      bool allowedPeer(int client);
+
+      Renderer                         renderer;
+      int                              listenSocket;
+      boost::atomic<bool>              running;
+      boost::scoped_ptr<boost::thread> thread;
+  };
+}
+
+#endif // _METRICS_LISTENER_HPP_
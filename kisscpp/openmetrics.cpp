@@ -0,0 +1,116 @@
+// File  : openmetrics.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cstdio>
+#include "openmetrics.hpp"
+#include "statskeeper.hpp"
+#include "errorstate.hpp"
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  void OpenMetrics::render(std::string &out)
+  {
+    out.reserve(out.size() + 16384);
+
+    StatsKeeper::instance()->writeOpenMetrics(out);
+    ErrorStateList::instance()->writeOpenMetrics(out);
+
+    out += "# EOF\n";
+  }
+
+  //--------------------------------------------------------------------------------
+  std::string OpenMetrics::name(const std::string &id)
+  {
+    std::string retval(id);
+
+    for(std::string::size_type i = 0; i < retval.size(); ++i) {
+      char c = retval[i];
+
+      if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == ':')) {
+        retval[i] = '_';
+      }
+    }
+
+    if(retval.empty() || (retval[0] >= '0' && retval[0] <= '9')) {
+      retval.insert(0, "_");
+    }
+
+    return retval;
+  }
+
+  //--------------------------------------------------------------------------------
+  std::string OpenMetrics::label(const char *key, const std::string &value)
+  {
+    std::string retval(key);
+
+    retval += "=\"";
+
+    for(std::string::size_type i = 0; i < value.size(); ++i) {
+      switch(value[i]) {
+        case '\\': retval += "\\\\"; break;
+        case '"' : retval += "\\\""; break;
+        case '\n': retval += "\\n" ; break;
+        default  : retval += value[i];
+      }
+    }
+
+    retval += "\"";
+
+    return retval;
+  }
+
+  //--------------------------------------------------------------------------------
+  void OpenMetrics::family(std::string &out, const std::string &name, const char *type, const char *unit /* = NULL */)
+  {
+    out += "# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+
+    if(unit) {
+      out += "# UNIT ";
+      out += name;
+      out += ' ';
+      out += unit;
+      out += '\n';
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void OpenMetrics::sample(std::string &out, const std::string &name, double value, const std::string &labels /* = "" */)
+  {
+    char number[32];
+
+    std::snprintf(number, sizeof(number), "%.15g", value);
+
+    out += name;
+
+    if(!labels.empty()) {
+      out += '{';
+      out += labels;
+      out += '}';
+    }
+
+    out += ' ';
+    out += number;
+    out += '\n';
+  }
+}
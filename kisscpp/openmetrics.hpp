@@ -0,0 +1,44 @@
+// File  : openmetrics.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _OPENMETRICS_HPP_
+#define _OPENMETRICS_HPP_
+
+#include <string>
+
+#define OPENMETRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  // Writing the OpenMetrics text exposition format (what Prometheus scrapes),
+  // straight into a string, without building a ptree first.
+  class OpenMetrics
+  {
+    public:
+      static void        render(std::string &out);  // Stats, error states and the closing "# EOF".
+
+      static std::string name  (const std::string &id);                        // "kcs-latency.handler.echo" becomes "kcs_latency_handler_echo".
+      static std::string label (const char *key, const std::string &value);    // key="value", with value escaped.
+      static void        family(std::string &out, const std::string &name, const char *type, const char *unit = NULL);
+      static void        sample(std::string &out, const std::string &name, double value, const std::string &labels = "");
+  };
+}
+
+#endif // _OPENMETRICS_HPP_
@@ -0,0 +1,247 @@
+// File  : profiler.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <signal.h>
+#include <sys/time.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include "profiler.hpp"
+#include "latency_histogram.hpp"
+
+namespace kisscpp
+{
+  boost::scoped_array<ProfileSample> Profiler::samples;
+  boost::atomic<unsigned int>        Profiler::claimed(0);
+  boost::atomic<unsigned int>        Profiler::written(0);
+  boost::atomic<bool>                Profiler::sampling(false);
+  boost::atomic<uint64_t>            Profiler::deadline(0);
+  bool                               Profiler::taken = false;
+  boost::mutex                       Profiler::controlMutex;
+
+  namespace
+  {
+    const int SIGNAL_FRAMES = 2; // onSignal(), and the kernel's signal trampoline.
+
+    //--------------------------------------------------------------------------------
+    // "module(mangled+0x1f) [0x4005d0]" as returned by backtrace_symbols(), to the
+    // demangled function, or "[module]" when the symbol is not exported.
+    std::string frameName(const char *symbol)
+    {
+      std::string text  = symbol;
+      std::size_t open  = text.find('(');
+      std::size_t plus  = text.find_first_of("+)", open);
+      std::string name;
+
+      if(open != std::string::npos && plus != std::string::npos && plus > open + 1) {
+        std::string mangled   = text.substr(open + 1, plus - open - 1);
+        int         status    = 0;
+        char       *demangled = abi::__cxa_demangle(mangled.c_str(), NULL, NULL, &status);
+
+        if(status == 0 && demangled) {
+          name = demangled;
+        } else {
+          name = mangled;
+        }
+
+        std::free(demangled);
+      } else {
+        std::string module = text.substr(0, open);
+        std::size_t slash  = module.rfind('/');
+
+        name = "[" + ((slash == std::string::npos) ? module : module.substr(slash + 1)) + "]";
+      }
+
+      return name;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  bool Profiler::start(unsigned int seconds, unsigned int frequency)
+  {
+    boost::lock_guard<boost::mutex> guard(controlMutex);
+
+    if(running()) {
+      errno = EBUSY;
+      return false;
+    }
+
+    if(frequency == 0) {
+      errno = EINVAL;
+      return false;
+    }
+
+    struct sigaction action;
+    struct itimerval timer;
+    void            *warm_up[1];
+    unsigned int     interval = 1000000 / frequency;      // Microseconds, which tv_usec only holds below a second.
+
+    backtrace(warm_up, 1); // The first call loads libgcc, which must not happen in the signal handler.
+
+    if(!samples) {
+      samples.reset(new ProfileSample[PROFILE_MAX_SAMPLES]);
+    }
+
+    // Left installed afterwards: a SIGPROF still pending when the timer is
+    // disarmed would otherwise terminate the process.
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = &Profiler::onSignal;
+    action.sa_flags   = SA_RESTART;
+
+    if(sigaction(SIGPROF, &action, NULL) != 0) {
+      return false;
+    }
+
+    claimed.store(0, boost::memory_order_relaxed);
+    written.store(0, boost::memory_order_relaxed);
+    deadline.store(LatencyHistogram::now() + static_cast<uint64_t>(seconds) * 1000000, boost::memory_order_relaxed);
+    sampling.store(true, boost::memory_order_release);
+    taken = true;
+
+    timer.it_interval.tv_sec  = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value            = timer.it_interval;
+
+    if(setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+      int error = errno;
+
+      sampling.store(false, boost::memory_order_release);
+      taken = false;                                        // What the last profile had, is gone.
+      errno = error;
+      return false;
+    }
+
+    return true;
+  }
+
+  //--------------------------------------------------------------------------------
+  bool Profiler::running()
+  {
+    if(sampling.load(boost::memory_order_acquire) && LatencyHistogram::now() >= deadline.load(boost::memory_order_relaxed)) {
+      disarm(); // A process that used no CPU got no signal to stop on.
+    }
+
+    return sampling.load(boost::memory_order_acquire);
+  }
+
+  //--------------------------------------------------------------------------------
+  bool Profiler::result(std::string &folded, unsigned int &sample_count, unsigned int &dropped)
+  {
+    boost::lock_guard<boost::mutex> guard(controlMutex);
+
+    if(!taken || running()) {
+      return false;
+    }
+
+    unsigned int total = claimed.load(boost::memory_order_acquire);
+    unsigned int kept  = (total < PROFILE_MAX_SAMPLES) ? total : PROFILE_MAX_SAMPLES;
+
+    while(written.load(boost::memory_order_acquire) < kept) { // A handler that claimed a slot before sampling stopped.
+      boost::this_thread::yield();
+    }
+
+    std::map<void*, std::string>        names;
+    std::map<std::string, unsigned int> stacks;
+    std::vector<void*>                  addresses;
+
+    for(unsigned int i = 0; i < kept; ++i) {
+      for(int f = SIGNAL_FRAMES; f < samples[i].depth; ++f) {
+        if(names.insert(std::make_pair(samples[i].frames[f], std::string())).second) {
+          addresses.push_back(samples[i].frames[f]);
+        }
+      }
+    }
+
+    if(!addresses.empty()) {
+      char **symbols = backtrace_symbols(&addresses[0], addresses.size());
+
+      for(std::size_t a = 0; symbols && a < addresses.size(); ++a) {
+        names[addresses[a]] = frameName(symbols[a]);
+      }
+
+      std::free(symbols);
+    }
+
+    for(unsigned int i = 0; i < kept; ++i) {
+      std::string stack;
+
+      for(int f = samples[i].depth - 1; f >= SIGNAL_FRAMES; --f) {
+        stack += names[samples[i].frames[f]];
+        stack += (f > SIGNAL_FRAMES) ? ";" : "";
+      }
+
+      if(!stack.empty()) {
+        ++stacks[stack];
+      }
+    }
+
+    std::ostringstream out;
+
+    for(std::map<std::string, unsigned int>::iterator itr = stacks.begin(); itr != stacks.end(); ++itr) {
+      out << itr->first << " " << itr->second << "\n";
+    }
+
+    folded       = out.str();
+    sample_count = kept;
+    dropped      = total - kept;
+
+    return true;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Runs on whichever thread the signal interrupted: only async signal safe calls
+  // here. backtrace() is, once start() has warmed it up.
+  void Profiler::onSignal(int)
+  {
+    int saved_errno = errno;
+
+    if(sampling.load(boost::memory_order_acquire)) {
+      if(LatencyHistogram::now() >= deadline.load(boost::memory_order_relaxed)) {
+        disarm();
+      } else {
+        unsigned int slot = claimed.fetch_add(1, boost::memory_order_relaxed);
+
+        if(slot < PROFILE_MAX_SAMPLES) {
+          samples[slot].depth = backtrace(samples[slot].frames, PROFILE_MAX_DEPTH);
+          written.fetch_add(1, boost::memory_order_release);
+        }
+      }
+    }
+
+    errno = saved_errno;
+  }
+
+  //--------------------------------------------------------------------------------
+  void Profiler::disarm()
+  {
+    struct itimerval timer;
+
+    timer.it_interval.tv_sec  = 0;
+    timer.it_interval.tv_usec = 0;
+    timer.it_value            = timer.it_interval;
+
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sampling.store(false, boost::memory_order_release);
+  }
+}
@@ -0,0 +1,72 @@
+// File  : profiler.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _PROFILER_HPP_
+#define _PROFILER_HPP_
+
+#include <string>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+
+#define PROFILE_MAX_DEPTH     32
+#define PROFILE_MAX_SAMPLES   32768
+#define PROFILE_MAX_SECONDS   300
+#define PROFILE_MAX_FREQUENCY 1000
+
+namespace kisscpp
+{
+  struct ProfileSample
+  {
+    int   depth;
+    void *frames[PROFILE_MAX_DEPTH];
+  };
+
+  //--------------------------------------------------------------------------------
+  // A sampling CPU profiler. While it runs, SIGPROF interrupts whichever thread of
+  // the process is using the CPU, frequency times per CPU second, and the signal
+  // handler copies that thread's stack into a preallocated buffer: a slot is
+  // claimed with one atomic increment, nothing is locked or allocated.
+  //
+  // Stacks are only symbolized for result(), which folds them into one line per
+  // distinct stack, "outer;...;inner count", as flame graph tools expect.
+  // Applications are best linked with -rdynamic, so their own functions have names.
+  class Profiler
+  {
+    public:
+      static bool start  (unsigned int seconds, unsigned int frequency); // false while a profile is running (errno EBUSY), or when SIGPROF could not be set up (errno tells why).
+      static bool running();
+      static bool result (std::string &folded, unsigned int &samples, unsigned int &dropped); // false while running, or before the first profile.
+
+    private:
+      static void onSignal(int signal_number);
+      static void disarm  ();
+
+      static boost::scoped_array<ProfileSample> samples;
+      static boost::atomic<unsigned int>        claimed;   // Slots handed out, including those beyond the buffer.
+      static boost::atomic<unsigned int>        written;   // Slots filled in.
+      static boost::atomic<bool>                sampling;
+      static boost::atomic<uint64_t>            deadline;  // LatencyHistogram::now() at which sampling stops.
+      static bool                               taken;     // A profile was started.
+      static boost::mutex                       controlMutex;
+  };
+}
+
+#endif // _PROFILER_HPP_
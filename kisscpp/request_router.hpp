@@ -22,13 +22,18 @@
 #include <iostream>
 
 #include <string>
+#include <sstream>
 #include <map>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
 #include "boost_ptree.hpp"
 #include "request_handler.hpp"
 #include "logstream.hpp"
 #include "request_status.hpp"
+#include "statskeeper.hpp"
+#include "inflight_table.hpp"
+#include "errorstate.hpp"
 
 namespace kisscpp
 {
@@ -38,18 +43,54 @@ namespace kisscpp
   typedef requestHandlerInfoList::iterator          requestHandlerInfoListIter;
   typedef boost::shared_ptr<requestHandlerInfoList> sharedRequestHandlerInfoList;
 
+  //--------------------------------------------------------------------------------
+  // What a handler's run() costs: wall time in a histogram, and CPU time of the
+  // thread running it, which leaves out time spent waiting.
+  struct HandlerStats
+  {
+    LatencyHistogram *latency;
+    StatHandle        calls;
+    StatHandle        cpu;   // Seconds.
+  };
+
+  typedef std::map<std::string, HandlerStats>       requestStatsMapType;
+  typedef requestStatsMapType::iterator             requestStatsMapTypeIter;
+
+  //--------------------------------------------------------------------------------
+  // Adds the CPU time the calling thread spends while it is in scope, to a handler's stats.
+  class HandlerCpuTimer : private boost::noncopyable
+  {
+    public:
+      explicit HandlerCpuTimer(const HandlerStats &s) : stats(s), started(LatencyHistogram::cpuNow()) {}
+      ~HandlerCpuTimer()
+      {
+        StatsKeeper::instance()->increment(stats.cpu, (LatencyHistogram::cpuNow() - started) / 1e6);
+        StatsKeeper::instance()->increment(stats.calls);
+      }
+
+    private:
+      const HandlerStats &stats;
+      uint64_t            started;
+  };
+
   //--------------------------------------------------------------------------------
   // The router for all incoming requests.
   class RequestRouter : private boost::noncopyable
   {
     public:
-      explicit RequestRouter() {};                                           
+      explicit RequestRouter() : draining(false), inFlight(0), slowThreshold(0), slowSamplePpm(LOG_SAMPLE_ALL), slowCount(0) {};
 
       //--------------------------------------------------------------------------------
       void register_handler(RequestHandlerPtr _handler)
       {
         LogStream log(__PRETTY_FUNCTION__);
+        HandlerStats &stats = requestStatsMap[_handler->commandId()];
+
         requestHandlerMap[_handler->commandId()] = _handler;
+
+        stats.latency = StatsKeeper::instance()->registerHistogram("kcs-latency.handler." + _handler->commandId());
+        stats.calls   = StatsKeeper::instance()->registerStat     ("kcs-handler." + _handler->commandId() + ".calls");
+        stats.cpu     = StatsKeeper::instance()->registerStat     ("kcs-handler." + _handler->commandId() + ".cpu-seconds");
       }
 
       // Handle a request and produce a reply.
@@ -58,15 +99,43 @@ namespace kisscpp
       void route_request(const BoostPtree &request, BoostPtree &response)
       {
         LogStream log(__PRETTY_FUNCTION__);
+
+        if(draining) {
+          response.put("kcm-sts", RQST_APPLICATION_SHUTING_DOWN);
+          response.put("kcm-erm", "Request not processed: Application is shutting down.");
+          return;
+        }
+
         try {
-          std::string command = request.get<std::string>("kcm-cmd");
-
-          if(requestHandlerMap.find(command) != requestHandlerMap.end()) {
-            try {
-              requestHandlerMap[command]->run(request, response);
-            } catch (boost::property_tree::ptree_bad_path &e) {
-              response.put("kcm-sts", RQST_MISSING_PARAMETER);
-              response.put("kcm-erm", e.what());
+          std::string               command = request.get<std::string>("kcm-cmd");
+          requestHandlerMapTypeIter handler = requestHandlerMap.find(command);
+
+          if(handler != requestHandlerMap.end() && shedding(command)) {
+            StatsKeeper::instance()->increment(shedRequests);
+            response.put("kcm-sts", RQST_APPLICATION_BUSY);
+            response.put("kcm-erm", "Request not processed: Application is shedding load, due to errors.");
+          } else if(handler != requestHandlerMap.end()) {
+            const HandlerStats &stats   = requestStatsMap[command];
+            std::string         client  = request.get<std::string>("kcm-client.id", "");
+            InFlightEntry       entry    (inFlightTable, command, client);
+            uint64_t            started = LatencyHistogram::now();
+
+            {
+              LatencyTimer    timer(stats.latency);
+              HandlerCpuTimer cpu  (stats);
+
+              try {
+                handler->second->run(request, response);
+              } catch (boost::property_tree::ptree_bad_path &e) {
+                response.put("kcm-sts", RQST_MISSING_PARAMETER);
+                response.put("kcm-erm", e.what());
+              }
+            }
+
+            uint64_t elapsed = LatencyHistogram::now() - started;
+
+            if(slowThreshold.load(boost::memory_order_relaxed) > 0 && elapsed >= slowThreshold.load(boost::memory_order_relaxed)) {
+              slowRequest(request, command, client, elapsed);
             }
           } else {
             response.put("kcm-sts", RQST_COMMAND_NOT_SUPPORTED);
@@ -92,8 +161,103 @@ namespace kisscpp
         return retval;
       }
 
+      //--------------------------------------------------------------------------------
+      // Calls, and CPU seconds spent in them, since start up.
+      void getHandlerUsage(const std::string &command, double &calls, double &cpu_seconds)
+      {
+        requestStatsMapTypeIter itr = requestStatsMap.find(command);
+
+        calls       = 0;
+        cpu_seconds = 0;
+
+        if(itr != requestStatsMap.end()) {
+          calls       = StatsKeeper::instance()->readTotal((itr->second).calls);
+          cpu_seconds = StatsKeeper::instance()->readTotal((itr->second).cpu);
+        }
+      }
+
+      //--------------------------------------------------------------------------------
+      // Once the StatsKeeper is configured.
+      void registerStats()
+      {
+        slowRequests = StatsKeeper::instance()->registerStat("kcs-slow-requests");
+        shedRequests = StatsKeeper::instance()->registerStat("kcs-shed-requests");
+      }
+
+      //--------------------------------------------------------------------------------
+      // Requests that take threshold milliseconds or more are counted as
+      // kcs-slow-requests, and logged in full, a fraction sample of them.
+      void setSlowRequestLog(unsigned long int threshold, double sample)
+      {
+        slowSamplePpm.store(static_cast<uint32_t>(((sample < 0) ? 0 : (sample > 1) ? 1 : sample) * LOG_SAMPLE_ALL));
+        slowThreshold.store(static_cast<uint64_t>(threshold) * 1000);
+      }
+
+      void listInFlight(InFlightList &requests) const { inFlightTable.list(requests); }
+
+      //--------------------------------------------------------------------------------
+      // Once draining, new requests are answered with RQST_APPLICATION_SHUTING_DOWN,
+      // while the ones already in flight are allowed to complete.
+      void         beginDrain   ()       { draining = true; }
+      bool         isDraining   () const { return draining; }
+
+      void         enterRequest ()       { ++inFlight; }
+      void         leaveRequest ()       { --inFlight; }
+      unsigned int inFlightCount() const { return inFlight; }
+
+    private:
+      //--------------------------------------------------------------------------------
+      // While an error threshold set to shed is reached, only the standard (kch-)
+      // handlers are run, so the application can still be looked at.
+      static bool shedding(const std::string &command)
+      {
+        return (ErrorStateList::instance()->isShedding() && command.compare(0, 4, "kch-") != 0);
+      }
+
+      //--------------------------------------------------------------------------------
+      // Keeps the n-th slow request whenever n times the sample passes a whole number.
+      void slowRequest(const BoostPtree &request, const std::string &command, const std::string &client, uint64_t elapsed)
+      {
+        LogStream log(__PRETTY_FUNCTION__);
+        uint64_t  n   = slowCount.fetch_add(1, boost::memory_order_relaxed) + 1;
+        uint64_t  ppm = slowSamplePpm.load(boost::memory_order_relaxed);
+
+        StatsKeeper::instance()->increment(slowRequests);
+
+        if((n * ppm) / LOG_SAMPLE_ALL == ((n - 1) * ppm) / LOG_SAMPLE_ALL) {
+          return;
+        }
+
+        std::stringstream full_request;
+
+        boost::property_tree::json_parser::write_json(full_request, request, false);
+
+        KISSCPP_LOGF(log, LT_INFO, LS_HIGH, "Slow request: [{}] from [{}] took {}ms on thread [{}] > {}")
+          << command << client << (elapsed / 1000) << InFlightTable::threadId() << full_request.str();
+      }
+
+      requestHandlerMapType       requestHandlerMap;
+      requestStatsMapType         requestStatsMap;   // Time spent in each handler's run().
+      boost::atomic<bool>         draining;
+      boost::atomic<unsigned int> inFlight;
+      InFlightTable               inFlightTable;
+      boost::atomic<uint64_t>     slowThreshold;     // Microseconds, 0 when off.
+      boost::atomic<uint32_t>     slowSamplePpm;
+      boost::atomic<uint64_t>     slowCount;
+      StatHandle                  slowRequests;
+      StatHandle                  shedRequests;
+  };
+
+  //--------------------------------------------------------------------------------
+  // Marks a request as in flight, for as long as it is in scope.
+  class InFlightRequest : private boost::noncopyable
+  {
+    public:
+      explicit InFlightRequest(RequestRouter &rr) : requestRouter(rr) { requestRouter.enterRequest(); }
+      ~InFlightRequest()                                               { requestRouter.leaveRequest(); }
+
     private:
-      requestHandlerMapType requestHandlerMap;
+      RequestRouter &requestRouter;
   };
 
   typedef boost::shared_ptr<RequestRouter> sharedRequestRouter;
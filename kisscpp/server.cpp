@@ -20,6 +20,121 @@
 
 namespace kisscpp
 {
+  namespace
+  {
+    // The pre-fork master does not run its io_services, so it can not use asio for signals.
+    volatile sig_atomic_t prefork_stop_requested   = 0;
+    volatile sig_atomic_t prefork_reopen_requested = 0;
+
+    void preforkStopHandler  (int) { prefork_stop_requested   = 1; }
+    void preforkReopenHandler(int) { prefork_reopen_requested = 1; }
+
+    uint64_t monotonicMs() { return LatencyHistogram::now() / 1000; }
+
+    //--------------------------------------------------------------------------------
+    // None for a worker that ran a while, otherwise doubling with every quick exit in a row.
+    uint64_t respawnDelay(unsigned int quick_exits)
+    {
+      uint64_t delay = PREFORK_RESPAWN_MIN_MS;
+
+      if(quick_exits == 0) {
+        return 0;
+      }
+
+      while(--quick_exits > 0 && delay < PREFORK_RESPAWN_MAX_MS) {
+        delay *= 2;
+      }
+
+      return std::min<uint64_t>(delay, PREFORK_RESPAWN_MAX_MS);
+    }
+
+    //--------------------------------------------------------------------------------
+    // Stats travel between master and workers as one line, in the same format as cacti_format_stats.
+    std::string formatStatsLine(const StatsMapType &stats)
+    {
+      std::stringstream line;
+      bool              first = true;
+
+      for(StatsMapType::const_iterator itr = stats.begin(); itr != stats.end(); ++itr) {
+        if(first) { first = false;
+        } else    { line << " ";
+        }
+        line << itr->first << ":" << itr->second;
+      }
+
+      line << "\n";
+      return line.str();
+    }
+
+    //--------------------------------------------------------------------------------
+    void parseStatsLine(const std::string &line, StatsMapType &stats)
+    {
+      std::stringstream fields(line);
+      std::string       field;
+
+      stats.clear();
+
+      while(fields >> field) {
+        std::string::size_type separator = field.rfind(':');
+
+        if(separator != std::string::npos) {
+          stats[field.substr(0, separator)] = std::strtod(field.c_str() + separator + 1, NULL);
+        }
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    bool writeAll(int fd, const std::string &data)
+    {
+      std::size_t written = 0;
+
+      while(written < data.size()) {
+        ssize_t rc = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL); // The other side may be gone.
+
+        if(rc < 0 && errno == EINTR) { continue; }
+        if(rc <= 0)                  { return false; }
+
+        written += rc;
+      }
+
+      return true;
+    }
+
+    //--------------------------------------------------------------------------------
+    // Read of a single line, anything read beyond it, is kept in buffer. False when
+    // nothing arrived for timeout_ms.
+    bool readLine(int fd, std::string &buffer, std::string &line, int timeout_ms)
+    {
+      std::string::size_type end;
+      char                   chunk[4096];
+
+      while((end = buffer.find('\n')) == std::string::npos) {
+        struct pollfd pfd;
+
+        pfd.fd      = fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        int ready = poll(&pfd, 1, timeout_ms);
+
+        if(ready < 0 && errno == EINTR) { continue; }
+        if(ready <= 0)                  { return false; }
+
+        ssize_t rc = read(fd, chunk, sizeof(chunk));
+
+        if(rc < 0 && errno == EINTR) { continue; }
+        if(rc <= 0)                  { return false; }
+
+        buffer.append(chunk, rc);
+      }
+
+      line = buffer.substr(0, end);
+      buffer.erase(0, end + 1);
+
+      return true;
+    }
+  }
+
   //--------------------------------------------------------------------------------
   Server::Server(std::size_t        io_service_pool_size,
                  const std::string& application_id,
@@ -32,10 +147,56 @@ namespace kisscpp
       stop_signals_      (io_service_pool_.get_io_service()),
       log_reopen_signals_(io_service_pool_.get_io_service()),
       acceptor_          (io_service_pool_.get_io_service()),
+      drain_timer_       (io_service_pool_.get_io_service()),
+      draining_          (false),
+      handoff_acceptor_  (io_service_pool_.get_io_service()),
+      handoff_socket_    (io_service_pool_.get_io_service()),
+      handoff_ack_       (0),
+      hot_restart_       (std::getenv("KCPP_HOT_RESTART") != NULL),
+      handed_off_        (false),
+      prefork_worker_    (false),
       new_connection_    (),
-      request_router_    ()
+      request_router_    (),
+      stats_socket_      (-1),
+      cfg_address_             ("kcc-server.address"),
+      cfg_port_                ("kcc-server.port"),
+      cfg_drain_timeout_       ("kcc-server.drain-timeout"     , 5000),
+      cfg_workers_             ("kcc-server.workers"           , 0),
+      cfg_metrics_address_     ("kcc-server.metrics-address"   , ""),
+      cfg_metrics_port_        ("kcc-server.metrics-port"      , ""),
+      cfg_loop_probe_interval_ ("kcc-server.loop-probe-interval", 1000),
+      cfg_slow_request_ms_     ("kcc-server.slow-request-ms"   , 0),
+      cfg_slow_request_sample_ ("kcc-server.slow-request-sample", 1.0),
+      cfg_watchdog_limit_      ("kcc-server.watchdog-limit"    , 0),
+      cfg_watchdog_restart_    ("kcc-server.watchdog-restart"  , "false"),
+      cfg_shed_on_errors_      ("kcc-server.shed-on-errors"    , ""),
+      cfg_stats_gather_period_ ("kcc-stats.gather-period"      , 300),
+      cfg_stats_history_length_("kcc-stats.history-length"     , 12),
+      cfg_stats_gather_period_ms_("kcc-stats.gather-period-ms" , 0),
+      cfg_stats_rollups_       ("kcc-stats.rollups"            , ""),
+      cfg_log_type_            ("kcc-log-level.type"           , "info"),
+      cfg_log_severity_        ("kcc-log-level.severity"       , "low"),
+      cfg_log_buff_size_       ("kcc-log-level.buff-size"      , 5000),
+      cfg_log_async_           ("kcc-log-level.async"          , "false"),
+      cfg_log_queue_size_      ("kcc-log-level.queue-size"     , DEFAULT_ASYNC_LOG_QUEUE),
+      cfg_log_overflow_        ("kcc-log-level.overflow"       , "count"),
+      cfg_log_coarse_clock_    ("kcc-log-level.coarse-clock"   , "false"),
+      cfg_log_format_          ("kcc-log-level.format"         , "text"),
+      cfg_log_rotate_size_     ("kcc-log-level.rotate-size"    , 0),
+      cfg_log_rotate_interval_ ("kcc-log-level.rotate-interval", 0),
+      cfg_log_rotate_keep_     ("kcc-log-level.rotate-keep"    , 0),
+      cfg_log_rotate_compress_ ("kcc-log-level.rotate-compress", "false"),
+      cfg_log_rate_limit_      ("kcc-log-level.rate-limit"     , 0),
+      cfg_log_sample_          ("kcc-log-level.sample"         , 1.0)
   {
-    if (createLockFile(application_id, application_instance)) {
+    int handoff_socket     = -1;
+    int inherited_listener = -1;
+
+    if(hot_restart_) {
+      inherited_listener = takeOverListener(application_id, application_instance, handoff_socket);
+    }
+
+    if (inherited_listener >= 0 || createLockFile(application_id, application_instance)) {
 
       std::cerr << "Lock file created for: [" << application_id << "] [" << application_instance << "]" << std::endl;
 
@@ -54,39 +215,62 @@ namespace kisscpp
       std::cerr << "Initialized Logging." << std::endl;
 
       // create the stats keeper instance here. So that it's available as soon as the server is constructed.
-      StatsKeeper::instance(Config::instance()->get<unsigned long int>("kcc-stats.gather-period" ,300),
-                            Config::instance()->get<unsigned long int>("kcc-stats.history-length",12));
+      initializeStats();
+      io_service_pool_.set_probe_interval(cfg_loop_probe_interval_.get());
+      request_router_.registerStats();
+      request_router_.setSlowRequestLog(cfg_slow_request_ms_.get(), cfg_slow_request_sample_.get());
       std::cerr << "Initialized StatsKeeper." << std::endl;
 
-      ErrorStateList::instance();   // same goes for the error state list.
+      initializeErrorStates();      // same goes for the error state list.
       std::cerr << "Initialized ErrorStateList." << std::endl;
 
       initialize_standard_handlers();
       std::cerr << "Initialized Standard Handlers." << std::endl;
 
-      boost::asio::ip::tcp::resolver        resolver(acceptor_.get_io_service()); // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
-      std::cerr << "Initialized resolver." << std::endl;
+      if(inherited_listener >= 0) {
+        struct sockaddr_storage listener_address;
+        socklen_t               listener_address_length = sizeof(listener_address);
+
+        getsockname(inherited_listener, reinterpret_cast<struct sockaddr*>(&listener_address), &listener_address_length);
 
-      boost::asio::ip::tcp::resolver::query query(Config::instance()->get<std::string>("kcc-server.address"),
-                                                  Config::instance()->get<std::string>("kcc-server.port"));
-      std::cerr << "Initialized query object." << std::endl;
+        acceptor_.assign((listener_address.ss_family == AF_INET6) ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4(),
+                         inherited_listener);
+        std::cerr << "Acceptor taken over from running instance." << std::endl;
+      } else {
+        boost::asio::ip::tcp::resolver        resolver(acceptor_.get_io_service()); // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
+        std::cerr << "Initialized resolver." << std::endl;
 
-      boost::asio::ip::tcp::endpoint        endpoint = *resolver.resolve(query);
-      std::cerr << "Initialized endpoint." << std::endl;
+        boost::asio::ip::tcp::resolver::query query(cfg_address_.get(),
+                                                    cfg_port_.get());
+        std::cerr << "Initialized query object." << std::endl;
 
-      acceptor_.open(endpoint.protocol());
-      std::cerr << "Acceptor opened." << std::endl;
+        boost::asio::ip::tcp::endpoint        endpoint = *resolver.resolve(query);
+        std::cerr << "Initialized endpoint." << std::endl;
 
-      acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-      std::cerr << "Acceptor options set." << std::endl;
+        acceptor_.open(endpoint.protocol());
+        std::cerr << "Acceptor opened." << std::endl;
 
-      acceptor_.bind(endpoint);
-      std::cerr << "Acceptor bound." << std::endl;
+        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        std::cerr << "Acceptor options set." << std::endl;
 
-      acceptor_.listen();
+        acceptor_.bind(endpoint);
+        std::cerr << "Acceptor bound." << std::endl;
+
+        acceptor_.listen();
+      }
 
       std::cerr << "Server started, now accepting connections." << std::endl;
       start_accept();
+
+      if(hot_restart_) {
+        start_handoff_listener();
+
+        if(handoff_socket >= 0) {
+          acknowledgeHandoff(handoff_socket);
+          std::cerr << "Acknowledged takeover, previous instance is draining." << std::endl;
+        }
+      }
+
       std::cerr << "Server Ready." << std::endl;
     } else {
       std::cerr << "Could not create Lockfile for this appid and instance: ["
@@ -111,25 +295,69 @@ namespace kisscpp
         << "--------------------------------------------------------------------------------\n"
         << "Starting Process : " << Config::instance()->getAppId()                             << '\n'
         << "Instance         : " << Config::instance()->getAppInstance()                       << '\n'
-        << "Server address   : " << Config::instance()->get<std::string>("kcc-server.address") << '\n'
-        << "Server port      : " << Config::instance()->get<std::string>("kcc-server.port")    << '\n'
+        << "Server address   : " << cfg_address_.get()                                         << '\n'
+        << "Server port      : " << cfg_port_.get()                                            << '\n'
         << "--------------------------------------------------------------------------------"  << manip::endl;
 
+    std::size_t worker_count = cfg_workers_.get();
+
+    if(worker_count > 0 && !prefork_worker_) {
+      open_metrics_listener(boost::bind(&Server::render_cluster_metrics, this, _1));
+
+      if(!run_prefork_master(worker_count)) {
+        LogStream::stopAsync(); // This is the master, and all of its workers have exited.
+        return;
+      }
+    } else if(!prefork_worker_) {
+      open_metrics_listener(&OpenMetrics::render);
+
+      if(metrics_listener_) {
+        metrics_listener_->start();
+      }
+    }
+
+    if(cfg_watchdog_limit_.get() > 0) { // Here, so a pre-forked worker watches its own threads.
+      watchdog_.reset(new Watchdog(request_router_,
+                                   io_service_pool_,
+                                   cfg_watchdog_limit_.get(),
+                                   (cfg_watchdog_restart_.get() == "true"),
+                                   cfg_drain_timeout_.get()));
+      watchdog_->start();
+    }
+
     io_service_pool_.run();
+
+    if(watchdog_) {
+      watchdog_->stop();
+    }
+
+    if(metrics_listener_) {
+      metrics_listener_->stop();
+    }
+
+    if(stats_reporter_) {
+      stats_reporter_->interrupt();
+      shutdown(stats_socket_, SHUT_RDWR); // Wakes it, should it be waiting on the master.
+      stats_reporter_->join();
+      close(stats_socket_);
+      stats_socket_ = -1;
+    }
+
+    LogStream::stopAsync(); // Writes out what is still queued, the drain's last lines included. The threads above no longer log.
   }
 
   //--------------------------------------------------------------------------------
   void Server::stop()
   {
     LogStream log(__PRETTY_FUNCTION__);
-    handle_stop();
+    request_stop();
 
     log << manip::info_normal
         << "--------------------------------------------------------------------------------"  << '\n'
         << "Stopping Process : " << Config::instance()->getAppId()                             << '\n'
         << "Instance         : " << Config::instance()->getAppInstance()                       << '\n'
-        << "Server address   : " << Config::instance()->get<std::string>("kcc-server.address") << '\n'
-        << "Server port      : " << Config::instance()->get<std::string>("kcc-server.port")    << '\n'
+        << "Server address   : " << cfg_address_.get()                                         << '\n'
+        << "Server port      : " << cfg_port_.get()                                            << '\n'
         << "--------------------------------------------------------------------------------"  << manip::endl;
   }
 
@@ -154,18 +382,92 @@ namespace kisscpp
   //--------------------------------------------------------------------------------
   void Server::handle_accept(const boost::system::error_code& e)
   {
-    LogStream log(__PRETTY_FUNCTION__);
+    LogStream     log (__PRETTY_FUNCTION__);
+    LoopBusyTimer busy; // The connection is served right here, on the acceptor's thread.
+
     if(!e) {
       new_connection_->start();
     }
 
-    start_accept();
+    if(!draining_ && e != boost::asio::error::operation_aborted) {
+      start_accept();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // The acceptor is closed, and the drain timer armed, on the thread that runs the
+  // acceptor's io_service, never alongside start_accept on another.
+  void Server::request_stop()
+  {
+    acceptor_.get_io_service().post(boost::bind(&Server::handle_stop, this));
   }
 
   //--------------------------------------------------------------------------------
   void Server::handle_stop()
   {
     LogStream log(__PRETTY_FUNCTION__);
+
+    if(draining_.exchange(true)) { // A drain is already in progress.
+      return;
+    }
+
+    unsigned long int         drain_timeout = cfg_drain_timeout_.get();
+    boost::system::error_code ignored_error;
+
+    log << manip::info_normal
+        << "Draining: No longer accepting connections. Waiting up to "
+        << drain_timeout
+        << "ms for ["
+        << request_router_.inFlightCount()
+        << "] in-flight request(s) to complete."
+        << manip::endl;
+
+    acceptor_.close(ignored_error);
+    handoff_acceptor_.get_io_service().post(boost::bind(&Server::close_handoff_listener, this));
+    request_router_.beginDrain();
+
+    drain_deadline_ = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(drain_timeout);
+
+    handle_drain_check(boost::system::error_code());
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::close_handoff_listener()
+  {
+    boost::system::error_code ignored_error;
+    handoff_acceptor_.close(ignored_error);
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::handle_drain_check(const boost::system::error_code& e)
+  {
+    if(!e &&
+       request_router_.inFlightCount() > 0 &&
+       boost::posix_time::microsec_clock::universal_time() < drain_deadline_) {
+
+      drain_timer_.expires_from_now(boost::posix_time::milliseconds(DRAIN_POLL_INTERVAL_MS));
+      drain_timer_.async_wait(boost::bind(&Server::handle_drain_check, this, boost::asio::placeholders::error));
+
+    } else {
+      finish_stop();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::finish_stop()
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    if(request_router_.inFlightCount() > 0) {
+      log << manip::error_normal
+          << "Drain deadline reached, abandoning ["
+          << request_router_.inFlightCount()
+          << "] in-flight request(s)."
+          << manip::endl;
+    }
+
+    log << manip::info_normal << "Drain completed, stopping io services." << manip::flush;
+
     io_service_pool_.stop();
   }
 
@@ -177,25 +479,500 @@ namespace kisscpp
     log.set2ReOpen();
   }
 
+  //--------------------------------------------------------------------------------
+  void Server::reload_configuration()
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    try {
+      Config::instance()->reload();
+    } catch (std::exception& e) {
+      log << manip::error_high << "Configuration not reloaded, the current configuration remains in use: " << e.what() << manip::endl;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::handle_stop_signal(const boost::system::error_code& e)
+  {
+    if(e != boost::asio::error::operation_aborted) {
+      request_stop();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::handle_reopen_signal(const boost::system::error_code& e)
+  {
+    if(e != boost::asio::error::operation_aborted) {
+      handle_log_reopen();
+      reload_configuration();
+      log_reopen_signals_.async_wait(boost::bind(&Server::handle_reopen_signal, this, boost::asio::placeholders::error));
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // The master binds the acceptor (that happened in the constructor) and forks the
+  // workers. Each worker runs its own io_services, and accepts on the shared socket.
+  // The master restarts workers that die, and sums up the stats they report.
+  bool Server::run_prefork_master(std::size_t worker_count)
+  {
+    LogStream        log(__PRETTY_FUNCTION__);
+    struct sigaction stop_action;
+    struct sigaction reopen_action;
+
+    stop_signals_.cancel();
+    stop_signals_.clear();
+    log_reopen_signals_.cancel();
+    log_reopen_signals_.clear();
+
+    std::memset(&stop_action  , 0, sizeof(stop_action));
+    std::memset(&reopen_action, 0, sizeof(reopen_action));
+
+    stop_action.sa_handler   = preforkStopHandler;
+    reopen_action.sa_handler = preforkReopenHandler;
+
+    sigemptyset(&stop_action.sa_mask);
+    sigemptyset(&reopen_action.sa_mask);
+
+    sigaction(SIGINT , &stop_action  , NULL);
+    sigaction(SIGTERM, &stop_action  , NULL);
+#if defined(SIGQUIT)
+    sigaction(SIGQUIT, &stop_action  , NULL);
+#endif
+    sigaction(SIGHUP , &reopen_action, NULL);
+
+    StatsKeeper::instance()->stop(); // Threads do not survive fork(), the workers start their own.
+
+    prefork_workers_.resize(worker_count);
+
+    for(std::size_t i = 0; i < worker_count; ++i) {
+      if(spawn_worker(i)) {
+        return true;
+      }
+    }
+
+    while(!prefork_stop_requested) {
+      std::vector<struct pollfd> poll_fds;
+      std::vector<std::size_t>   poll_workers;
+
+      for(std::size_t i = 0; i < prefork_workers_.size(); ++i) {
+        if(prefork_workers_[i].stats_socket >= 0) {
+          struct pollfd pfd;
+          pfd.fd      = prefork_workers_[i].stats_socket;
+          pfd.events  = POLLIN;
+          pfd.revents = 0;
+          poll_fds.push_back(pfd);
+          poll_workers.push_back(i);
+        }
+      }
+
+      if(metrics_listener_) { // Scrapes are answered from this loop, the master does not run an io_service.
+        struct pollfd pfd;
+        pfd.fd      = metrics_listener_->socket();
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        poll_fds.push_back(pfd);
+        poll_workers.push_back(prefork_workers_.size());
+      }
+
+      if(poll(poll_fds.empty() ? NULL : &poll_fds[0], poll_fds.size(), PREFORK_POLL_INTERVAL_MS) > 0) {
+        for(std::size_t i = 0; i < poll_fds.size(); ++i) {
+          if(poll_fds[i].revents != 0) {
+            if(poll_workers[i] < prefork_workers_.size()) {
+              handle_worker_report(poll_workers[i]);
+            } else {
+              metrics_listener_->serve(PREFORK_SCRAPE_BUDGET_MS);
+            }
+          }
+        }
+      }
+
+      LogStream::checkRotation(); // Only the master rotates, and it hardly logs, so it would rarely notice the file is due.
+
+      if(prefork_reopen_requested) {
+        prefork_reopen_requested = 0;
+        handle_log_reopen();
+        reload_configuration();
+
+        for(std::size_t i = 0; i < prefork_workers_.size(); ++i) {
+          if(prefork_workers_[i].pid > 0) { kill(prefork_workers_[i].pid, SIGHUP); }
+        }
+      }
+
+      for(std::size_t i = 0; i < prefork_workers_.size(); ++i) { // By pid: the log rotator's gzip children are reaped by the log rotator.
+        pid_t pid = prefork_workers_[i].pid;
+        int   status;
+
+        if(pid > 0 && waitpid(pid, &status, WNOHANG) == pid) {
+          PreforkWorker &worker      = prefork_workers_[i];
+          unsigned int   quick_exits = (monotonicMs() - worker.started < PREFORK_STARTUP_MS) ? worker.quick_exits + 1 : 0;
+          uint64_t       delay       = respawnDelay(quick_exits);
+
+          log << manip::error_normal
+              << "Worker [" << static_cast<unsigned long>(i) << "] pid [" << static_cast<long>(pid) << "] exited with status ["
+              << status << "]";
+
+          if(prefork_stop_requested) { log << "." << manip::flush;
+          } else                     { log << ", restarting it in " << delay << "ms." << manip::flush;
+          }
+
+          if(worker.stats_socket >= 0) {
+            close(worker.stats_socket);
+          }
+
+          worker             = PreforkWorker();
+          worker.quick_exits = quick_exits;
+          worker.respawn_at  = monotonicMs() + delay;
+        }
+      }
+
+      for(std::size_t i = 0; i < prefork_workers_.size() && !prefork_stop_requested; ++i) {
+        if(prefork_workers_[i].pid <= 0 && monotonicMs() >= prefork_workers_[i].respawn_at && spawn_worker(i)) {
+          return true;
+        }
+      }
+    }
+
+    stop_workers();
+
+    return false;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Workers drain as they would on their own SIGTERM. Their stats sockets are shut
+  // down first, so none of them waits for the master to answer a report.
+  void Server::stop_workers()
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+    uint64_t  deadline = monotonicMs() + cfg_drain_timeout_.get() + PREFORK_KILL_GRACE_MS;
+    bool      running  = false;
+
+    log << manip::info_normal << "Pre-fork master stopping workers." << manip::flush;
+
+    for(std::size_t i = 0; i < prefork_workers_.size(); ++i) {
+      if(prefork_workers_[i].stats_socket >= 0) { shutdown(prefork_workers_[i].stats_socket, SHUT_RDWR); }
+      if(prefork_workers_[i].pid          >  0) { kill(prefork_workers_[i].pid, SIGTERM); running = true; }
+    }
+
+    while(running && monotonicMs() < deadline) {
+      running = false;
+
+      for(std::size_t i = 0; i < prefork_workers_.size(); ++i) {
+        int status;
+
+        if(prefork_workers_[i].pid > 0 && waitpid(prefork_workers_[i].pid, &status, WNOHANG) == 0) {
+          running = true;
+        } else {
+          prefork_workers_[i].pid = -1;
+        }
+      }
+
+      if(running) {
+        poll(NULL, 0, DRAIN_POLL_INTERVAL_MS);
+      }
+    }
+
+    for(std::size_t i = 0; i < prefork_workers_.size(); ++i) {
+      if(prefork_workers_[i].pid > 0) {
+        int status;
+
+        log << manip::error_normal << "Worker pid [" << static_cast<long>(prefork_workers_[i].pid) << "] did not stop in time, killing it." << manip::flush;
+
+        kill(prefork_workers_[i].pid, SIGKILL);
+        waitpid(prefork_workers_[i].pid, &status, 0);
+      }
+
+      if(prefork_workers_[i].stats_socket >= 0) {
+        close(prefork_workers_[i].stats_socket);
+      }
+    }
+
+    prefork_workers_.clear();
+  }
+
+  //--------------------------------------------------------------------------------
+  bool Server::spawn_worker(std::size_t index)
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+    int       sockets[2];
+    pid_t     pid;
+
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+      throw std::runtime_error("Could not create a socket pair for a pre-forked worker.");
+    }
+
+    log << manip::info_normal << "Forking worker [" << static_cast<unsigned long>(index) << "]" << manip::flush; // Flushed, so that the child does not inherit buffered lines.
+
+    io_service_pool_.notify_fork(boost::asio::io_service::fork_prepare);
+
+    pid = fork();
+
+    if(pid < 0) {
+      close(sockets[0]);
+      close(sockets[1]);
+      throw std::runtime_error("Could not fork a pre-forked worker.");
+    }
+
+    if(pid == 0) {
+      LogStream::afterFork();
+      io_service_pool_.notify_fork(boost::asio::io_service::fork_child);
+
+      close(sockets[0]);
+
+      for(std::size_t i = 0; i < prefork_workers_.size(); ++i) {
+        if(prefork_workers_[i].stats_socket >= 0) {
+          close(prefork_workers_[i].stats_socket);
+        }
+      }
+
+      prefork_workers_.clear();
+      prefork_worker_ = true;
+      metrics_listener_.reset();
+
+      boost::system::error_code ignored_error;
+      handoff_acceptor_.close(ignored_error); // Hot restarts are not supported in pre-fork mode.
+
+      signalRegistrations();
+      StatsKeeper::instance()->start();
+      stats_socket_ = sockets[1];
+      stats_reporter_.reset(new boost::thread(boost::bind(&Server::report_worker_stats, this, sockets[1])));
+
+      return true;
+    }
+
+    io_service_pool_.notify_fork(boost::asio::io_service::fork_parent);
+
+    close(sockets[1]);
+
+    prefork_workers_[index].pid          = pid;
+    prefork_workers_[index].stats_socket = sockets[0];
+    prefork_workers_[index].started      = monotonicMs();
+
+    return false;
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::handle_worker_report(std::size_t index)
+  {
+    PreforkWorker &worker = prefork_workers_[index];
+    char           chunk[4096];
+    ssize_t        rc     = read(worker.stats_socket, chunk, sizeof(chunk));
+
+    if(rc <= 0) {
+      if(rc < 0 && errno == EINTR) { return; }
+
+      close(worker.stats_socket); // The worker is going away, waitpid() will take care of the rest.
+      worker.stats_socket = -1;
+      return;
+    }
+
+    worker.read_buffer.append(chunk, rc);
+
+    std::string::size_type end;
+
+    while((end = worker.read_buffer.find('\n')) != std::string::npos) {
+      StatsMapType cluster_totals;
+      StatsMapType cluster_stats;
+
+      parseStatsLine(worker.read_buffer.substr(0, end), worker.stats);
+      worker.read_buffer.erase(0, end + 1);
+
+      sum_worker_stats(cluster_totals);
+      StatsKeeper::totalsToStats(cluster_totals, cluster_stats);
+
+      writeAll(worker.stats_socket, formatStatsLine(cluster_stats));
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // Workers report totals, as StatsKeeper::getTotals has them: their gather
+  // periods do not line up, and percentiles can not be added up.
+  void Server::sum_worker_stats(StatsMapType &cluster_totals)
+  {
+    std::size_t live_workers = 0;
+
+    for(std::size_t i = 0; i < prefork_workers_.size(); ++i) {
+      if(prefork_workers_[i].pid <= 0) { continue; }
+
+      live_workers++;
+
+      StatsKeeper::addTotals(cluster_totals, prefork_workers_[i].stats);
+    }
+
+    cluster_totals["gauge:kcs-workers"] = live_workers;
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::open_metrics_listener(const MetricsListener::Renderer &renderer)
+  {
+    std::string port    = cfg_metrics_port_.get();
+    std::string address = cfg_metrics_address_.get();
+
+    if(port.empty()) {
+      return;
+    }
+
+    metrics_listener_.reset(new MetricsListener(renderer));
+
+    if(!metrics_listener_->open(address.empty() ? cfg_address_.get() : address, port)) {
+      metrics_listener_.reset(); // Logged, the server runs on without it.
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // Typed as a worker would expose its own, but without percentiles.
+  void Server::render_cluster_metrics(std::string &out)
+  {
+    StatsMapType cluster_totals;
+
+    sum_worker_stats(cluster_totals);
+    StatsKeeper::writeOpenMetrics(out, cluster_totals);
+
+    ErrorStateList::instance()->writeOpenMetrics(out);
+
+    out += "# EOF\n";
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::report_worker_stats(int master_socket)
+  {
+    std::string read_buffer;
+    std::string reply;
+
+    try {
+      while(true) {
+        boost::this_thread::sleep(boost::posix_time::seconds(1));
+
+        SharedStatsMapType totals        = StatsKeeper::instance()->getTotals();
+        SharedStatsMapType cluster_stats(new StatsMapType());
+
+        if(!writeAll(master_socket, formatStatsLine(*totals)) || !readLine(master_socket, read_buffer, reply, PREFORK_REPLY_TIMEOUT_MS)) {
+          break; // The socket is closed by run(), once this thread is joined.
+        }
+
+        parseStatsLine(reply, *cluster_stats);
+        StatsKeeper::instance()->setClusterStats(cluster_stats);
+      }
+    } catch(boost::thread_interrupted &) {
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::start_handoff_listener()
+  {
+    LogStream                                     log(__PRETTY_FUNCTION__);
+    boost::asio::local::stream_protocol::endpoint endpoint(handoffPath.native());
+
+    unlink(handoffPath.c_str()); // Left behind by a crash, or by the instance we just took over from.
+
+    // Whoever connects here, gets our listening socket: only our user may, from
+    // the moment the socket file exists.
+    boost::system::error_code bind_error;
+    mode_t                    old_mask = umask(S_IRWXG | S_IRWXO);
+
+    handoff_acceptor_.open(endpoint.protocol());
+    handoff_acceptor_.bind(endpoint, bind_error);
+
+    umask(old_mask);
+
+    if(bind_error) {
+      throw boost::system::system_error(bind_error);
+    }
+
+    handoff_acceptor_.listen();
+
+    start_handoff_accept();
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::start_handoff_accept()
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+    handoff_socket_.close();
+    handoff_acceptor_.async_accept(handoff_socket_,
+                                   boost::bind(&Server::handle_handoff,
+                                   this,
+                                   boost::asio::placeholders::error));
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::handle_handoff(const boost::system::error_code& e)
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    if(e) {
+      if(!draining_ && e != boost::asio::error::operation_aborted) {
+        start_handoff_accept();
+      }
+      return;
+    }
+
+    struct ucred peer;
+    socklen_t    peer_length = sizeof(peer);
+
+    if(getsockopt(handoff_socket_.native_handle(), SOL_SOCKET, SO_PEERCRED, &peer, &peer_length) != 0 || peer.uid != geteuid()) {
+      log << manip::error_high << "Refused to hand the listening socket over to a process of another user." << manip::endl;
+      start_handoff_accept();
+      return;
+    }
+
+    if(draining_ || !sendFileDescriptor(handoff_socket_.native_handle(), acceptor_.native_handle())) {
+      log << manip::error_normal << "Could not hand the listening socket over to a replacement process." << manip::endl;
+      start_handoff_accept();
+      return;
+    }
+
+    log << manip::info_normal << "Listening socket sent to replacement process, waiting for it to start accepting." << manip::endl;
+
+    boost::asio::async_read(handoff_socket_,
+                            boost::asio::buffer(&handoff_ack_, 1),
+                            boost::bind(&Server::handle_handoff_ack,
+                            this,
+                            boost::asio::placeholders::error));
+  }
+
+  //--------------------------------------------------------------------------------
+  void Server::handle_handoff_ack(const boost::system::error_code& e)
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    if(!e && handoff_ack_ == HANDOFF_ACK) {
+      log << manip::info_normal << "Replacement process is accepting connections, handing over." << manip::endl;
+      handed_off_ = true;
+      handoff_socket_.close();
+      request_stop();
+    } else {
+      log << manip::error_normal << "Replacement process did not take over, continuing to serve." << manip::endl;
+      start_handoff_accept();
+    }
+  }
+
   //--------------------------------------------------------------------------------
   void Server::initialize_standard_handlers()
   {
     statsReporter.reset(new StatsReporter());
+    metricsReporter.reset(new MetricsReporter());
     errorReporter.reset(new ErrorReporter());
     handlerReporter.reset(new HandlerReporter(request_router_));
+    inFlightReporter.reset(new InFlightReporter(request_router_));
     logLevelAdjuster.reset(new LogLevelAdjuster());
+    configReloader.reset(new ConfigReloader());
+    profileReporter.reset(new ProfileReporter());
 
     register_handler(statsReporter);
+    register_handler(metricsReporter);
     register_handler(errorReporter);
     register_handler(handlerReporter);
+    register_handler(inFlightReporter);
     register_handler(logLevelAdjuster);
+    register_handler(configReloader);
+    register_handler(profileReporter);
   }
 
   //--------------------------------------------------------------------------------
-  bool Server::checkLockFile(const std::string &appid, const std::string& instance)
+  void Server::makeLockFilePaths(const std::string &appid, const std::string& instance)
   {
-    bool         retval        = false;
     std::string  lockFileName  = appid + "." + instance + ".lock";
+    std::string  handoffName   = appid + "." + instance + ".handoff";
     char        *kcpp_lock_dir = std::getenv("KCPP_LOCK_DIR");
 
     if(kcpp_lock_dir) {
@@ -204,7 +981,17 @@ namespace kisscpp
       lockFilePath = "/var/run";
     }
 
-    lockFilePath += "/" + lockFileName;
+    handoffPath   = lockFilePath;
+    lockFilePath /= lockFileName;
+    handoffPath  /= handoffName;
+  }
+
+  //--------------------------------------------------------------------------------
+  bool Server::checkLockFile(const std::string &appid, const std::string& instance)
+  {
+    bool retval = false;
+
+    makeLockFilePaths(appid, instance);
 
     if(!bfs::exists(lockFilePath)) {
       retval = true;
@@ -239,6 +1026,30 @@ namespace kisscpp
     return retval;
   }
 
+  //--------------------------------------------------------------------------------
+  // If an instance with this appid and instance id is running, with hot restarts
+  // enabled, take over its listening socket and lock file.
+  int Server::takeOverListener(const std::string &appid, const std::string& instance, int &handoff_socket)
+  {
+    int listener = -1;
+
+    makeLockFilePaths(appid, instance);
+
+    if(bfs::exists(lockFilePath) && bfs::exists(handoffPath)) {
+      listener = requestListenerHandoff(handoffPath.native(), handoff_socket);
+
+      if(listener >= 0) {
+        std::ofstream lockFile(lockFilePath.c_str(), std::ios::out | std::ios::trunc);
+        lockFile << std::time(NULL) << std::endl;
+        std::cerr << "Took over listening socket from running instance: [" << handoffPath.native() << "]" << std::endl;
+      } else {
+        std::cerr << "Could not take over from running instance: [" << handoffPath.native() << "]" << std::endl;
+      }
+    }
+
+    return listener;
+  }
+
   //--------------------------------------------------------------------------------
   void Server::removeLockFile()
   {
@@ -247,6 +1058,14 @@ namespace kisscpp
     }
   }
 
+  //--------------------------------------------------------------------------------
+  void Server::removeHandoffSocket()
+  {
+    if(hot_restart_ && bfs::exists(handoffPath)) {
+      bfs::remove(handoffPath);
+    }
+  }
+
   //--------------------------------------------------------------------------------
   void Server::signalRegistrations()
   {
@@ -262,21 +1081,80 @@ namespace kisscpp
 
     log_reopen_signals_.add(SIGHUP);
 
-    stop_signals_.async_wait(boost::bind(&Server::handle_stop, this));
-    log_reopen_signals_.async_wait(boost::bind(&Server::handle_log_reopen, this));
+    stop_signals_.async_wait(boost::bind(&Server::handle_stop_signal, this, boost::asio::placeholders::error));
+    log_reopen_signals_.async_wait(boost::bind(&Server::handle_reopen_signal, this, boost::asio::placeholders::error));
+
+  }
+
+  //--------------------------------------------------------------------------------
+  // kcc-stats.gather-period-ms, when set, takes the place of kcc-stats.gather-period.
+  // kcc-stats.rollups is a comma separated list of periods, in seconds.
+  void Server::initializeStats()
+  {
+    unsigned long int              gather_period = cfg_stats_gather_period_ms_.get();
+    std::vector<std::string>       periods;
+    std::vector<unsigned long int> rollups;
+    std::string                    rollup_list   = cfg_stats_rollups_.get();
+
+    if(gather_period == 0) {
+      gather_period = cfg_stats_gather_period_.get() * 1000;
+    }
+
+    boost::split(periods, rollup_list, boost::is_any_of(", "), boost::token_compress_on);
+
+    for(std::size_t i = 0; i < periods.size(); ++i) {
+      if(!periods[i].empty()) {
+        rollups.push_back(boost::lexical_cast<unsigned long int>(periods[i]) * 1000);
+      }
+    }
+
+    StatsKeeper::instance(cfg_stats_gather_period_.get(),
+                          cfg_stats_history_length_.get())->configure(gather_period,
+                                                                      cfg_stats_history_length_.get(),
+                                                                      rollups);
+  }
+
+  //--------------------------------------------------------------------------------
+  // kcc-server.shed-on-errors lists "id=count/seconds" thresholds, separated by
+  // commas, at which requests are shed.
+  void Server::initializeErrorStates()
+  {
+    std::vector<std::string> thresholds;
+    std::string              threshold_list = cfg_shed_on_errors_.get();
+
+    boost::split(thresholds, threshold_list, boost::is_any_of(", "), boost::token_compress_on);
+
+    for(std::size_t i = 0; i < thresholds.size(); ++i) {
+      std::vector<std::string> parts;
+
+      if(thresholds[i].empty()) {
+        continue;
+      }
+
+      boost::split(parts, thresholds[i], boost::is_any_of("=/"));
 
+      if(parts.size() != 3) {
+        throw std::invalid_argument("kcc-server.shed-on-errors: expected id=count/seconds, got [" + thresholds[i] + "]");
+      }
+
+      ErrorStateList::instance()->setThreshold(parts[0],
+                                               boost::lexical_cast<unsigned int>(parts[1]),
+                                               boost::lexical_cast<unsigned int>(parts[2]),
+                                               true);
+    }
   }
 
   //--------------------------------------------------------------------------------
   void Server::initializeLogging(bool log2console)
   {
+    bool         binaryFormat  = (cfg_log_format_.get() == "binary");
     std::string  logFileRoot   = "/tmp";
     std::string  logFileName   = Config::instance()->getAppId()       + "." +
-                                 Config::instance()->getAppInstance() + ".log";
+                                 Config::instance()->getAppInstance() + ((binaryFormat) ? ".blog" : ".log");
 
-    std::string  logType       = Config::instance()->get<std::string> ("kcc-log-level.type"     ,"info");
-    std::string  logSeverity   = Config::instance()->get<std::string> ("kcc-log-level.severity" ,"low");
-    unsigned int maxLinesBuff  = Config::instance()->get<unsigned int>("kcc-log-level.buff-size",5000);
+    std::string  logType       = cfg_log_type_.get();
+    std::string  logSeverity   = cfg_log_severity_.get();
+    unsigned int maxLinesBuff  = cfg_log_buff_size_.get();
 
     char        *kcpp_log_root = std::getenv("KCPP_LOG_ROOT");
     char        *kcpp_exec_env = std::getenv("KCPP_EXEC_ENV");
@@ -299,6 +1177,20 @@ namespace kisscpp
 
     logFilePath  = logFileRoot + "/" + logFileName;
 
+    LogStream::setBinaryFormat(binaryFormat);
+
+    LogRotation rotation;
+
+    rotation.max_bytes = static_cast<uint64_t>(cfg_log_rotate_size_.get()) * 1024 * 1024;
+    rotation.interval  = cfg_log_rotate_interval_.get();
+    rotation.keep      = cfg_log_rotate_keep_.get();
+    rotation.compress  = (cfg_log_rotate_compress_.get() == "true");
+
+    LogStream::setRotation(rotation);
+
+    LogLimiter::setRateLimit(cfg_log_rate_limit_.get());
+    LogLimiter::setSample   (cfg_log_sample_.get());
+
     kisscpp::LogStream log(__PRETTY_FUNCTION__,
                            logFilePath.native(),
                            log2console,
@@ -306,6 +1198,12 @@ namespace kisscpp
 
     log.setMessageType(logType    , true);
     log.setSeverity   (logSeverity, true);
+
+    LogStream::setCoarseClock(cfg_log_coarse_clock_.get() == "true");
+
+    if(cfg_log_async_.get() == "true") {
+      LogStream::startAsync(cfg_log_queue_size_.get(), AsyncLogWriter::toOverflowPolicy(cfg_log_overflow_.get()));
+    }
   }
 
   //--------------------------------------------------------------------------------
@@ -22,6 +22,10 @@
 #include <sys/types.h>  // getpid()
 #include <unistd.h>     // getpid()
 #include <sys/stat.h>   // umask
+#include <sys/wait.h>   // waitpid()
+#include <sys/socket.h> // socketpair()
+#include <poll.h>       // poll()
+#include <signal.h>     // sigaction()
 
 #include <iostream>
 #include <fstream>
@@ -29,15 +33,30 @@
 #include <vector>
 #include <cstdlib>
 #include <ctime>
+#include <stdexcept>
 
 #include <boost/asio.hpp>
+#include <boost/atomic.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 namespace bfs = boost::filesystem;
 
+#define DRAIN_POLL_INTERVAL_MS   50
+#define PREFORK_POLL_INTERVAL_MS 250
+#define PREFORK_REPLY_TIMEOUT_MS 5000  // How long a worker waits for the master to answer its stats.
+#define PREFORK_SCRAPE_BUDGET_MS 50    // All the master's loop spends on one scrape, accept to last byte.
+#define PREFORK_KILL_GRACE_MS    2000  // Beyond kcc-server.drain-timeout, before the master kills a stopping worker.
+#define PREFORK_STARTUP_MS       5000  // A worker exiting sooner than this, is restarted after a growing delay,
+#define PREFORK_RESPAWN_MIN_MS   1000  // starting at this,
+#define PREFORK_RESPAWN_MAX_MS   30000 // and doubling up to this.
+
 #include "io_service_pool.hpp"
 #include "connection.hpp"
 #include "request_router.hpp"
@@ -46,6 +65,9 @@ namespace bfs = boost::filesystem;
 #include "errorstate.hpp"
 #include "standard_handlers.hpp"
 #include "configuration.hpp"
+#include "socket_handoff.hpp"
+#include "metrics_listener.hpp"
+#include "watchdog.hpp"
 
 namespace kisscpp
 {
@@ -63,7 +85,10 @@ namespace kisscpp
 
       ~Server()
       {
-        removeLockFile();
+        if(!handed_off_ && !prefork_worker_) { // The replacement process, or the pre-fork master owns these.
+          removeLockFile();
+          removeHandoffSocket();
+        }
       }
 
       void run();  // Run the server's io_service loop.
@@ -74,31 +99,121 @@ namespace kisscpp
       IoServicePool &getIoServicePool() { return io_service_pool_; };
 
     private:
+      //--------------------------------------------------------------------------------
+      // A worker process, as seen by the pre-fork master.
+      struct PreforkWorker
+      {
+        PreforkWorker() : pid(-1), stats_socket(-1), started(0), quick_exits(0), respawn_at(0) {}
+
+        pid_t        pid;
+        int          stats_socket; // The master's end of the socket pair the worker reports its stats on.
+        std::string  read_buffer;
+        StatsMapType stats;        // The stats last reported by the worker.
+        uint64_t     started;      // Monotonic milliseconds.
+        unsigned int quick_exits;  // In a row, each within PREFORK_STARTUP_MS of starting.
+        uint64_t     respawn_at;   // Monotonic milliseconds, while pid is -1.
+      };
+
       void start_accept();                                    // Initiate an asynchronous accept operation.
       void handle_accept(const boost::system::error_code& e); // Handle completion of an asynchronous accept operation.
-      void handle_stop();                                     // Handle a request to stop the server.
+      void request_stop();                                    // Post handle_stop to the acceptor's io_service, safe from any thread.
+      void handle_stop();                                     // Handle a request to stop the server. Starts draining in-flight requests.
+      void close_handoff_listener();                          // On the handoff acceptor's io_service.
+      void handle_drain_check(const boost::system::error_code& e); // Stop the server once in-flight requests are done, or the drain deadline passed.
+      void finish_stop();                                     // Flush what needs flushing, and stop the io_services.
       void handle_log_reopen();                               // Handle a request to reopen log.
+      void reload_configuration();                            // Publish a new Config snapshot, keeping the current one on failure.
+      void handle_stop_signal  (const boost::system::error_code& e);
+      void handle_reopen_signal(const boost::system::error_code& e);
+      bool run_prefork_master  (std::size_t worker_count);    // Returns true in a newly forked worker, false once the master is done.
+      bool spawn_worker        (std::size_t index);           // Returns true in the child.
+      void handle_worker_report(std::size_t index);           // Read a worker's stats and answer with the sum over all workers.
+      void report_worker_stats (int master_socket);           // Worker thread, exchanging stats with the master.
+      void stop_workers        ();                            // SIGTERM, and SIGKILL for those that do not exit in time.
+      void open_metrics_listener(const MetricsListener::Renderer &renderer); // When kcc-server.metrics-port is set.
+      void render_cluster_metrics(std::string &out);          // The pre-fork master's exposition, of what its workers report.
+      void sum_worker_stats      (StatsMapType &cluster_totals);
+      void start_handoff_listener();                          // Listen for a replacement process, when hot restarts are enabled.
+      void start_handoff_accept();
+      void handle_handoff    (const boost::system::error_code& e); // Send our listening socket to the replacement process.
+      void handle_handoff_ack(const boost::system::error_code& e); // The replacement process is accepting, so we drain.
       void initialize_standard_handlers();
-      bool checkLockFile (const std::string &appid, const std::string& instance);
-      bool createLockFile(const std::string &appid, const std::string& instance);
+      void makeLockFilePaths(const std::string &appid, const std::string& instance);
+      bool checkLockFile    (const std::string &appid, const std::string& instance);
+      bool createLockFile   (const std::string &appid, const std::string& instance);
+      int  takeOverListener (const std::string &appid, const std::string& instance, int &handoff_socket);
       void removeLockFile();
+      void removeHandoffSocket();
       void signalRegistrations();
       void initializeLogging(bool log2console);
+      void initializeStats();
+      void initializeErrorStates();
       void becomeDaemonProcess();
 
       IoServicePool                  io_service_pool_;        // The pool of io_service objects used to perform asynchronous operations.
       boost::asio::signal_set        stop_signals_;           // The signal_set is used to register for process termination notifications.
       boost::asio::signal_set        log_reopen_signals_;     // The signal_set is used to register for process termination notifications.
       boost::asio::ip::tcp::acceptor acceptor_;               // Acceptor used to listen for incoming connections.
+      boost::asio::deadline_timer    drain_timer_;            // Used to poll the number of in-flight requests while draining.
+      boost::posix_time::ptime       drain_deadline_;         // In-flight requests still running at this time, are abandoned.
+      boost::atomic<bool>            draining_;               // Set once a stop has been requested.
+      boost::asio::local::stream_protocol::acceptor handoff_acceptor_; // Listens for a replacement process (KCPP_HOT_RESTART).
+      boost::asio::local::stream_protocol::socket   handoff_socket_;   // Connection to the replacement process.
+      char                           handoff_ack_;
+      bool                           hot_restart_;
+      bool                           handed_off_;             // Set once a replacement process has taken over our listening socket.
+      bool                           prefork_worker_;         // Set in worker processes, when running in pre-fork mode.
       ConnectionPtr                  new_connection_;         // The next connection to be accepted.
       RequestRouter                  request_router_;         // The handler for all incoming requests.
+      std::vector<PreforkWorker>     prefork_workers_;        // Only populated in the pre-fork master.
+      boost::scoped_ptr<boost::thread> stats_reporter_;       // Only running in pre-forked workers.
+      int                            stats_socket_;           // A pre-forked worker's end of the socket pair, closed once stats_reporter_ is joined.
+      boost::scoped_ptr<MetricsListener> metrics_listener_;   // Not in pre-forked workers, the master serves their sum.
+      boost::scoped_ptr<Watchdog>    watchdog_;               // When kcc-server.watchdog-limit is set.
       bfs::path                      lockFilePath;
+      bfs::path                      handoffPath;
+
+      // Configuration, resolved once per configuration generation.
+      ConfigKey<std::string>         cfg_address_;
+      ConfigKey<std::string>         cfg_port_;
+      ConfigKey<unsigned long int>   cfg_drain_timeout_;
+      ConfigKey<std::size_t>         cfg_workers_;
+      ConfigKey<std::string>         cfg_metrics_address_;
+      ConfigKey<std::string>         cfg_metrics_port_;
+      ConfigKey<unsigned long int>   cfg_loop_probe_interval_;
+      ConfigKey<unsigned long int>   cfg_slow_request_ms_;
+      ConfigKey<double>              cfg_slow_request_sample_;
+      ConfigKey<unsigned long int>   cfg_watchdog_limit_;
+      ConfigKey<std::string>         cfg_watchdog_restart_;
+      ConfigKey<std::string>         cfg_shed_on_errors_;
+      ConfigKey<unsigned long int>   cfg_stats_gather_period_;
+      ConfigKey<unsigned long int>   cfg_stats_history_length_;
+      ConfigKey<unsigned long int>   cfg_stats_gather_period_ms_;
+      ConfigKey<std::string>         cfg_stats_rollups_;
+      ConfigKey<std::string>         cfg_log_type_;
+      ConfigKey<std::string>         cfg_log_severity_;
+      ConfigKey<unsigned int>        cfg_log_buff_size_;
+      ConfigKey<std::string>         cfg_log_async_;
+      ConfigKey<std::size_t>         cfg_log_queue_size_;
+      ConfigKey<std::string>         cfg_log_overflow_;
+      ConfigKey<std::string>         cfg_log_coarse_clock_;
+      ConfigKey<std::string>         cfg_log_format_;
+      ConfigKey<unsigned int>        cfg_log_rotate_size_;
+      ConfigKey<unsigned int>        cfg_log_rotate_interval_;
+      ConfigKey<unsigned int>        cfg_log_rotate_keep_;
+      ConfigKey<std::string>         cfg_log_rotate_compress_;
+      ConfigKey<unsigned int>        cfg_log_rate_limit_;
+      ConfigKey<double>              cfg_log_sample_;
 
       // Standard Handlers
       RequestHandlerPtr              statsReporter;
+      RequestHandlerPtr              metricsReporter;
       RequestHandlerPtr              errorReporter;
       RequestHandlerPtr              handlerReporter;
+      RequestHandlerPtr              inFlightReporter;
       RequestHandlerPtr              logLevelAdjuster;
+      RequestHandlerPtr              configReloader;
+      RequestHandlerPtr              profileReporter;
   };
 }
 
@@ -0,0 +1,139 @@
+// File  : socket_handoff.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+#include "socket_handoff.hpp"
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  bool sendFileDescriptor(int unix_socket, int fd)
+  {
+    struct msghdr   msg;
+    struct iovec    iov;
+    char            data = 'F';
+    char            control[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr *cmsg;
+
+    std::memset(&msg    , 0, sizeof(msg));
+    std::memset(control , 0, sizeof(control));
+
+    iov.iov_base       = &data;
+    iov.iov_len        = 1;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsg               = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level   = SOL_SOCKET;
+    cmsg->cmsg_type    = SCM_RIGHTS;
+    cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t rc;
+    do {
+      rc = sendmsg(unix_socket, &msg, 0);
+    } while(rc < 0 && errno == EINTR);
+
+    return (rc == 1);
+  }
+
+  //--------------------------------------------------------------------------------
+  int receiveFileDescriptor(int unix_socket)
+  {
+    struct msghdr   msg;
+    struct iovec    iov;
+    char            data;
+    char            control[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr *cmsg;
+    int             fd = -1;
+
+    std::memset(&msg    , 0, sizeof(msg));
+    std::memset(control , 0, sizeof(control));
+
+    iov.iov_base       = &data;
+    iov.iov_len        = 1;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t rc;
+    do {
+      rc = recvmsg(unix_socket, &msg, 0);
+    } while(rc < 0 && errno == EINTR);
+
+    if(rc == 1) {
+      for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+          std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+      }
+    }
+
+    return fd;
+  }
+
+  //--------------------------------------------------------------------------------
+  int requestListenerHandoff(const std::string &path, int &unix_socket)
+  {
+    struct sockaddr_un addr;
+    int                fd = -1;
+
+    unix_socket = -1;
+
+    if(path.size() >= sizeof(addr.sun_path)) {
+      return -1;
+    }
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if((unix_socket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      return -1;
+    }
+
+    if(connect(unix_socket, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+      fd = receiveFileDescriptor(unix_socket);
+    }
+
+    if(fd < 0) {
+      close(unix_socket);
+      unix_socket = -1;
+    }
+
+    return fd;
+  }
+
+  //--------------------------------------------------------------------------------
+  bool acknowledgeHandoff(int unix_socket)
+  {
+    char    ack = HANDOFF_ACK;
+    ssize_t rc;
+
+    do {
+      rc = write(unix_socket, &ack, 1);
+    } while(rc < 0 && errno == EINTR);
+
+    close(unix_socket);
+
+    return (rc == 1);
+  }
+}
@@ -0,0 +1,51 @@
+// File  : socket_handoff.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _SOCKET_HANDOFF_HPP_
+#define _SOCKET_HANDOFF_HPP_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  // Helpers for passing a listening socket from a running process, to the process
+  // replacing it, over a unix domain socket (SCM_RIGHTS).
+  //
+  // The conversation is short:
+  // 1. The new process connects to the handoff socket of the running process.
+  // 2. The running process sends its listening socket.
+  // 3. The new process starts accepting on that socket, and acknowledges with a
+  //    single byte. Only then does the running process start draining.
+
+  const char HANDOFF_ACK = 'R';
+
+  bool sendFileDescriptor    (int unix_socket, int fd);    // false on failure, errno is left as set by sendmsg.
+  int  receiveFileDescriptor (int unix_socket);            // -1 on failure.
+  int  requestListenerHandoff(const std::string &path,     // Connects to path, and returns the listening socket received, or -1.
+                              int               &unix_socket); // Left open on success, for acknowledgeHandoff.
+  bool acknowledgeHandoff    (int unix_socket);            // Tells the old process we are accepting, and closes unix_socket.
+}
+
+#endif // _SOCKET_HANDOFF_HPP_
@@ -1,7 +1,39 @@
+#include <cerrno>
+#include <cstring>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include "standard_handlers.hpp"
 
 namespace kisscpp
 {
+  namespace
+  {
+    const char *LOG_TYPE_NAMES    [] = { "debug", "info"  , "error" };
+    const char *LOG_SEVERITY_NAMES[] = { "low"  , "normal", "high"  };
+
+    //--------------------------------------------------------------------------------
+    // Names already validated by the caller.
+    int logLevelByName(const std::string &type, const std::string &severity)
+    {
+      int t = 0;
+      int s = 0;
+
+      while(type     != LOG_TYPE_NAMES    [t]) { ++t; }
+      while(severity != LOG_SEVERITY_NAMES[s]) { ++s; }
+
+      return logLevel(static_cast<log_type>(t), static_cast<log_severity>(s));
+    }
+
+    //--------------------------------------------------------------------------------
+    // Microseconds since the epoch, as "2024-01-31T13:45:00.123456Z".
+    std::string isoTime(uint64_t micros)
+    {
+      boost::posix_time::ptime t = boost::posix_time::from_time_t(static_cast<time_t>(micros / 1000000)) +
+                                   boost::posix_time::microseconds(static_cast<long>(micros % 1000000));
+
+      return boost::posix_time::to_iso_extended_string(t) + "Z";
+    }
+  }
+
   //--------------------------------------------------------------------------------
   void StatsReporter::run(const BoostPtree &request, BoostPtree &response)
   {
@@ -9,13 +41,15 @@ namespace kisscpp
 
     try {
 
-      std::string stat_type = request.get<std::string>("type","current");
+      std::string       stat_type = request.get<std::string>("type","current");
+      unsigned long int rollup    = request.get<unsigned long int>("rollup", 0) * 1000; // Seconds, gathered and full only.
 
       response.put("kcm-sts" , RQST_SUCCESS);
 
-      if      (stat_type == "full"    )   { full    (response); }
+      if      (stat_type == "full"    )   { full    (response, rollup); }
       else if (stat_type == "current" )   { current (response); }
-      else  /*(stat_type == "gathered")*/ { gathered(response); }
+      else if (stat_type == "cluster" )   { cluster (response); }
+      else  /*(stat_type == "gathered")*/ { gathered(response, rollup); }
 
     } catch (boost::property_tree::ptree_bad_path &e) {
 
@@ -23,6 +57,18 @@ namespace kisscpp
       response.put("kcm-sts", RQST_MISSING_PARAMETER);
       response.put("kcm-erm", e.what());
 
+    } catch (boost::property_tree::ptree_bad_data &e) {
+
+      log << "Exception: " << e.what() << manip::endl;
+      response.put("kcm-sts", RQST_INVALID_PARAMETER);
+      response.put("kcm-erm", e.what());
+
+    } catch (std::invalid_argument &e) {
+
+      log << "Exception: " << e.what() << manip::endl;
+      response.put("kcm-sts", RQST_INVALID_PARAMETER);
+      response.put("kcm-erm", e.what());
+
     } catch (std::exception& e) {
 
       log << "Exception: " << e.what() << manip::endl;
@@ -32,9 +78,9 @@ namespace kisscpp
   }
 
   //--------------------------------------------------------------------------------
-  void StatsReporter::gathered(BoostPtree &response)
+  void StatsReporter::gathered(BoostPtree &response, unsigned long int rollup)
   {
-    SharedStatsMapType ssmt  = StatsKeeper::instance()->getLastGatheredStats();
+    SharedStatsMapType ssmt  = StatsKeeper::instance()->getLastGatheredStats(rollup);
     bool               first = true;
     std::stringstream  cacti_fromat;
 
@@ -51,9 +97,9 @@ namespace kisscpp
   }
 
   //--------------------------------------------------------------------------------
-  void StatsReporter::full    (BoostPtree &response)
+  void StatsReporter::full    (BoostPtree &response, unsigned long int rollup)
   {
-    SharedStatsHistoryMapType sshmt = StatsKeeper::instance()->getFullStatsHistory();
+    SharedStatsHistoryMapType sshmt = StatsKeeper::instance()->getFullStatsHistory(rollup);
 
     for(StatsHistoryMapTypeIterator itr = sshmt->begin(); itr != sshmt->end(); ++itr) {
       for(unsigned int i = 0; i < (itr->second).size(); ++i) {
@@ -81,6 +127,37 @@ namespace kisscpp
     response.put("cacti_format_stats", cacti_fromat.str());
   }
 
+  //--------------------------------------------------------------------------------
+  void StatsReporter::cluster (BoostPtree &response)
+  {
+    SharedStatsMapType ssmt  = StatsKeeper::instance()->getClusterStats();
+    bool               first = true;
+    std::stringstream  cacti_fromat;
+
+    for(StatsMapTypeIterator itr = ssmt->begin(); itr != ssmt->end(); ++itr) {
+      response.put(itr->first, itr->second);
+
+      if(first) { first = false;
+      } else    { cacti_fromat << " ";
+      }
+      cacti_fromat << itr->first << ":" << itr->second;
+    }
+
+    response.put("cacti_format_stats", cacti_fromat.str());
+  }
+
+  //--------------------------------------------------------------------------------
+  void MetricsReporter::run(const BoostPtree &request, BoostPtree &response)
+  {
+    LogStream   log(__PRETTY_FUNCTION__);
+    std::string metrics;
+
+    OpenMetrics::render(metrics);
+
+    response.put("kcm-sts", RQST_SUCCESS);
+    response.put("metrics", metrics);
+  }
+
   //--------------------------------------------------------------------------------
   void ErrorReporter::run(const BoostPtree &request, BoostPtree &response)
   {
@@ -99,9 +176,27 @@ namespace kisscpp
       for(ErrorListIterator itr = selm->begin(); itr != selm->end(); ++itr) {
         BoostPtree error;
 
+        ErrorHistory history;
+
         error.put("type"       ,(*itr)->getId());
         error.put("description",(*itr)->getDescription());
         error.put("count"      ,(*itr)->getSetCount());
+        error.put("total"      ,(*itr)->getTotal());
+        error.put("rate-10s"   ,(*itr)->getRate(10));
+        error.put("rate-60s"   ,(*itr)->getRate(ERROR_RATE_SECONDS));
+        error.put("first-seen" ,isoTime((*itr)->getFirstSeen()));
+        error.put("last-seen"  ,isoTime((*itr)->getLastSeen()));
+
+        (*itr)->getHistory(history);
+
+        for(std::size_t i = 0; i < history.size(); ++i) {
+          BoostPtree occurrence;
+
+          occurrence.put("time"  , isoTime(history[i].when));
+          occurrence.put("detail", history[i].detail);
+
+          error.add_child("recent.occurrence", occurrence);
+        }
 
         response.add_child("error-state.errors.error", error);
 
@@ -112,6 +207,7 @@ namespace kisscpp
 
       response.put("error-state.error-type-count"  , error_type_count );
       response.put("error-state.total-error-count" , total_error_count);
+      response.put("error-state.shedding"          , (ErrorStateList::instance()->isShedding()) ? "true" : "false");
 
     } catch (boost::property_tree::ptree_bad_path &e) {
 
@@ -173,9 +269,15 @@ namespace kisscpp
 
       for(requestHandlerInfoListIter itr = requestHandlerList->begin(); itr != requestHandlerList->end(); ++itr) {
         BoostPtree handlerDetails;
+        double     calls;
+        double     cpu_seconds;
+
+        requestRouter.getHandlerUsage(itr->first, calls, cpu_seconds);
 
         handlerDetails.put("id"         ,itr->first);
         handlerDetails.put("description",itr->second);
+        handlerDetails.put("calls"      ,calls);
+        handlerDetails.put("cpu-seconds",cpu_seconds);
         response.add_child("handler"    ,handlerDetails); 
       }
     } catch (boost::property_tree::ptree_bad_path &e) {
@@ -192,51 +294,248 @@ namespace kisscpp
     }
   }
 
+  //--------------------------------------------------------------------------------
+  // Oldest first, so a stuck request is at the top.
+  void InFlightReporter::run(const BoostPtree &request, BoostPtree &response)
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    try {
+      InFlightList                    requests;
+      std::multimap<uint64_t, size_t> by_age;
+      uint64_t                        now = LatencyHistogram::now();
+
+      requestRouter.listInFlight(requests);
+
+      for(size_t i = 0; i < requests.size(); ++i) {
+        by_age.insert(std::make_pair(requests[i].started, i));
+      }
+
+      response.put("kcm-sts", RQST_SUCCESS);
+      response.put("count"  , requests.size());
+
+      for(std::multimap<uint64_t, size_t>::iterator itr = by_age.begin(); itr != by_age.end(); ++itr) {
+        const InFlightInfo &info = requests[itr->second];
+        BoostPtree          requestDetails;
+
+        requestDetails.put("command"   , info.command);
+        requestDetails.put("client"    , info.client);
+        requestDetails.put("thread"    , info.thread);
+        requestDetails.put("running-ms", (now > info.started) ? (now - info.started) / 1000 : 0);
+        response.add_child("request"   , requestDetails);
+      }
+    } catch (std::exception& e) {
+
+      log << "Exception: " << e.what() << manip::endl;
+      response.put("kcm-sts", RQST_UNKNOWN);
+      response.put("kcm-erm", e.what());
+    }
+  }
+
   //--------------------------------------------------------------------------------
   void LogLevelAdjuster::run(const BoostPtree &request, BoostPtree &response)
   {
     LogStream log(__PRETTY_FUNCTION__);
 
     try {
-//      bool        validLogType     = false;
-//      bool        validLogSeverity = false;
-      std::string newLogType       = request.get<std::string>("type");
-      std::string newLogSeverity   = request.get<std::string>("severity");
+      boost::optional<std::string> newLogType     = request.get_optional<std::string>("type");
+      boost::optional<std::string> newLogSeverity = request.get_optional<std::string>("severity");
+      boost::optional<uint32_t>    newRateLimit   = request.get_optional<uint32_t>   ("rate-limit");
+      boost::optional<double>      newSample      = request.get_optional<double>     ("sample");
+      boost::optional<std::string> overrideSource = request.get_optional<std::string>("source");
+      boost::optional<std::string> overrideEntity = request.get_optional<std::string>("entity");
+      bool                         clearOverride  = request.get<bool>                ("clear", false);
+
+      if(!newLogType && !newLogSeverity && !newRateLimit && !newSample && !overrideSource && !overrideEntity && !clearOverride) {
+        response.put("kcm-sts", RQST_MISSING_PARAMETER);
+        response.put("kcm-erm", "type and severity, rate-limit, sample, source, entity or clear required");
+        return;
+      }
 
-      if(newLogType == "debug" || newLogType == "info" || newLogType == "error") {
+      if(overrideSource && overrideEntity) {
+        response.put("kcm-sts", RQST_INVALID_PARAMETER);
+        response.put("kcm-erm", "an override is for either a source or an entity");
+        return;
+      }
 
-        if(newLogSeverity == "low" || newLogSeverity == "normal" || newLogSeverity == "high") {
+      if((overrideSource && overrideSource->empty()) || (overrideEntity && overrideEntity->empty())) {
+        response.put("kcm-sts", RQST_INVALID_PARAMETER);
+        response.put("kcm-erm", "empty source or entity");
+        return;
+      }
 
-          log.setMessageType(newLogType    ,true);
-          log.setSeverity   (newLogSeverity,true);
+      if(newLogType || newLogSeverity) {
+        if(!newLogType || !newLogSeverity) {
+          response.put("kcm-sts", RQST_MISSING_PARAMETER);
+          response.put("kcm-erm", "type and severity are set together");
+          return;
+        }
 
-          response.put("kcm-sts"               , RQST_SUCCESS);
-          response.put("new-log-level.type"    , newLogType);
-          response.put("new-log-level.severity", newLogSeverity);
+        if(*newLogType != "debug" && *newLogType != "info" && *newLogType != "error") {
+          response.put("kcm-sts", RQST_INVALID_PARAMETER);
+          response.put("kcm-erm", "invalid log type");
+          return;
+        }
 
-        } else {
+        if(*newLogSeverity != "low" && *newLogSeverity != "normal" && *newLogSeverity != "high") {
           response.put("kcm-sts", RQST_INVALID_PARAMETER);
           response.put("kcm-erm", "invalid log severity");
+          return;
         }
+      } else if((overrideSource || overrideEntity) && !clearOverride) {
+        response.put("kcm-sts", RQST_MISSING_PARAMETER);
+        response.put("kcm-erm", "type and severity required for an override");
+        return;
+      }
+
+      if(newSample && (*newSample < 0.0 || *newSample > 1.0)) {
+        response.put("kcm-sts", RQST_INVALID_PARAMETER);
+        response.put("kcm-erm", "invalid sample, it is a fraction from 0 to 1");
+        return;
+      }
+
+      log_override_kind kind = (overrideEntity) ? LOK_ENTITY : LOK_SOURCE;
+      std::string       key  = (overrideEntity) ? *overrideEntity : (overrideSource) ? *overrideSource : "";
+
+      if(clearOverride) {
+        if(key.empty()) {
+          LogLevelOverrides::clear();
+        } else {
+          LogLevelOverrides::remove(kind, key);
+        }
+      }
+
+      if(newLogType && !key.empty()) {
+        LogLevelOverrides::set(kind, key, logLevelByName(*newLogType, *newLogSeverity));
+      } else if(newLogType) {
+        log.setMessageType(*newLogType    ,true);
+        log.setSeverity   (*newLogSeverity,true);
+
+        response.put("new-log-level.type"    , *newLogType);
+        response.put("new-log-level.severity", *newLogSeverity);
+      }
+
+      if(newRateLimit) { LogLimiter::setRateLimit(*newRateLimit); }
+      if(newSample   ) { LogLimiter::setSample   (*newSample);    }
+
+      response.put("kcm-sts"                 , RQST_SUCCESS);
+      response.put("new-log-level.rate-limit", LogLimiter::getRateLimit());
+      response.put("new-log-level.sample"    , LogLimiter::getSample());
+
+      std::vector<LogLevelOverride> overrides = LogLevelOverrides::list();
+      BoostPtree                    overrideList;
+
+      for(std::vector<LogLevelOverride>::const_iterator it = overrides.begin(); it != overrides.end(); ++it) {
+        BoostPtree entry;
+
+        entry.put((it->kind == LOK_ENTITY) ? "entity" : "source", it->key);
+        entry.put("type"    , LOG_TYPE_NAMES    [(it->level - 1) / 3]);
+        entry.put("severity", LOG_SEVERITY_NAMES[(it->level - 1) % 3]);
+
+        overrideList.push_back(std::make_pair("", entry));
+      }
+
+      response.add_child("new-log-level.overrides", overrideList);
+
+    } catch (boost::property_tree::ptree_bad_data &e) {
+
+      log << "Exception: " << e.what() << manip::endl;
+      response.put("kcm-sts", RQST_INVALID_PARAMETER);
+      response.put("kcm-erm", e.what());
+
+    } catch (std::exception& e) {
 
+      log << "Exception: " << e.what() << manip::endl;
+      response.put("kcm-sts", RQST_UNKNOWN);                    
+      response.put("kcm-erm", e.what());
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void ConfigReloader::run(const BoostPtree &request, BoostPtree &response)
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    try {
+      Config::instance()->reload();
+
+      response.put("kcm-sts"          , RQST_SUCCESS);
+      response.put("config-generation", Config::instance()->snapshot()->getGeneration());
+
+    } catch (std::exception& e) {
+
+      log << manip::error_high << "Exception: " << e.what() << manip::endl;
+      response.put("kcm-sts", RQST_PROCESSING_FAILURE);
+      response.put("kcm-erm", std::string("Configuration not reloaded: ") + e.what());
+    }
+  }
 
+  //--------------------------------------------------------------------------------
+  // "action":"start" starts a profile, and returns at once, so the profile is not
+  // of this handler waiting. "action":"result" returns it, once it is done.
+  void ProfileReporter::run(const BoostPtree &request, BoostPtree &response)
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    try {
+      std::string action = request.get<std::string>("action", "result");
+
+      if(action == "start") {
+        unsigned int seconds   = request.get<unsigned int>("seconds"  , 10);
+        unsigned int frequency = request.get<unsigned int>("frequency", 99);
+
+        if(seconds < 1 || seconds > PROFILE_MAX_SECONDS || frequency < 1 || frequency > PROFILE_MAX_FREQUENCY) {
+          response.put("kcm-sts", RQST_INVALID_PARAMETER);
+          response.put("kcm-erm", "seconds has to be 1 to " + boost::lexical_cast<std::string>(PROFILE_MAX_SECONDS) +
+                                  ", and frequency 1 to "   + boost::lexical_cast<std::string>(PROFILE_MAX_FREQUENCY));
+        } else if(!Profiler::start(seconds, frequency)) {
+          if(errno == EBUSY) {
+            response.put("kcm-sts", RQST_APPLICATION_BUSY);
+            response.put("kcm-erm", "A profile is already running.");
+          } else {
+            response.put("kcm-sts", RQST_PROCESSING_FAILURE);
+            response.put("kcm-erm", std::string("The profiling timer could not be set: ") + std::strerror(errno));
+          }
+        } else {
+          log << manip::info_normal << "Profiling for " << seconds << "s at " << frequency << "Hz." << manip::endl;
+
+          response.put("kcm-sts"  , RQST_SUCCESS);
+          response.put("seconds"  , seconds);
+          response.put("frequency", frequency);
+        }
+      } else if(action == "result") {
+        std::string  folded;
+        unsigned int samples = 0;
+        unsigned int dropped = 0;
+
+        if(Profiler::running()) {
+          response.put("kcm-sts", RQST_APPLICATION_BUSY);
+          response.put("kcm-erm", "The profile is still running.");
+        } else if(!Profiler::result(folded, samples, dropped)) {
+          response.put("kcm-sts", RQST_PROCESSING_FAILURE);
+          response.put("kcm-erm", "No profile has been started.");
+        } else {
+          response.put("kcm-sts", RQST_SUCCESS);
+          response.put("samples", samples);
+          response.put("dropped", dropped);
+          response.put("folded" , folded);
+        }
       } else {
         response.put("kcm-sts", RQST_INVALID_PARAMETER);
-        response.put("kcm-erm", "invalid log type");
+        response.put("kcm-erm", "action has to be start or result.");
       }
 
-    } catch (boost::property_tree::ptree_bad_path &e) {
+    } catch (boost::property_tree::ptree_bad_data &e) {
 
       log << "Exception: " << e.what() << manip::endl;
-      response.put("kcm-sts", RQST_MISSING_PARAMETER);
+      response.put("kcm-sts", RQST_INVALID_PARAMETER);
       response.put("kcm-erm", e.what());
 
     } catch (std::exception& e) {
 
       log << "Exception: " << e.what() << manip::endl;
-      response.put("kcm-sts", RQST_UNKNOWN);                    
+      response.put("kcm-sts", RQST_UNKNOWN);
       response.put("kcm-erm", e.what());
     }
   }
 }
-
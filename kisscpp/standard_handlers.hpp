@@ -14,6 +14,9 @@
 #include "request_status.hpp"
 #include "statskeeper.hpp"
 #include "errorstate.hpp"
+#include "openmetrics.hpp"
+#include "configuration.hpp"
+#include "profiler.hpp"
 
 namespace kisscpp
 {
@@ -32,9 +35,27 @@ namespace kisscpp
       void run(const BoostPtree &request, BoostPtree &response);
     protected:
     private:
-      void gathered(BoostPtree &response);
-      void full    (BoostPtree &response);
+      void gathered(BoostPtree &response, unsigned long int rollup);
+      void full    (BoostPtree &response, unsigned long int rollup);
       void current (BoostPtree &response);
+      void cluster (BoostPtree &response);
+  };
+
+  //--------------------------------------------------------------------------------
+  class MetricsReporter : public RequestHandler
+  {
+    public:
+      MetricsReporter() :
+        RequestHandler("kch-metrics", "retrieves the application statistics and error states in OpenMetrics text format")
+      {
+        LogStream log(__PRETTY_FUNCTION__);
+      }
+
+      ~MetricsReporter() {};
+
+      void run(const BoostPtree &request, BoostPtree &response);
+    protected:
+    private:
   };
 
   //--------------------------------------------------------------------------------
@@ -90,12 +111,31 @@ namespace kisscpp
       RequestRouter &requestRouter;
   };
 
+  //--------------------------------------------------------------------------------
+  class InFlightReporter : public RequestHandler
+  {
+    public:
+      explicit InFlightReporter(RequestRouter &rr) :
+        RequestHandler("kch-inflight", "shows the requests being handled right now"),
+        requestRouter(rr)
+      {
+        LogStream log(__PRETTY_FUNCTION__);
+      }
+
+      ~InFlightReporter() {};
+
+      void run(const BoostPtree &request, BoostPtree &response);
+    protected:
+    private:
+      RequestRouter &requestRouter;
+  };
+
   //--------------------------------------------------------------------------------
   class LogLevelAdjuster : public RequestHandler
   {
     public:
       LogLevelAdjuster() :
-        RequestHandler("kch-loglevel", "Adjust the log level to specified levels")
+        RequestHandler("kch-loglevel", "Adjust the log level, rate limit and sampling")
       {
         LogStream log(__PRETTY_FUNCTION__);
       }
@@ -106,6 +146,40 @@ namespace kisscpp
     protected:
     private:
   };
+
+  //--------------------------------------------------------------------------------
+  class ConfigReloader : public RequestHandler
+  {
+    public:
+      ConfigReloader() :
+        RequestHandler("kch-reload", "Reloads the application configuration")
+      {
+        LogStream log(__PRETTY_FUNCTION__);
+      }
+
+      ~ConfigReloader() {};
+
+      void run(const BoostPtree &request, BoostPtree &response);
+    protected:
+    private:
+  };
+
+  //--------------------------------------------------------------------------------
+  class ProfileReporter : public RequestHandler
+  {
+    public:
+      ProfileReporter() :
+        RequestHandler("kch-profile", "samples where the application spends CPU time")
+      {
+        LogStream log(__PRETTY_FUNCTION__);
+      }
+
+      ~ProfileReporter() {};
+
+      void run(const BoostPtree &request, BoostPtree &response);
+    protected:
+    private:
+  };
 }
 
 #endif // _STANDARD_HANDLERS_HPP_
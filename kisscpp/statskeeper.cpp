@@ -17,11 +17,123 @@
 // along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
 
 #include "statskeeper.hpp"
+#include "openmetrics.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <set>
+#include <sstream>
 
 namespace kisscpp
 {
   StatsKeeper                          * StatsKeeper::singleton_instance;
 
+  namespace
+  {
+    //--------------------------------------------------------------------------------
+    void putSummary(StatsMapType &stats, const std::string &id, const LatencySummary &summary)
+    {
+      stats[id + ".count"] = summary.count;
+      stats[id + ".p50"  ] = summary.p50;
+      stats[id + ".p90"  ] = summary.p90;
+      stats[id + ".p99"  ] = summary.p99;
+      stats[id + ".p999" ] = summary.p999;
+      stats[id + ".max"  ] = summary.max;
+    }
+
+    //--------------------------------------------------------------------------------
+    // Histograms' totals are keyed by their unit, "seconds:" or "bytes:".
+    bool isHistogramTotal(const std::string &key)
+    {
+      return key.compare(0, 8, "seconds:") == 0 || key.compare(0, 6, "bytes:") == 0;
+    }
+
+    //--------------------------------------------------------------------------------
+    bool endsWith(const std::string &key, const char *suffix)
+    {
+      std::size_t length = std::strlen(suffix);
+
+      return key.size() >= length && key.compare(key.size() - length, length, suffix) == 0;
+    }
+
+    //--------------------------------------------------------------------------------
+    double totalOf(const StatsMapType &totals, const std::string &key)
+    {
+      StatsMapTypeConstIterator itr = totals.find(key);
+
+      return (itr != totals.end()) ? itr->second : 0;
+    }
+
+    //--------------------------------------------------------------------------------
+    void pushHistory(GatheredStatsMapType &history, const std::string &id, double value, std::size_t history_length)
+    {
+      GatheredStatsMapTypeIterator itr = history.find(id);
+
+      if(itr == history.end()) {
+        itr = history.insert(std::make_pair(id, StatsRing(history_length))).first;
+      }
+
+      (itr->second).push(value);
+    }
+
+    //--------------------------------------------------------------------------------
+    void addTo(boost::atomic<double> &stat, double value)
+    {
+      double current = stat.load(boost::memory_order_relaxed);
+
+      while(!stat.compare_exchange_weak(current, current + value, boost::memory_order_relaxed)) {
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    void pushHistory(GatheredStatsMapType &history, const StatsMapType &stats, std::size_t history_length)
+    {
+      for(StatsMapTypeConstIterator itr = stats.begin(); itr != stats.end(); ++itr) {
+        pushHistory(history, itr->first, itr->second, history_length);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void StatsRollup::add(const StatsMapType         &gathered_counters,
+                        const StatsMapType         &gathered_gauges,
+                        const LatencyCountsMapType &gathered_latency,
+                        std::size_t                 history_length)
+  {
+    for(StatsMapTypeConstIterator itr = gathered_counters.begin(); itr != gathered_counters.end(); ++itr) {
+      counters[itr->first] += itr->second;
+    }
+
+    for(StatsMapTypeConstIterator itr = gathered_gauges.begin(); itr != gathered_gauges.end(); ++itr) {
+      gauges[itr->first] = itr->second;
+    }
+
+    for(LatencyCountsMapTypeConstIterator itr = gathered_latency.begin(); itr != gathered_latency.end(); ++itr) {
+      latency[itr->first].add(itr->second);
+    }
+
+    if(++pending < factor) {
+      return;
+    }
+
+    StatsMapType summaries;
+
+    for(LatencyCountsMapTypeConstIterator itr = latency.begin(); itr != latency.end(); ++itr) {
+      LatencySummary summary;
+      (itr->second).summarize(summary);
+      putSummary(summaries, itr->first, summary);
+    }
+
+    pushHistory(history, counters , history_length);
+    pushHistory(history, gauges   , history_length);
+    pushHistory(history, summaries, history_length);
+
+    counters.clear();
+    gauges.clear();
+    latency.clear();
+    pending = 0;
+  }
+
   //--------------------------------------------------------------------------------
   StatsKeeper* StatsKeeper::instance(unsigned long int gp /* = 300 */,
                                      unsigned long int hl /* = 10 */)
@@ -36,9 +148,12 @@ namespace kisscpp
   //--------------------------------------------------------------------------------
   void StatsKeeper::start()
   {
+    boost::lock_guard<boost::mutex> guard(statMutex);
+
     if(!running) {
-      startTime = time(NULL);
-      running   = true;
+      startTime  = time(NULL);
+      nextGather = boost::get_system_time() + boost::posix_time::milliseconds(gatherPeriod);
+      running    = true;
       threadGroup.create_thread(boost::bind(&StatsKeeper::gatherStats, this));
     }
   }
@@ -46,45 +161,277 @@ namespace kisscpp
   //--------------------------------------------------------------------------------
   void StatsKeeper::stop()
   {
-    running = false;
+    {
+      boost::lock_guard<boost::mutex> guard(statMutex);
+      running = false;
+    }
+
+    gatherCondition.notify_all();
     threadGroup.join_all();
   }
 
   //--------------------------------------------------------------------------------
-  void StatsKeeper::setStatValue(std::string id, double value /* = 0*/)
+  void StatsKeeper::configure(unsigned long int                     gather_period,
+                              unsigned long int                     history_length,
+                              const std::vector<unsigned long int> &rollup_periods)
   {
     boost::lock_guard<boost::mutex> guard(statMutex);
-    statsMap[id] = value;
+    std::vector<unsigned long int>  periods(rollup_periods);
+
+    gatherPeriod  = (gather_period > 0) ? gather_period : 1;
+    historyLength = history_length;
+    nextGather    = boost::get_system_time() + boost::posix_time::milliseconds(gatherPeriod);
+
+    rollups.clear();
+    rollups.push_back(StatsRollup(gatherPeriod, 1));
+
+    std::sort(periods.begin(), periods.end());
+
+    for(std::size_t i = 0; i < periods.size(); ++i) {
+      unsigned long int factor = (periods[i] + gatherPeriod / 2) / gatherPeriod;
+
+      if(factor > rollups.back().factor) {
+        rollups.push_back(StatsRollup(factor * gatherPeriod, factor));
+      }
+    }
+
+    gatherCondition.notify_all();
   }
 
   //--------------------------------------------------------------------------------
-  void StatsKeeper::increment(std::string id, double value /* = 1 */)
+  StatHandle StatsKeeper::registerStat(const std::string &id, StatType type /* = ST_COUNTER */)
   {
     boost::lock_guard<boost::mutex> guard(statMutex);
-    if(statsMap.find(id) != statsMap.end()) {
-      statsMap[id] += value;
+    StatHandleMapType::iterator     itr = statHandles.find(id);
+
+    if(itr != statHandles.end()) {
+      StatHandle h = itr->second;
+
+      if(type == ST_GAUGE && !statGauges[h].load(boost::memory_order_relaxed)) {
+        statGauges[h].store(true, boost::memory_order_relaxed);
+        addTo(gaugeValues[h], takeStat(h));             // What it counted so far is its level.
+      }
+
+      return h;
+    }
+
+    StatHandle h = statCount.load(boost::memory_order_relaxed);
+
+    if(h >= STATS_MAX_HANDLES) {
+      throw std::runtime_error("Too many stats registered: " + id);
+    }
+
+    for(unsigned int i = 0; i < STATS_SHARDS; ++i) {
+      shards[i].value[h].store(0, boost::memory_order_relaxed);
+    }
+
+    statNames  [h]  = id;
+    statTotals [h]  = 0;
+    gaugeValues[h].store(0, boost::memory_order_relaxed);
+    statGauges [h].store(type == ST_GAUGE, boost::memory_order_relaxed);
+    statHandles[id] = h;
+    statCount.store(h + 1, boost::memory_order_release);
+
+    return h;
+  }
+
+  //--------------------------------------------------------------------------------
+  // A counter's current period is taken out of the shards, and replaced by value;
+  // what is counted meanwhile still adds to it.
+  void StatsKeeper::setStatValue(StatHandle h, double value /* = 0*/)
+  {
+    if(statGauges[h].load(boost::memory_order_relaxed)) {
+      gaugeValues[h].store(value, boost::memory_order_relaxed);
     } else {
-      statsMap[id]  = value;
+      takeStat(h);
+      addTo(shard().value[h], value);
     }
   }
 
   //--------------------------------------------------------------------------------
-  void StatsKeeper::decrement(std::string id, double value /* = 1 */)
+  void StatsKeeper::increment(StatHandle h, double value /* = 1 */)
   {
-    boost::lock_guard<boost::mutex> guard(statMutex);
-    if(statsMap.find(id) != statsMap.end()) {
-      statsMap[id] -= value;
+    if(statGauges[h].load(boost::memory_order_relaxed)) {
+      addTo(gaugeValues[h], value);
     } else {
-      statsMap[id]  = 0 - value;
+      addTo(shard().value[h], value);
     }
   }
 
+  //--------------------------------------------------------------------------------
+  void StatsKeeper::decrement(StatHandle h, double value /* = 1 */)
+  {
+    increment(h, 0 - value);
+  }
+
+  //--------------------------------------------------------------------------------
+  double StatsKeeper::readStat(StatHandle h)
+  {
+    double sum = 0;
+
+    if(statGauges[h].load(boost::memory_order_relaxed)) {
+      return gaugeValues[h].load(boost::memory_order_relaxed);
+    }
+
+    for(unsigned int i = 0; i < STATS_SHARDS; ++i) {
+      sum += shards[i].value[h].load(boost::memory_order_relaxed);
+    }
+
+    return sum;
+  }
+
+  //--------------------------------------------------------------------------------
+  double StatsKeeper::readTotal(StatHandle h)
+  {
+    boost::lock_guard<boost::mutex> guard(statMutex);
+
+    if(statGauges[h].load(boost::memory_order_relaxed)) {
+      return readStat(h);
+    }
+
+    return statTotals[h] + readStat(h);
+  }
+
+  //--------------------------------------------------------------------------------
+  double StatsKeeper::takeStat(StatHandle h)
+  {
+    double sum = 0;
+
+    for(unsigned int i = 0; i < STATS_SHARDS; ++i) {
+      sum += shards[i].value[h].exchange(0, boost::memory_order_relaxed);
+    }
+
+    return sum;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Threads are handed out shards in turn, the first time they update a stat.
+  StatShard& StatsKeeper::shard()
+  {
+    static boost::atomic<unsigned int> nextShard(0);
+    static __thread int                threadShard = -1;
+
+    if(threadShard < 0) {
+      threadShard = nextShard.fetch_add(1, boost::memory_order_relaxed) % STATS_SHARDS;
+    }
+
+    return shards[threadShard];
+  }
+
   //--------------------------------------------------------------------------------
   void StatsKeeper::addStatableQueue(std::string id, sharedStatAbleQ ssq)
   {
+    boost::lock_guard<boost::mutex> guard(statMutex);
     queueStatsMap[id] = ssq;
   }
 
+  //--------------------------------------------------------------------------------
+  LatencyHistogram* StatsKeeper::registerHistogram(const std::string &id, HistogramUnit unit /* = HU_MICROSECONDS */)
+  {
+    boost::lock_guard<boost::mutex> guard(statMutex);
+    SharedLatencyHistogram         &histogram = histogramMap[id];
+
+    if(!histogram) {
+      histogram.reset(new LatencyHistogram());
+
+      if(unit != HU_MICROSECONDS) {
+        histogramUnits[id] = unit;
+      }
+    }
+
+    return histogram.get();
+  }
+
+  //--------------------------------------------------------------------------------
+  // Counters are reported as totals since start up, and histograms as summaries
+  // in seconds or bytes, as scrapers expect.
+  void StatsKeeper::writeOpenMetrics(std::string &out)
+  {
+    boost::lock_guard<boost::mutex> guard(statMutex);
+
+    OpenMetrics::family(out, "kcs_uptime_seconds", "gauge");
+    OpenMetrics::sample(out, "kcs_uptime_seconds", time(NULL) - startTime);
+
+    for(StatHandle h = 0; h < statCount.load(boost::memory_order_acquire); ++h) {
+      std::string name = OpenMetrics::name(statNames[h]);
+
+      if(statGauges[h].load(boost::memory_order_relaxed)) {
+        OpenMetrics::family(out, name, "gauge");
+        OpenMetrics::sample(out, name, readStat(h));
+      } else {
+        OpenMetrics::family(out, name, "counter");
+        OpenMetrics::sample(out, name + "_total", statTotals[h] + readStat(h));
+      }
+    }
+
+    for(QueueStatsMapTypeIterator itr = queueStatsMap.begin(); itr != queueStatsMap.end(); ++itr) {
+      std::string name = OpenMetrics::name(itr->first);
+
+      OpenMetrics::family(out, name, "gauge");
+      OpenMetrics::sample(out, name, (itr->second)->size());
+    }
+
+    for(HistogramMapTypeIterator itr = histogramMap.begin(); itr != histogramMap.end(); ++itr) {
+      bool           bytes = (histogramUnits.count(itr->first) > 0);
+      const char    *unit  = bytes ? "bytes" : "seconds";
+      double         scale = bytes ? 1 : 1e6;
+      std::string    name  = OpenMetrics::name(itr->first) + "_" + unit;
+      LatencySummary summary;
+
+      (itr->second)->snapshot(summary);
+
+      OpenMetrics::family(out, name, "summary", unit);
+      OpenMetrics::sample(out, name, summary.p50  / scale, "quantile=\"0.5\"");
+      OpenMetrics::sample(out, name, summary.p90  / scale, "quantile=\"0.9\"");
+      OpenMetrics::sample(out, name, summary.p99  / scale, "quantile=\"0.99\"");
+      OpenMetrics::sample(out, name, summary.p999 / scale, "quantile=\"0.999\"");
+      OpenMetrics::sample(out, name + "_count", summary.total_count);
+      OpenMetrics::sample(out, name + "_sum"  , summary.total_sum / scale);
+
+      OpenMetrics::family(out, name + "_max", "gauge");
+      OpenMetrics::sample(out, name + "_max", summary.max / scale);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // Summaries of totals have no quantiles: percentiles can not be added up.
+  void StatsKeeper::writeOpenMetrics(std::string &out, const StatsMapType &totals)
+  {
+    std::set<std::string> histograms;
+
+    for(StatsMapTypeConstIterator itr = totals.begin(); itr != totals.end(); ++itr) {
+      std::string::size_type separator = itr->first.find(':');
+      std::string            id        = itr->first.substr(separator + 1);
+
+      if(isHistogramTotal(itr->first)) {
+        histograms.insert(itr->first.substr(0, itr->first.rfind('.'))); // Its samples are written together, below.
+      } else if(id == "kcs-uptime") {
+        OpenMetrics::family(out, "kcs_uptime_seconds", "gauge");
+        OpenMetrics::sample(out, "kcs_uptime_seconds", itr->second);
+      } else if(itr->first.compare(0, separator, "counter") == 0) {
+        OpenMetrics::family(out, OpenMetrics::name(id), "counter");
+        OpenMetrics::sample(out, OpenMetrics::name(id) + "_total", itr->second);
+      } else {
+        OpenMetrics::family(out, OpenMetrics::name(id), "gauge");
+        OpenMetrics::sample(out, OpenMetrics::name(id), itr->second);
+      }
+    }
+
+    for(std::set<std::string>::const_iterator itr = histograms.begin(); itr != histograms.end(); ++itr) {
+      bool        bytes = (itr->compare(0, 6, "bytes:") == 0);
+      const char *unit  = bytes ? "bytes" : "seconds";
+      double      scale = bytes ? 1 : 1e6;
+      std::string name  = OpenMetrics::name(itr->substr(itr->find(':') + 1)) + "_" + unit;
+
+      OpenMetrics::family(out, name, "summary", unit);
+      OpenMetrics::sample(out, name + "_count", totalOf(totals, *itr + ".count"));
+      OpenMetrics::sample(out, name + "_sum"  , totalOf(totals, *itr + ".sum") / scale);
+
+      OpenMetrics::family(out, name + "_max", "gauge");
+      OpenMetrics::sample(out, name + "_max", totalOf(totals, *itr + ".max") / scale);
+    }
+  }
+
   //--------------------------------------------------------------------------------
   SharedStatsMapType StatsKeeper::getCurrentStats()
   {
@@ -93,11 +440,11 @@ namespace kisscpp
 
     retval.reset(new StatsMapType());
 
-    statsMap["kcs-uptime"] = time(NULL) - startTime;
+    (*retval)["stats.kcs-uptime"] = time(NULL) - startTime;
 
-    for(StatsMapTypeIterator         itr = statsMap.begin()        ; itr != statsMap.end()        ; ++itr) {
+    for(StatHandle h = 0; h < statCount.load(boost::memory_order_acquire); ++h) {
       std::string tpath = "stats.";
-      (*retval)[tpath + itr->first] = itr->second;
+      (*retval)[tpath + statNames[h]] = readStat(h);
     }
 
     for(QueueStatsMapTypeIterator    itr = queueStatsMap.begin()   ; itr != queueStatsMap.end()   ; ++itr) {
@@ -105,35 +452,105 @@ namespace kisscpp
       (*retval)[tpath + itr->first] = (itr->second)->size();
     }
 
+    for(HistogramMapTypeIterator     itr = histogramMap.begin()    ; itr != histogramMap.end()    ; ++itr) {
+      LatencySummary summary;
+      (itr->second)->snapshot(summary);
+      putSummary(*retval, "stats." + itr->first, summary);
+    }
+
     return retval;
   }
 
   //--------------------------------------------------------------------------------
-  SharedStatsMapType StatsKeeper::getLastGatheredStats()
+  SharedStatsMapType StatsKeeper::getTotals()
   {
     boost::lock_guard<boost::mutex> guard(statMutex);
-    SharedStatsMapType                      retval;
+    SharedStatsMapType              retval;
 
     retval.reset(new StatsMapType());
 
-    for(GatheredStatsMapTypeIterator itr = gatheredStatsMap.begin(); itr != gatheredStatsMap.end(); ++itr) {
-      std::string tpath = "stats.";
-      (*retval)[tpath + itr->first] = (itr->second)[0];
+    (*retval)["gauge:kcs-uptime"] = time(NULL) - startTime;
+
+    for(StatHandle h = 0; h < statCount.load(boost::memory_order_acquire); ++h) {
+      if(statGauges[h].load(boost::memory_order_relaxed)) {
+        (*retval)["gauge:"   + statNames[h]] = readStat(h);
+      } else {
+        (*retval)["counter:" + statNames[h]] = statTotals[h] + readStat(h);
+      }
+    }
+
+    for(QueueStatsMapTypeIterator itr = queueStatsMap.begin(); itr != queueStatsMap.end(); ++itr) {
+      (*retval)["gauge:" + itr->first] = (itr->second)->size();
+    }
+
+    for(HistogramMapTypeIterator itr = histogramMap.begin(); itr != histogramMap.end(); ++itr) {
+      std::string    key = ((histogramUnits.count(itr->first) > 0) ? "bytes:" : "seconds:") + itr->first;
+      LatencySummary summary;
+
+      (itr->second)->snapshot(summary);
+
+      (*retval)[key + ".count"] = summary.total_count;
+      (*retval)[key + ".sum"  ] = summary.total_sum;   // In microseconds, like the rest.
+      (*retval)[key + ".max"  ] = summary.max;
     }
 
     return retval;
   }
 
   //--------------------------------------------------------------------------------
-  SharedStatsHistoryMapType StatsKeeper::getFullStatsHistory()
+  void StatsKeeper::addTotals(StatsMapType &sum, const StatsMapType &totals)
+  {
+    for(StatsMapTypeConstIterator itr = totals.begin(); itr != totals.end(); ++itr) {
+      if(itr->first == "gauge:kcs-uptime" || (isHistogramTotal(itr->first) && endsWith(itr->first, ".max"))) {
+        sum[itr->first] = std::max(sum[itr->first], itr->second);
+      } else {
+        sum[itr->first] += itr->second;
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void StatsKeeper::totalsToStats(const StatsMapType &totals, StatsMapType &stats)
+  {
+    for(StatsMapTypeConstIterator itr = totals.begin(); itr != totals.end(); ++itr) {
+      if(isHistogramTotal(itr->first) && endsWith(itr->first, ".sum")) {
+        continue;
+      }
+
+      stats["stats." + itr->first.substr(itr->first.find(':') + 1)] = itr->second;
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  SharedStatsMapType StatsKeeper::getLastGatheredStats(unsigned long int rollup /* = 0 */)
   {
     boost::lock_guard<boost::mutex> guard(statMutex);
+    GatheredStatsMapType           &history = rollupOf(rollup).history;
+    SharedStatsMapType              retval;
+
+    retval.reset(new StatsMapType());
+
+    for(GatheredStatsMapTypeIterator itr = history.begin(); itr != history.end(); ++itr) {
+      if((itr->second).size() > 0) {
+        std::string tpath = "stats.";
+        (*retval)[tpath + itr->first] = (itr->second)[0];
+      }
+    }
+
+    return retval;
+  }
+
+  //--------------------------------------------------------------------------------
+  SharedStatsHistoryMapType StatsKeeper::getFullStatsHistory(unsigned long int rollup /* = 0 */)
+  {
+    boost::lock_guard<boost::mutex> guard(statMutex);
+    GatheredStatsMapType           &history = rollupOf(rollup).history;
     SharedStatsHistoryMapType       retval;
 
     retval.reset(new StatsHistoryMapType());
 
-    for(GatheredStatsMapTypeIterator itr = gatheredStatsMap.begin(); itr != gatheredStatsMap.end(); ++itr) {
-      for(unsigned int i = 0; i < historyLength; ++i) {
+    for(GatheredStatsMapTypeIterator itr = history.begin(); itr != history.end(); ++itr) {
+      for(unsigned int i = 0; i < (itr->second).size(); ++i) {
         std::stringstream tmppath;
         tmppath << "stats." << itr->first << "." << std::setfill('0') << std::setw(2) << i;
         (*retval)[tmppath.str()].push_back((itr->second)[i]);
@@ -143,35 +560,93 @@ namespace kisscpp
   }
 
   //--------------------------------------------------------------------------------
+  StatsRollup& StatsKeeper::rollupOf(unsigned long int period)
+  {
+    if(period == 0) {
+      return rollups[0];
+    }
+
+    for(std::size_t i = 0; i < rollups.size(); ++i) {
+      if(rollups[i].period == period) {
+        return rollups[i];
+      }
+    }
+
+    throw std::invalid_argument("Stats are not rolled up over that period.");
+  }
+
+  //--------------------------------------------------------------------------------
+  void StatsKeeper::setClusterStats(SharedStatsMapType ssmt)
+  {
+    boost::lock_guard<boost::mutex> guard(statMutex);
+    clusterStatsMap = *ssmt;
+  }
+
+  //--------------------------------------------------------------------------------
+  SharedStatsMapType StatsKeeper::getClusterStats()
+  {
+    boost::lock_guard<boost::mutex> guard(statMutex);
+    SharedStatsMapType              retval;
+
+    retval.reset(new StatsMapType(clusterStatsMap));
+
+    return retval;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Sleeps on gatherCondition, so stop() and configure() take effect right away.
+  // Gatherings keep to their schedule; those missed are skipped, not caught up.
   void StatsKeeper::gatherStats()
   {
+    boost::unique_lock<boost::mutex> lock(statMutex);
+
     while(running) {
-      int sleepCount = 0;
+      boost::system_time now = boost::get_system_time();
 
-      while(running && sleepCount < gatherPeriod) {
-        usleep(1000000); // 1 second
-        sleepCount++;
+      if(now < nextGather) {
+        gatherCondition.timed_wait(lock, nextGather);
+        continue;
       }
 
-      if(running) {
+      gather();
 
-        statsMap["kcs-uptime"] = time(NULL) - startTime;
+      nextGather += boost::posix_time::milliseconds(gatherPeriod);
 
-        for(StatsMapTypeIterator itr = statsMap.begin(); itr != statsMap.end(); ++itr) {
-          gatheredStatsMap[itr->first].push_front(itr->second);
-          itr->second = 0;
-        }
+      if(nextGather <= now) {
+        nextGather = now + boost::posix_time::milliseconds(gatherPeriod);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void StatsKeeper::gather()
+  {
+    StatsMapType         counters;
+    StatsMapType         gauges;
+    LatencyCountsMapType latency;
 
-        for(QueueStatsMapTypeIterator itr = queueStatsMap.begin(); itr != queueStatsMap.end(); ++itr) {
-          gatheredStatsMap[itr->first].push_front((itr->second)->size());
-        }
+    gauges["kcs-uptime"] = time(NULL) - startTime;
 
-        for(GatheredStatsMapTypeIterator itr = gatheredStatsMap.begin(); itr != gatheredStatsMap.end(); ++itr) {
-          if(gatheredStatsMap[itr->first].size() > historyLength) {
-            gatheredStatsMap[itr->first].pop_back();
-          }
-        }
+    for(StatHandle h = 0; h < statCount.load(boost::memory_order_acquire); ++h) {
+      if(statGauges[h].load(boost::memory_order_relaxed)) {
+        gauges[statNames[h]] = readStat(h);
+      } else {
+        double value = takeStat(h);
+        statTotals[h]         += value;
+        counters[statNames[h]] = value;
       }
     }
+
+    for(QueueStatsMapTypeIterator itr = queueStatsMap.begin(); itr != queueStatsMap.end(); ++itr) {
+      gauges[itr->first] = (itr->second)->size();
+    }
+
+    for(HistogramMapTypeIterator itr = histogramMap.begin(); itr != histogramMap.end(); ++itr) {
+      (itr->second)->take(latency[itr->first]);
+    }
+
+    for(std::size_t i = 0; i < rollups.size(); ++i) {
+      rollups[i].add(counters, gauges, latency, historyLength);
+    }
   }
 }
@@ -23,24 +23,59 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <ctime>
+#include <stdexcept>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/atomic.hpp>
 #include "boost_ptree.hpp"
 #include "logstream.hpp"
 #include "statable_queue.hpp"
+#include "latency_histogram.hpp"
 
 namespace kisscpp
 {
-  typedef std::map<std::string, std::deque<double> > GatheredStatsMapType;
+  //--------------------------------------------------------------------------------
+  // The history of one stat: a fixed number of values, the oldest overwritten.
+  class StatsRing
+  {
+    public:
+      explicit StatsRing(std::size_t capacity = 0) : values(capacity), next(0), count(0) {}
+
+      void        push(double value)
+      {
+        if(values.empty()) { return; }
+
+        values[next] = value;
+        next         = (next + 1) % values.size();
+        count        = (count < values.size()) ? count + 1 : count;
+      }
+
+      std::size_t size      ()                const { return count; }
+      double      operator[](std::size_t age) const { return values[(next + values.size() - 1 - age) % values.size()]; } // 0 is the newest.
+
+    private:
+      std::vector<double> values;
+      std::size_t         next;
+      std::size_t         count;
+  };
+
+  typedef std::map<std::string, StatsRing          > GatheredStatsMapType;
   typedef GatheredStatsMapType::iterator             GatheredStatsMapTypeIterator;
 
   typedef std::map<std::string, double             > StatsMapType;
   typedef StatsMapType::iterator                     StatsMapTypeIterator;
+  typedef StatsMapType::const_iterator               StatsMapTypeConstIterator;
   typedef boost::shared_ptr<StatsMapType>            SharedStatsMapType;
 
+  typedef std::map<std::string, LatencyCounts      > LatencyCountsMapType;
+  typedef LatencyCountsMapType::const_iterator       LatencyCountsMapTypeConstIterator;
+
   typedef std::vector<double>                        StatsHistoryType;
   typedef std::map<std::string, StatsHistoryType>    StatsHistoryMapType;
   typedef StatsHistoryMapType::iterator              StatsHistoryMapTypeIterator;
@@ -49,6 +84,62 @@ namespace kisscpp
   typedef std::map<std::string, sharedStatAbleQ    > QueueStatsMapType;
   typedef QueueStatsMapType::iterator                QueueStatsMapTypeIterator;
 
+  typedef unsigned int                               StatHandle;
+  typedef std::map<std::string, StatHandle         > StatHandleMapType;
+
+  typedef boost::shared_ptr<LatencyHistogram>        SharedLatencyHistogram;
+  typedef std::map<std::string, SharedLatencyHistogram> HistogramMapType;
+  typedef HistogramMapType::iterator                 HistogramMapTypeIterator;
+
+  enum HistogramUnit
+  {
+    HU_MICROSECONDS,
+    HU_BYTES
+  };
+
+  typedef std::map<std::string, HistogramUnit      > HistogramUnitMapType;
+
+  enum StatType
+  {
+    ST_COUNTER,
+    ST_GAUGE
+  };
+
+  //--------------------------------------------------------------------------------
+  // Gatherings summed up over a longer period, e.g. a minute, with a history of
+  // its own. Counters are added up, gauges keep their last value, and latency
+  // histograms are merged before their percentiles are taken.
+  struct StatsRollup
+  {
+    StatsRollup(unsigned long int p, unsigned long int f) : period(p), factor(f), pending(0) {}
+
+    void add(const StatsMapType         &gathered_counters,
+             const StatsMapType         &gathered_gauges,
+             const LatencyCountsMapType &gathered_latency,
+             std::size_t                 history_length);
+
+    unsigned long int    period;   // Milliseconds.
+    unsigned long int    factor;   // Gatherings per period.
+    unsigned long int    pending;  // Gatherings added since the period started.
+    StatsMapType         counters;
+    StatsMapType         gauges;
+    LatencyCountsMapType latency;
+    GatheredStatsMapType history;
+  };
+
+  typedef std::vector<StatsRollup>                   StatsRollupList;
+
+  const unsigned int STATS_MAX_HANDLES = 1024;       // Stats a process can register.
+  const unsigned int STATS_SHARDS      = 16;         // Threads are spread over this many copies of every counter.
+
+  //--------------------------------------------------------------------------------
+  // One copy of every counter. A thread only updates the shard it was given, so
+  // threads rarely touch the same cache line.
+  struct StatShard
+  {
+    boost::atomic<double> value[STATS_MAX_HANDLES];
+  };
+
 
   // The StasKeeper class is impelemented as a singleton.
   // For those of you with the opinion that singleton is an anti-patern, I have this to say:
@@ -63,7 +154,15 @@ namespace kisscpp
       static StatsKeeper* instance(unsigned long int gp = 300,  // gp - Gather Period as a number of seconds (defaults to 5minutes)
                                    unsigned long int hl = 12);  // hl - history length, i.e. Number of historic gathered periods to keep. (default to 12 periods so that we have an hours worth of history.)
       void                start   ();
-      void                stop    ();
+      void                stop    ();                           // Returns as soon as the gather thread is done, it does not wait out the period.
+
+      // Gather every gather_period milliseconds, and also roll the gatherings up
+      // into the periods in rollup_periods (milliseconds, rounded to a multiple of
+      // gather_period). Every period keeps history_length values. The history
+      // gathered so far is dropped.
+      void                configure(unsigned long int                     gather_period,
+                                    unsigned long int                     history_length,
+                                    const std::vector<unsigned long int> &rollup_periods);
 
       ~StatsKeeper()
       {
@@ -71,14 +170,49 @@ namespace kisscpp
         stop();
       };
 
-      void                      setStatValue    (std::string id, double          value = 0);
-      void                      increment       (std::string id, double          value = 1);
-      void                      decrement       (std::string id, double          value = 1);
+      // Register a stat once, e.g. at start up, and update it through the handle:
+      // that is lock free. Registering a name again returns the same handle.
+      //
+      // A counter counts per gather period, and starts at 0 again with every
+      // gathering; setting or decrementing it only changes the current period. A
+      // gauge keeps its value. Registering a counter again as a gauge makes it one.
+      StatHandle                registerStat    (const std::string &id, StatType type = ST_COUNTER);
+
+      void                      setStatValue    (StatHandle h, double value = 0);
+      void                      increment       (StatHandle h, double value = 1);
+      void                      decrement       (StatHandle h, double value = 1);
+      double                    readTotal       (StatHandle h); // A counter's total since start up, or a gauge's value.
+
+      // The same by name, which costs a lookup under a lock first.
+      void                      setStatValue    (const std::string &id, double          value = 0) { setStatValue(registerStat(id), value); }
+      void                      increment       (const std::string &id, double          value = 1) { increment   (registerStat(id), value); }
+      void                      decrement       (const std::string &id, double          value = 1) { decrement   (registerStat(id), value); }
       void                      addStatableQueue(std::string id, sharedStatAbleQ ssq);
 
+      // A latency histogram, reported as <id>.count, .p50, .p90, .p99, .p999 and
+      // .max, in microseconds. Keep the pointer; it stays valid, and recording
+      // into it is lock free. Histograms of sizes record bytes instead, which
+      // only changes how they are exposed to OpenMetrics.
+      LatencyHistogram*         registerHistogram(const std::string &id, HistogramUnit unit = HU_MICROSECONDS);
+
+      void                      writeOpenMetrics(std::string &out); // Appends every stat, in the OpenMetrics text format.
+      static void               writeOpenMetrics(std::string &out, const StatsMapType &totals); // The same of totals, as getTotals has them.
+
+      // Gathered stats are those of every gathering, or of a rollup, by its period
+      // in milliseconds. std::invalid_argument for a period that is not rolled up.
       SharedStatsMapType        getCurrentStats();
-      SharedStatsMapType        getLastGatheredStats();
-      SharedStatsHistoryMapType getFullStatsHistory();
+      SharedStatsMapType        getLastGatheredStats(unsigned long int rollup = 0);
+      SharedStatsHistoryMapType getFullStatsHistory (unsigned long int rollup = 0);
+
+      // Every stat by its type, as "counter:<id>" and so on: counters, histogram
+      // counts and sums as totals since start up, the rest as they are now. This
+      // is what pre-forked workers report, as their gather periods do not line up.
+      SharedStatsMapType        getTotals       ();
+      static void               addTotals       (StatsMapType &sum, const StatsMapType &totals);     // Maxima and kcs-uptime are the largest, the rest add up.
+      static void               totalsToStats   (const StatsMapType &totals, StatsMapType &stats);   // Named as getCurrentStats does, without percentiles.
+
+      void                      setClusterStats (SharedStatsMapType ssmt); // Stats summed over all pre-forked workers, as reported by the master process.
+      SharedStatsMapType        getClusterStats ();
 
     protected:
     private:
@@ -88,26 +222,45 @@ namespace kisscpp
 
       StatsKeeper(unsigned long int gp,
                   unsigned long int hl) :
-        gatherPeriod (gp),
+        gatherPeriod (gp * 1000),
         historyLength(hl),
-        running(false)
+        running(false),
+        rollups(1, StatsRollup(gp * 1000, 1)),
+        statCount(0),
+        shards(new StatShard[STATS_SHARDS])
       {
         kisscpp::LogStream log(__PRETTY_FUNCTION__);
         start();
       }
 
-      void       gatherStats();
-
-      static StatsKeeper   *singleton_instance;
-      unsigned long int     gatherPeriod;
-      unsigned long int     historyLength;
-      bool                  running;
-      boost::mutex          statMutex;
-      boost::thread_group   threadGroup;
-      GatheredStatsMapType  gatheredStatsMap;
-      StatsMapType          statsMap;
-      time_t                startTime;
-      QueueStatsMapType     queueStatsMap;
+      void         gatherStats();                      // The gather thread.
+      void         gather     ();                      // Called with statMutex held.
+      StatsRollup& rollupOf   (unsigned long int period);
+      double       readStat   (StatHandle h);          // Sum over the shards, or a gauge's value.
+      double       takeStat   (StatHandle h);          // Sum over the shards, leaving them 0. Counters only.
+      StatShard&   shard      ();                      // The calling thread's.
+
+      static StatsKeeper            *singleton_instance;
+      unsigned long int              gatherPeriod;                  // Milliseconds.
+      unsigned long int              historyLength;
+      bool                           running;
+      boost::mutex                   statMutex;
+      boost::condition_variable      gatherCondition;               // Wakes the gather thread, to stop or reschedule.
+      boost::system_time             nextGather;
+      boost::thread_group            threadGroup;
+      StatsRollupList                rollups;                       // [0] is every gathering.
+      boost::atomic<unsigned int>    statCount;                     // Handles below this are registered.
+      std::string                    statNames[STATS_MAX_HANDLES];
+      boost::atomic<bool>            statGauges[STATS_MAX_HANDLES];
+      boost::atomic<double>          gaugeValues[STATS_MAX_HANDLES]; // Not sharded, a set has to replace every update before it.
+      double                         statTotals[STATS_MAX_HANDLES];  // What counters counted in previous gather periods.
+      StatHandleMapType              statHandles;
+      boost::scoped_array<StatShard> shards;
+      time_t                         startTime;
+      QueueStatsMapType              queueStatsMap;
+      HistogramMapType               histogramMap;
+      HistogramUnitMapType           histogramUnits;                // Only those not in microseconds.
+      StatsMapType                   clusterStatsMap;
   };
 }
 
@@ -0,0 +1,282 @@
+// File  : watchdog.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <signal.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include "watchdog.hpp"
+#include "logstream.hpp"
+
+namespace kisscpp
+{
+  namespace
+  {
+    struct StackCapture
+    {
+      StackCapture() : sequence(0), depth(0), ready(false) {}
+
+      boost::atomic<uint32_t> sequence;     // Of the request it is for.
+      void                   *frames[WATCHDOG_STACK_DEPTH];
+      int                     depth;
+      boost::atomic<bool>     ready;
+    };
+
+    boost::atomic<uint64_t>      stackRequest(0);    // Sequence << 32 | the thread whose stack is wanted, 0 once claimed or withdrawn.
+    boost::atomic<StackCapture*> stackCapture(NULL); // Replaced, and never freed, when a claimed request timed out.
+    uint32_t                     stackSequence = 0;
+    boost::mutex                 stackMutex;         // One stack at a time.
+  }
+
+  //--------------------------------------------------------------------------------
+  Watchdog::Watchdog(RequestRouter     &rr,
+                     IoServicePool     &pool,
+                     unsigned long int  lim,
+                     bool               rst,
+                     unsigned long int  drain_timeout) :
+    requestRouter(rr),
+    ioServicePool(pool),
+    stuckRequest (ErrorStateList::instance()->registerState("kce-stuck-request"  , "A request has been running for longer than the watchdog limit.")),
+    stuckIoThread(ErrorStateList::instance()->registerState("kce-stuck-io-thread", "An io_service has not run its loop probe for longer than the watchdog limit.")),
+    limit        (static_cast<uint64_t>(lim) * 1000),
+    restart      (rst),
+    drainTimeout (drain_timeout),
+    restarting   (false),
+    running      (false)
+  {
+  }
+
+  //--------------------------------------------------------------------------------
+  void Watchdog::start()
+  {
+    boost::lock_guard<boost::mutex> guard(stopMutex);
+
+    if(!running) {
+      struct sigaction action;
+      void            *warm_up[1];
+
+      backtrace(warm_up, 1); // The first call loads libgcc, which must not happen in the signal handler.
+
+      sigemptyset(&action.sa_mask);
+      action.sa_handler = &Watchdog::onStackSignal;
+      action.sa_flags   = SA_RESTART;
+      sigaction(WATCHDOG_STACK_SIGNAL, &action, NULL);
+
+      running = true;
+      thread.reset(new boost::thread(boost::bind(&Watchdog::run, this)));
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void Watchdog::stop()
+  {
+    {
+      boost::lock_guard<boost::mutex> guard(stopMutex);
+      running = false;
+    }
+
+    stopCondition.notify_all();
+
+    if(thread) {
+      thread->join();
+      thread.reset();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void Watchdog::run()
+  {
+    boost::unique_lock<boost::mutex> lock(stopMutex);
+    unsigned long int                interval = limit / 4000;
+
+    interval = (interval > WATCHDOG_MAX_CHECK_INTERVAL_MS) ? WATCHDOG_MAX_CHECK_INTERVAL_MS : (interval > 0) ? interval : 1;
+
+    while(running) {
+      stopCondition.timed_wait(lock, boost::posix_time::milliseconds(interval));
+
+      if(running) {
+        lock.unlock();
+        check();
+        lock.lock();
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void Watchdog::check()
+  {
+    uint64_t                   now = LatencyHistogram::now();
+    InFlightList               requests;
+    std::vector<LoopHeartbeat> beats;
+    std::set<StuckKey>         still_stuck;
+
+    requestRouter.listInFlight(requests);
+
+    for(std::size_t i = 0; i < requests.size(); ++i) {
+      if(now > requests[i].started && now - requests[i].started > limit) {
+        StuckKey key(requests[i].thread, requests[i].started);
+
+        still_stuck.insert(key);
+
+        if(reported.find(key) == reported.end()) {
+          std::stringstream what;
+          what << "Request [" << requests[i].command << "] from [" << requests[i].client << "] has been running for "
+               << (now - requests[i].started) / 1000 << "ms on thread [" << requests[i].thread << "]";
+          stuck(*stuckRequest, what.str(), requests[i].thread);
+        }
+      }
+    }
+
+    ioServicePool.heartbeats(beats);
+
+    for(std::size_t i = 0; i < beats.size(); ++i) {
+      uint64_t silence = (now > beats[i].beat) ? now - beats[i].beat : 0;
+
+      if(silence > limit + ioServicePool.probe_interval() * 1000) {
+        StuckKey key(-static_cast<long>(i) - 1, beats[i].beat); // Kept apart from threads by being negative.
+
+        still_stuck.insert(key);
+
+        if(reported.find(key) == reported.end()) {
+          std::stringstream what;
+          what << "io_service [" << i << "] has not run its loop probe for " << silence / 1000 << "ms, on thread [" << beats[i].thread << "]";
+          stuck(*stuckIoThread, what.str(), beats[i].thread);
+        }
+      }
+    }
+
+    reported.swap(still_stuck); // What is no longer stuck, may be reported again.
+
+    if(restart && !reported.empty()) {
+      restartProcess();
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  void Watchdog::stuck(ErrorState &state, const std::string &what, long thread)
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    state.set(what);
+
+    log << manip::error_high << "Watchdog: " << what << ". Stack:\n" << stackOf(thread) << manip::endl;
+  }
+
+  //--------------------------------------------------------------------------------
+  // Stops as SIGTERM would, but gives up on the drain when the stuck thread holds it up.
+  void Watchdog::restartProcess()
+  {
+    LogStream log(__PRETTY_FUNCTION__);
+
+    if(!restarting) {
+      restarting = true;
+
+      log << manip::error_high << "Watchdog: stopping the process, to be restarted." << manip::endl;
+
+      kill(getpid(), SIGTERM);
+    }
+
+    boost::unique_lock<boost::mutex> lock    (stopMutex);
+    boost::system_time               deadline = boost::get_system_time() + boost::posix_time::milliseconds(drainTimeout + WATCHDOG_EXIT_GRACE_MS);
+
+    while(running && stopCondition.timed_wait(lock, deadline)) {
+    }
+
+    if(running) {
+      log << manip::error_high << "Watchdog: the process did not stop in time, exiting." << manip::endl;
+      _exit(EXIT_FAILURE);
+    }
+  }
+
+  //--------------------------------------------------------------------------------
+  // Every request carries a new sequence number, which the signal handler has to
+  // match to claim it. A handler that claimed a request, but did not finish in
+  // time, may still be writing to its capture, so that one is left to it.
+  std::string Watchdog::stackOf(long thread)
+  {
+    boost::lock_guard<boost::mutex> guard(stackMutex);
+    std::stringstream               stack;
+
+    if(thread <= 0) {
+      return "  (unknown thread)\n";
+    }
+
+    StackCapture *capture = stackCapture.load(boost::memory_order_relaxed);
+
+    if(!capture) {
+      capture = new StackCapture();
+      stackCapture.store(capture, boost::memory_order_release);
+    }
+
+    uint64_t request = (static_cast<uint64_t>(++stackSequence) << 32) | static_cast<uint32_t>(thread);
+
+    capture->ready.store(false, boost::memory_order_relaxed);
+    capture->sequence.store(stackSequence, boost::memory_order_relaxed);
+    stackRequest.store(request, boost::memory_order_release);
+
+    if(syscall(SYS_tgkill, getpid(), thread, WATCHDOG_STACK_SIGNAL) == 0) {
+      for(int waited = 0; waited < WATCHDOG_STACK_WAIT_MS && !capture->ready.load(boost::memory_order_acquire); ++waited) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      }
+    }
+
+    bool claimed = !stackRequest.compare_exchange_strong(request, 0, boost::memory_order_acq_rel); // Withdraw it, unless the handler has it.
+
+    if(!capture->ready.load(boost::memory_order_acquire)) {
+      if(claimed) {
+        stackCapture.store(new StackCapture(), boost::memory_order_release);
+      }
+
+      return "  (the thread did not answer)\n";
+    }
+
+    char **symbols = backtrace_symbols(capture->frames + 2, capture->depth - 2); // Less the signal handler, and trampoline.
+
+    for(int i = 0; symbols && i < capture->depth - 2; ++i) {
+      stack << "  " << symbols[i] << '\n';
+    }
+
+    std::free(symbols);
+
+    return stack.str();
+  }
+
+  //--------------------------------------------------------------------------------
+  // Only async signal safe calls here.
+  void Watchdog::onStackSignal(int)
+  {
+    int           saved_errno = errno;
+    StackCapture *capture     = stackCapture.load(boost::memory_order_acquire); // Before the request, it may be replaced after one timed out.
+    uint64_t      request     = stackRequest.load(boost::memory_order_acquire);
+
+    if(request != 0 &&
+       static_cast<uint32_t>(request) == static_cast<uint32_t>(syscall(SYS_gettid)) &&
+       capture && capture->sequence.load(boost::memory_order_relaxed) == static_cast<uint32_t>(request >> 32) &&
+       stackRequest.compare_exchange_strong(request, 0, boost::memory_order_acq_rel)) {
+
+      capture->depth = backtrace(capture->frames, WATCHDOG_STACK_DEPTH);
+      capture->ready.store(true, boost::memory_order_release);
+    }
+
+    errno = saved_errno;
+  }
+}
@@ -0,0 +1,97 @@
+// File  : watchdog.hpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _WATCHDOG_HPP_
+#define _WATCHDOG_HPP_
+
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include "io_service_pool.hpp"
+#include "request_router.hpp"
+#include "errorstate.hpp"
+
+#define WATCHDOG_MAX_CHECK_INTERVAL_MS 1000
+#define WATCHDOG_STACK_WAIT_MS         200
+#define WATCHDOG_EXIT_GRACE_MS         2000  // After the drain timeout, for a restart that does not get through a drain.
+#define WATCHDOG_STACK_DEPTH           32
+#define WATCHDOG_STACK_SIGNAL          (SIGRTMIN + 2)
+
+namespace kisscpp
+{
+  //--------------------------------------------------------------------------------
+  // Looks for threads that are stuck: a request in flight for longer than limit,
+  // or an io_service whose loop probe has not run for longer than limit past its
+  // interval. Both are read from stamps the threads leave anyway, so watching
+  // costs them nothing.
+  //
+  // A stuck thread is reported once: an error state is set, and the request and
+  // the thread's stack are logged. The stack is taken by signalling the thread,
+  // and copying it in the signal handler. With restart set, the process is then
+  // stopped, as by SIGTERM. In pre-fork mode the master starts a new worker in its
+  // place; otherwise whatever supervises the process has to. When the stuck thread
+  // keeps the drain from completing, the process exits anyway, once the drain
+  // timeout has passed.
+  class Watchdog : private boost::noncopyable
+  {
+    public:
+      Watchdog(RequestRouter     &rr,
+               IoServicePool     &pool,
+               unsigned long int  limit,          // Milliseconds.
+               bool               restart,
+               unsigned long int  drain_timeout); // Milliseconds.
+
+      ~Watchdog() { stop(); }
+
+      void start();
+      void stop ();
+
+    private:
+      typedef std::pair<long, uint64_t> StuckKey; // Thread, and when it started on what it is stuck on.
+
+      void run        ();
+      void check      ();
+      void stuck      (ErrorState &state, const std::string &what, long thread);
+      void restartProcess();
+
+      static std::string stackOf(long thread);
+      static void        onStackSignal(int signal_number);
+
+      RequestRouter                    &requestRouter;
+      IoServicePool                    &ioServicePool;
+      SharedErrorState                  stuckRequest;   // kce-stuck-request, what got stuck is each occurrence's detail.
+      SharedErrorState                  stuckIoThread;  // kce-stuck-io-thread
+      uint64_t                          limit;          // Microseconds.
+      bool                              restart;
+      unsigned long int                 drainTimeout;
+      bool                              restarting;
+      std::set<StuckKey>                reported;
+      boost::mutex                      stopMutex;
+      boost::condition_variable         stopCondition;
+      bool                              running;
+      boost::scoped_ptr<boost::thread>  thread;
+  };
+}
+
+#endif // _WATCHDOG_HPP_
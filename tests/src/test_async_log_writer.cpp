@@ -0,0 +1,139 @@
+#include <string>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <boost/thread.hpp>
+#include "../catch.hpp"
+#include "../kisscpp/async_log_writer.hpp"
+
+//--------------------------------------------------------------------------------
+// A FIFO nobody reads yet: the writer thread blocks opening it, after it took the
+// first line, so what is pushed meanwhile stays queued.
+static const char *fifo_path = "/tmp/kisscpp_test_async_log";
+
+static std::string numbered(int i)
+{
+  std::stringstream line;
+  line << "line " << i;
+  return line.str();
+}
+
+static void push(kisscpp::AsyncLogWriter &writer, int first, int last)
+{
+  for(int i = first; i <= last; ++i) {
+    std::string line = numbered(i);
+    writer.push(line, i == first);
+  }
+}
+
+static std::string readAll(int fd)
+{
+  std::string out;
+  char        chunk[4096];
+  ssize_t     rc;
+
+  while((rc = read(fd, chunk, sizeof(chunk))) > 0) {
+    out.append(chunk, rc);
+  }
+
+  return out;
+}
+
+namespace
+{
+  struct Pusher
+  {
+    Pusher(kisscpp::AsyncLogWriter &w, int f, int l) : writer(w), first(f), last(l) {}
+    void operator()() { push(writer, first, last); }
+
+    kisscpp::AsyncLogWriter &writer;
+    int                      first;
+    int                      last;
+  };
+}
+
+SCENARIO("The asynchronous log writer queues lines in a bounded ring", "[async_log_writer]")
+{
+  GIVEN("A writer with room for 3 lines, rounded up to 4, stalled after its first line")
+  {
+    unlink(fifo_path);
+    REQUIRE(mkfifo(fifo_path, 0600) == 0);
+
+    //--------------------------------------------------------------------------------
+    WHEN("More lines are pushed than it holds, dropping the rest") {
+      kisscpp::AsyncLogWriter *writer = new kisscpp::AsyncLogWriter(fifo_path, false, 3, kisscpp::LO_DROP);
+
+      push(*writer, 1, 1);
+      boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+      push(*writer, 2, 8);
+
+      int      fd      = open(fifo_path, O_RDONLY);
+      uint64_t dropped = writer->droppedRecords();
+
+      delete writer;
+
+      std::string out = readAll(fd);
+      close(fd);
+
+      THEN("What fit is written in order, and the rest is only counted") {
+        REQUIRE(dropped == 3);
+        REQUIRE(out     == "line 1\nline 2\nline 3\nline 4\nline 5\n");
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("More lines are pushed than it holds, counting the rest") {
+      kisscpp::AsyncLogWriter *writer = new kisscpp::AsyncLogWriter(fifo_path, false, 3, kisscpp::LO_COUNT);
+
+      push(*writer, 1, 1);
+      boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+      push(*writer, 2, 8);
+
+      int fd = open(fifo_path, O_RDONLY);
+
+      delete writer;
+
+      std::string out = readAll(fd);
+      close(fd);
+
+      THEN("The writer logs how many were dropped, after what fit") {
+        REQUIRE(out.compare(0, 35, "line 1\nline 2\nline 3\nline 4\nline 5\n") == 0);
+        REQUIRE(out.find("[3] log records dropped, the log queue was full.") != std::string::npos);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("More lines are pushed than it holds, blocking until there is room") {
+      kisscpp::AsyncLogWriter *writer = new kisscpp::AsyncLogWriter(fifo_path, false, 3, kisscpp::LO_BLOCK);
+
+      push(*writer, 1, 1);
+      boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+
+      boost::thread pusher(Pusher(*writer, 2, 100));
+      int           fd = open(fifo_path, O_RDONLY);
+
+      pusher.join();
+
+      uint64_t dropped = writer->droppedRecords();
+
+      delete writer;
+
+      std::string out = readAll(fd);
+      close(fd);
+
+      std::string expected;
+
+      for(int i = 1; i <= 100; ++i) {
+        expected += numbered(i) + "\n";
+      }
+
+      THEN("Every line is written, in order") {
+        REQUIRE(dropped == 0);
+        REQUIRE(out     == expected);
+      }
+    }
+
+    unlink(fifo_path);
+  }
+}
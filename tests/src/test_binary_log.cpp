@@ -0,0 +1,117 @@
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <unistd.h>
+#include "../catch.hpp"
+#include "../kisscpp/binary_log.hpp"
+
+//--------------------------------------------------------------------------------
+// The same records, as another process would have written them.
+static std::string withPid(std::string records, uint32_t pid)
+{
+  std::size_t pos = 0;
+
+  while(pos < records.size()) {
+    uint32_t length;
+
+    std::memcpy(&length, &records[pos], sizeof(length));
+    std::memcpy(&records[pos + sizeof(length) + 1], &pid, sizeof(pid));
+    pos += sizeof(length) + length;
+  }
+
+  return records;
+}
+
+SCENARIO("Binary log records are read back as they were written", "[binary_log]")
+{
+  GIVEN("A file with a text line and two formatted entries")
+  {
+    static const char *source = "void foo()";
+    static const char *format = "Request from [{}:{}] took {}ms";
+
+    kisscpp::BinaryLogDefinitions definitions;
+    std::string                   records;
+    std::string                   entry;
+    std::string                   file;
+
+    kisscpp::BinaryLog::textRecord(records, 1000000000ULL, 5, "void bar()", "+ [void bar()]");
+
+    for(int i = 0; i < 2; ++i) {
+      kisscpp::BinaryLog::beginEntry(entry, 2000000000ULL, 5, source, "", format);
+      kisscpp::BinaryLog::addString (entry, "10.0.0.1");
+      kisscpp::BinaryLog::addUInt   (entry, 9100 + i);
+      kisscpp::BinaryLog::addDouble (entry, 1.5);
+      kisscpp::BinaryLog::endRecord (entry);
+      records += entry;
+    }
+
+    kisscpp::BinaryLog::header(file);
+    definitions.prepare(records, file);
+
+    //--------------------------------------------------------------------------------
+    WHEN("We read it back") {
+      std::istringstream       in(file);
+      kisscpp::BinaryLogReader reader(in);
+      kisscpp::BinaryLogEntry  read;
+
+      THEN("The entries are complete, and the format is only defined once") {
+        REQUIRE(reader.next(read));
+        REQUIRE(!read.formatted);
+        REQUIRE(read.source  == "void bar()");
+        REQUIRE(read.message == "+ [void bar()]");
+
+        REQUIRE(reader.next(read));
+        REQUIRE(read.formatted);
+        REQUIRE(read.pid         == static_cast<uint32_t>(getpid()));
+        REQUIRE(read.source      == source);
+        REQUIRE(read.format      == format);
+        REQUIRE(read.args.size() == 3);
+        REQUIRE(read.message     == "Request from [10.0.0.1:9100] took 1.5ms");
+
+        REQUIRE(reader.next(read));
+        REQUIRE(read.message     == "Request from [10.0.0.1:9101] took 1.5ms");
+        REQUIRE(!reader.next(read));
+
+        REQUIRE(file.find(format) == file.rfind(format));
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("Another process opens the file, and both write on") {
+      std::string shared = file;
+
+      kisscpp::BinaryLog::header(shared);
+      shared += withPid(records, getpid() + 1);
+      shared += records;
+
+      std::istringstream       in(shared);
+      kisscpp::BinaryLogReader reader(in);
+      kisscpp::BinaryLogEntry  read;
+
+      THEN("Ids are only looked up among the strings of the process that wrote them") {
+        for(int i = 0; i < 5; ++i) {
+          REQUIRE(reader.next(read));
+        }
+
+        REQUIRE(read.format == "?");
+
+        for(int i = 0; i < 3; ++i) {
+          REQUIRE(reader.next(read));
+        }
+
+        REQUIRE(read.format == format);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("We read something that is not a binary log") {
+      std::istringstream       in("KCPPXXXX\x01\x00");
+      kisscpp::BinaryLogReader reader(in);
+      kisscpp::BinaryLogEntry  read;
+
+      THEN("It is refused") {
+        REQUIRE_THROWS(reader.next(read));
+      }
+    }
+  }
+}
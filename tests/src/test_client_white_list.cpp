@@ -0,0 +1,54 @@
+#include <string>
+#include "../catch.hpp"
+#include "../kisscpp/client_white_list.hpp"
+
+SCENARIO("White-listed applications and instances are found", "[client_white_list]")
+{
+  GIVEN("A compiled white-list")
+  {
+    kisscpp::ClientWhiteList white_list;
+
+    white_list.addApplication("foo", true);
+    white_list.addApplication("bar", false);
+    white_list.addInstance   ("bar", "2");
+    white_list.addInstance   ("bar", "1");
+
+    for(unsigned int i = 0; i < 50; ++i) {
+      white_list.addInstance("app" + std::to_string(i), "0");
+    }
+
+    white_list.compile();
+
+    //--------------------------------------------------------------------------------
+    WHEN("We look up allowed clients") {
+      THEN("They are allowed") {
+        REQUIRE(white_list.isAllowed("foo"  , "any"));
+        REQUIRE(white_list.isAllowed("bar"  , "1"));
+        REQUIRE(white_list.isAllowed("bar"  , "2"));
+        REQUIRE(white_list.isAllowed("app17", "0"));
+        REQUIRE(white_list.size() == 52);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("We look up clients that are not in the list") {
+      THEN("They are denied") {
+        REQUIRE(!white_list.isAllowed("bar"  , "3"));
+        REQUIRE(!white_list.isAllowed("baz"  , "1"));
+        REQUIRE(!white_list.isAllowed("app17", "1"));
+        REQUIRE(white_list.findApplication("baz") == kisscpp::ClientWhiteList::NOT_FOUND);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("We use the interned id of an application") {
+      int bar = white_list.findApplication("bar");
+
+      THEN("It answers for that application") {
+        REQUIRE(bar != kisscpp::ClientWhiteList::NOT_FOUND);
+        REQUIRE( white_list.isAllowed(bar, "1"));
+        REQUIRE(!white_list.isAllowed(bar, "3"));
+      }
+    }
+  }
+}
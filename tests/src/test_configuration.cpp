@@ -0,0 +1,70 @@
+#include <string>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "../catch.hpp"
+#include "../kisscpp/configuration.hpp"
+
+//--------------------------------------------------------------------------------
+static const char *config_root = "/tmp/kisscpp_test_config";
+
+static void writeConfig(const std::string &limit)
+{
+  boost::filesystem::create_directories(std::string(config_root) + "/kc_test");
+
+  std::ofstream file((std::string(config_root) + "/kc_test/kc_test.0.kcppcfg").c_str());
+
+  file << "{ \"test\" : { \"limit\" : \"" << limit << "\" } }\n";
+}
+
+SCENARIO("Configuration keys are resolved once per generation", "[configuration]")
+{
+  GIVEN("A configuration file, and a key on it")
+  {
+    writeConfig("5");
+
+    kisscpp::Config         *config = kisscpp::Config::instance("kc_test", "0", config_root);
+    kisscpp::ConfigKey<int>  limit("test.limit");
+
+    config->reload();
+
+    //--------------------------------------------------------------------------------
+    WHEN("The file changes, and the configuration is reloaded") {
+      int                            before     = limit.get();
+      const kisscpp::ConfigSnapshot *snapshot   = config->snapshot();
+      unsigned long                  generation = snapshot->getGeneration();
+
+      writeConfig("6");
+      int unchanged = limit.get();
+      config->reload();
+
+      THEN("The key has the new value, and the old snapshot the old one") {
+        REQUIRE(before                              == 5);
+        REQUIRE(unchanged                           == 5);
+        REQUIRE(limit.get()                         == 6);
+        REQUIRE(config->snapshot()->getGeneration() == generation + 1);
+        REQUIRE(snapshot->get<int>("test.limit")    == 5);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("The file can not be parsed") {
+      std::ofstream((std::string(config_root) + "/kc_test/kc_test.0.kcppcfg").c_str()) << "{ \"test\" : ";
+
+      THEN("Reloading throws, and the key keeps its value") {
+        REQUIRE_THROWS(config->reload());
+        REQUIRE(limit.get() == 5);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("A key is not configured") {
+      kisscpp::ConfigKey<int> with_default   ("test.missing", 7);
+      kisscpp::ConfigKey<int> without_default("test.missing");
+
+      THEN("It has its default, or throws without one") {
+        REQUIRE(with_default.get() == 7);
+        REQUIRE_THROWS_AS(without_default.get(), boost::property_tree::ptree_bad_path);
+      }
+    }
+  }
+}
@@ -0,0 +1,96 @@
+#include <string>
+#include "../catch.hpp"
+#include "../kisscpp/errorstate.hpp"
+
+namespace
+{
+  struct CountCrossings
+  {
+    explicit CountCrossings(unsigned int &c) : crossings(c) {}
+    void operator()(const kisscpp::ErrorState &, unsigned int) { ++crossings; }
+
+    unsigned int &crossings;
+  };
+}
+
+SCENARIO("Error states count occurrences over time", "[errorstate]")
+{
+  GIVEN("The error state list")
+  {
+    kisscpp::ErrorStateList *errors = kisscpp::ErrorStateList::instance();
+
+    //--------------------------------------------------------------------------------
+    WHEN("An error is set under differently cased ids") {
+      kisscpp::SharedErrorState state = errors->registerState("kce-test-case");
+
+      errors->set("KCE-Test-Case", "first");
+      errors->set("kce-test-case", "second");
+
+      THEN("Both count towards the one state") {
+        REQUIRE(state->getSetCount()   == 2);
+        REQUIRE(state->getTotal()      == 2);
+        REQUIRE(state->countInWindow(ERROR_RATE_SECONDS) == 2);
+        REQUIRE(state->getFirstSeen()  >  0);
+        REQUIRE(state->getLastSeen()   >= state->getFirstSeen());
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("An error is cleared more often than it was set") {
+      kisscpp::SharedErrorState state = errors->registerState("kce-test-clear");
+
+      errors->set  ("kce-test-clear");
+      errors->clear("KCE-TEST-CLEAR", 5);
+
+      THEN("The count stops at 0, and the total is kept") {
+        REQUIRE(state->getSetCount()   == 0);
+        REQUIRE(state->getTotal()      == 1);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("An error is set more often than the history holds") {
+      kisscpp::SharedErrorState state = errors->registerState("kce-test-history");
+      kisscpp::ErrorHistory     history;
+
+      for(int i = 0; i < ERROR_HISTORY_LENGTH + 2; ++i) {
+        state->set(std::string(1, static_cast<char>('a' + i)));
+      }
+
+      state->getHistory(history);
+
+      THEN("Only the most recent are kept, oldest first") {
+        REQUIRE(history.size()        == ERROR_HISTORY_LENGTH);
+        REQUIRE(history[0].detail     == "c");
+        REQUIRE(history.back().detail == std::string(1, static_cast<char>('a' + ERROR_HISTORY_LENGTH + 1)));
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("An error reaches its threshold, and keeps being set") {
+      unsigned int crossings = 0;
+
+      errors->setThreshold("kce-test-threshold", 3, 10, false, CountCrossings(crossings));
+
+      for(int i = 0; i < 5; ++i) {
+        errors->set("kce-test-threshold");
+      }
+
+      THEN("The callback is called once, and nothing is shed") {
+        REQUIRE(crossings             == 1);
+        REQUIRE(errors->isShedding()  == false);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("An error reaches a threshold set to shed") {
+      errors->setThreshold("kce-test-shed", 2, 1, true);
+      errors->set("kce-test-shed");
+      errors->set("kce-test-shed");
+
+      THEN("Requests are shed") {
+        REQUIRE(errors->isShedding()  == true);
+      }
+    }
+  }
+}
@@ -0,0 +1,40 @@
+#include <string>
+#include "../catch.hpp"
+#include "../kisscpp/inflight_table.hpp"
+
+SCENARIO("The in-flight table lists the requests being handled", "[inflight]")
+{
+  GIVEN("An empty table")
+  {
+    kisscpp::InFlightTable table;
+    kisscpp::InFlightList  requests;
+
+    //--------------------------------------------------------------------------------
+    WHEN("Two requests enter, and one leaves") {
+      int first  = table.enter("kch-stats", "monitor");
+      int second = table.enter("echo"     , std::string(100, 'c'));
+
+      table.leave(first);
+      table.list(requests);
+
+      THEN("Only the other is listed, with its id cut to fit") {
+        REQUIRE(second                    >= 0);
+        REQUIRE(requests.size()           == 1);
+        REQUIRE(requests[0].command       == "echo");
+        REQUIRE(requests[0].client.size() == INFLIGHT_FIELD_SIZE - 1);
+        REQUIRE(requests[0].thread        == kisscpp::InFlightTable::threadId());
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("Every slot is taken") {
+      for(int i = 0; i < INFLIGHT_SLOTS; ++i) {
+        table.enter("echo", "load");
+      }
+
+      THEN("Further requests are not tracked") {
+        REQUIRE(table.enter("echo", "load") == -1);
+      }
+    }
+  }
+}
@@ -0,0 +1,87 @@
+#include <string>
+#include <stdexcept>
+#include "../catch.hpp"
+#include "../kisscpp/ip_prefix_trie.hpp"
+
+//--------------------------------------------------------------------------------
+static bool allowed(const kisscpp::IpPrefixTrie &trie, const std::string &ip)
+{
+  return trie.contains(boost::asio::ip::address::from_string(ip));
+}
+
+SCENARIO("White-listed networks are matched by prefix", "[ip_prefix_trie]")
+{
+  GIVEN("A trie with a few IPv4 and IPv6 networks")
+  {
+    kisscpp::IpPrefixTrie trie;
+
+    trie.insert("10.1.0.0/16");
+    trie.insert("10.1.2.0/24");
+    trie.insert("192.168.7.9");
+    trie.insert("172.16.0.0/12");
+    trie.insert("2001:db8::/32");
+    trie.insert("fe80::1");
+
+    //--------------------------------------------------------------------------------
+    WHEN("We look up addresses inside the networks") {
+      THEN("They are allowed") {
+        REQUIRE(allowed(trie, "10.1.0.1"));
+        REQUIRE(allowed(trie, "10.1.255.255"));
+        REQUIRE(allowed(trie, "10.1.2.3"));
+        REQUIRE(allowed(trie, "192.168.7.9"));
+        REQUIRE(allowed(trie, "172.31.200.1"));
+        REQUIRE(allowed(trie, "2001:db8:1234::5"));
+        REQUIRE(allowed(trie, "fe80::1"));
+        REQUIRE(allowed(trie, "::ffff:10.1.9.9"));
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("We look up addresses outside the networks") {
+      THEN("They are denied") {
+        REQUIRE(!allowed(trie, "10.2.0.1"));
+        REQUIRE(!allowed(trie, "192.168.7.8"));
+        REQUIRE(!allowed(trie, "172.32.0.1"));
+        REQUIRE(!allowed(trie, "2001:db9::1"));
+        REQUIRE(!allowed(trie, "fe80::2"));
+        REQUIRE(!allowed(trie, "::ffff:10.2.0.1"));
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("We add a network that is already there") {
+      std::size_t size_before = trie.size();
+      trie.insert("10.1.2.0/24");
+
+      THEN("The size stays the same") {
+        REQUIRE(trie.size() == size_before);
+      }
+    }
+  }
+
+  GIVEN("An empty trie, and one that allows everything")
+  {
+    kisscpp::IpPrefixTrie empty_trie;
+    kisscpp::IpPrefixTrie any_trie;
+
+    any_trie.insert("0.0.0.0/0");
+
+    THEN("Lookups fail, and succeed respectively") {
+      REQUIRE(!allowed(empty_trie, "127.0.0.1"));
+      REQUIRE( allowed(any_trie  , "127.0.0.1"));
+      REQUIRE(!allowed(any_trie  , "::1"));
+    }
+  }
+
+  GIVEN("Invalid white-list entries")
+  {
+    kisscpp::IpPrefixTrie trie;
+
+    THEN("They are rejected") {
+      REQUIRE_THROWS_AS(trie.insert("10.0.0.0/33"), std::invalid_argument);
+      REQUIRE_THROWS_AS(trie.insert("10.0.0/8")   , std::invalid_argument);
+      REQUIRE_THROWS_AS(trie.insert("10.0.0.0/")  , std::invalid_argument);
+      REQUIRE_THROWS_AS(trie.insert("host.name")  , std::invalid_argument);
+    }
+  }
+}
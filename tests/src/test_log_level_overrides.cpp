@@ -0,0 +1,79 @@
+#include <string>
+#include "../catch.hpp"
+#include "../kisscpp/log_level_overrides.hpp"
+
+using kisscpp::LogLevelOverrides;
+
+SCENARIO("Log level overrides apply to sources and entities", "[log_level_overrides]")
+{
+  GIVEN("No overrides")
+  {
+    const std::string connection = "void kisscpp::Connection::start()";
+    const std::string server     = "void kisscpp::Server::run()";
+
+    LogLevelOverrides::clear();
+
+    //--------------------------------------------------------------------------------
+    WHEN("Nothing is overridden") {
+      THEN("No level applies") {
+        REQUIRE(LogLevelOverrides::empty());
+        REQUIRE(LogLevelOverrides::find(connection, "worker") == 0);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("A source is overridden") {
+      LogLevelOverrides::set(kisscpp::LOK_SOURCE, "kisscpp::Connection::", 3);
+
+      THEN("It applies to sources with a word starting with it") {
+        REQUIRE(LogLevelOverrides::find(connection                         , "") == 3);
+        REQUIRE(LogLevelOverrides::find("kisscpp::Connection::stop"        , "") == 3);
+        REQUIRE(LogLevelOverrides::find("void kisscpp::ConnectionPool::x()", "") == 0);
+        REQUIRE(LogLevelOverrides::find("void my_kisscpp::Connection::x()" , "") == 0);
+        REQUIRE(LogLevelOverrides::find(server                             , "") == 0);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("Sources are overridden by keys of different length") {
+      LogLevelOverrides::set(kisscpp::LOK_SOURCE, "kisscpp::Connection::", 3);
+      LogLevelOverrides::set(kisscpp::LOK_SOURCE, "kisscpp::"            , 2);
+      LogLevelOverrides::set(kisscpp::LOK_SOURCE, "kisscpp::Conn"        , 4);
+
+      THEN("The longest key that matches wins") {
+        REQUIRE(LogLevelOverrides::find(connection, "") == 3);
+        REQUIRE(LogLevelOverrides::find(server    , "") == 2);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("An entity and a source are overridden") {
+      LogLevelOverrides::set(kisscpp::LOK_SOURCE, "kisscpp::Connection::", 3);
+      LogLevelOverrides::set(kisscpp::LOK_ENTITY, "worker-1"             , 5);
+
+      THEN("The entity goes before the source, when it is the same entity") {
+        REQUIRE(LogLevelOverrides::find(connection, "worker-1") == 5);
+        REQUIRE(LogLevelOverrides::find(server    , "worker-1") == 5);
+        REQUIRE(LogLevelOverrides::find(connection, "worker-2") == 3);
+        REQUIRE(LogLevelOverrides::find(connection, "worker"  ) == 3);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("An override is removed") {
+      LogLevelOverrides::set(kisscpp::LOK_SOURCE, "kisscpp::", 2);
+
+      uint32_t generation = LogLevelOverrides::generation();
+
+      LogLevelOverrides::remove(kisscpp::LOK_SOURCE, "kisscpp::");
+
+      THEN("It no longer applies, and readers can tell the overrides changed") {
+        REQUIRE(LogLevelOverrides::find(server, "") == 0);
+        REQUIRE(LogLevelOverrides::empty());
+        REQUIRE(LogLevelOverrides::generation()     != generation);
+      }
+    }
+
+    LogLevelOverrides::clear();
+  }
+}
@@ -0,0 +1,88 @@
+#include <time.h>
+#include <boost/thread/thread.hpp>
+#include "../catch.hpp"
+#include "../kisscpp/logstream.hpp"
+#include "../kisscpp/log_limiter.hpp"
+
+//--------------------------------------------------------------------------------
+static int admitted(const char *site, int times)
+{
+  int count = 0;
+
+  for(int i = 0; i < times; ++i) {
+    if(kisscpp::LogLimiter::admit(site, kisscpp::LT_INFO, kisscpp::LS_LOW)) {
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+// Right after the second changes, so a burst does not straddle two seconds.
+static void startOfSecond()
+{
+  time_t now = time(NULL);
+
+  while(time(NULL) == now) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+  }
+}
+
+SCENARIO("Log lines are rate limited and sampled per call site", "[log_limiter]")
+{
+  GIVEN("No limits")
+  {
+    kisscpp::LogLimiter::setRateLimit(0);
+    kisscpp::LogLimiter::setSample   (1.0);
+
+    //--------------------------------------------------------------------------------
+    WHEN("Nothing is limited") {
+      THEN("Every line is admitted") {
+        REQUIRE(admitted("test_log_limiter.cpp:none", 1000) == 1000);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("Call sites are limited to 5 lines per second") {
+      kisscpp::LogLimiter::setRateLimit(5);
+
+      startOfSecond();
+
+      int first = admitted("test_log_limiter.cpp:rate-a", 20);
+      int other = admitted("test_log_limiter.cpp:rate-b", 20);
+
+      startOfSecond();
+
+      int next  = admitted("test_log_limiter.cpp:rate-a", 20);
+
+      kisscpp::LogLimiter::setRateLimit(0);
+
+      THEN("Each site gets 5 every second") {
+        REQUIRE(first == 5);
+        REQUIRE(other == 5);
+        REQUIRE(next  == 5);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("A fraction of the lines is sampled") {
+      kisscpp::LogLimiter::setSample(0.0);
+      int none    = admitted("test_log_limiter.cpp:sample", 1000);
+
+      kisscpp::LogLimiter::setSample(0.25);
+      int quarter = admitted("test_log_limiter.cpp:sample", 20000);
+
+      kisscpp::LogLimiter::setSample(2.0);
+      double clamped = kisscpp::LogLimiter::getSample();
+
+      kisscpp::LogLimiter::setSample(1.0);
+
+      THEN("About that fraction is admitted") {
+        REQUIRE(none    == 0);
+        REQUIRE(quarter >  4000);
+        REQUIRE(quarter <  6000);
+        REQUIRE(clamped == 1.0);
+      }
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#include <string>
+#include <cctype>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/thread.hpp>
+#include "../catch.hpp"
+#include "../kisscpp/logstream.hpp"
+
+//--------------------------------------------------------------------------------
+static std::string isoNow()
+{
+  return boost::posix_time::to_iso_string(boost::posix_time::microsec_clock::local_time());
+}
+
+static bool digitsAt(const std::string &s, std::size_t from, std::size_t to)
+{
+  for(std::size_t i = from; i < to; ++i) {
+    if(!std::isdigit(static_cast<unsigned char>(s[i]))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+SCENARIO("Log timestamps keep the layout of to_iso_string", "[logstream]")
+{
+  GIVEN("The local time, as to_iso_string has it, before and after a timestamp")
+  {
+    //--------------------------------------------------------------------------------
+    WHEN("A timestamp is taken") {
+      std::string before = isoNow();
+      std::string stamp(kisscpp::LogStream::timestamp(), LOG_TIMESTAMP_LENGTH);
+      std::string after  = isoNow();
+
+      THEN("It reads YYYYMMDDTHHMMSS.ffffff, between the two") {
+        REQUIRE(stamp.size() == 22);
+        REQUIRE(digitsAt(stamp,  0,  8));
+        REQUIRE(stamp[8]     == 'T');
+        REQUIRE(digitsAt(stamp,  9, 15));
+        REQUIRE(stamp[15]    == '.');
+        REQUIRE(digitsAt(stamp, 16, 22));
+        REQUIRE(before       <= stamp);
+        REQUIRE(stamp        <= after);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("Timestamps are taken across a second") {
+      std::string first(kisscpp::LogStream::timestamp(), LOG_TIMESTAMP_LENGTH);
+
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1100));
+
+      std::string before = isoNow();
+      std::string second(kisscpp::LogStream::timestamp(), LOG_TIMESTAMP_LENGTH);
+      std::string after  = isoNow();
+
+      THEN("The cached seconds are formatted again") {
+        REQUIRE(first.compare(0, 15, second, 0, 15) <  0);
+        REQUIRE(before                               <= second);
+        REQUIRE(second                               <= after);
+      }
+    }
+  }
+}
@@ -0,0 +1,185 @@
+#include <string>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include "../catch.hpp"
+#include "../kisscpp/statskeeper.hpp"
+
+//--------------------------------------------------------------------------------
+static void count(kisscpp::StatHandle h, int times)
+{
+  for(int i = 0; i < times; ++i) {
+    kisscpp::StatsKeeper::instance()->increment(h);
+  }
+}
+
+SCENARIO("Stats updated from many threads add up", "[statskeeper]")
+{
+  GIVEN("A registered stat")
+  {
+    kisscpp::StatsKeeper *stats = kisscpp::StatsKeeper::instance();
+    kisscpp::StatHandle   h     = stats->registerStat("test-counted");
+
+    //--------------------------------------------------------------------------------
+    WHEN("It is registered again") {
+      THEN("The same handle is returned") {
+        REQUIRE(stats->registerStat("test-counted") == h);
+        REQUIRE(stats->registerStat("test-other"  ) != h);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("Threads, more than there are shards, update it") {
+      boost::thread_group threads;
+
+      stats->setStatValue(h, 5);
+
+      for(int i = 0; i < 20; ++i) {
+        threads.create_thread(boost::bind(count, h, 1000));
+      }
+
+      threads.join_all();
+      stats->decrement("test-counted", 2);
+
+      THEN("Reading it sums every update") {
+        REQUIRE((*stats->getCurrentStats())["stats.test-counted"] == 20003);
+      }
+    }
+  }
+}
+
+SCENARIO("Stats are counters unless registered as gauges", "[statskeeper]")
+{
+  GIVEN("A stat set by name, and one registered as a gauge")
+  {
+    kisscpp::StatsKeeper *stats = kisscpp::StatsKeeper::instance();
+    std::string           out;
+
+    stats->setStatValue("test-set", 3);
+    stats->decrement   (stats->registerStat("test-level", kisscpp::ST_GAUGE), 2);
+
+    //--------------------------------------------------------------------------------
+    WHEN("They are exposed to OpenMetrics") {
+      stats->writeOpenMetrics(out);
+
+      THEN("Only the registered gauge is a gauge") {
+        REQUIRE(out.find("# TYPE test_set counter\ntest_set_total 3\n") != std::string::npos);
+        REQUIRE(out.find("# TYPE test_level gauge\ntest_level -2\n" ) != std::string::npos);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("A gauge is updated from many threads, and then set") {
+      kisscpp::StatHandle g = stats->registerStat("test-gauge-set", kisscpp::ST_GAUGE);
+      boost::thread_group threads;
+
+      for(int i = 0; i < 20; ++i) {
+        threads.create_thread(boost::bind(count, g, 1000));
+      }
+
+      threads.join_all();
+
+      double updated = stats->readTotal(g);
+
+      stats->setStatValue(g, 7);
+      stats->increment   (g);
+
+      THEN("The set replaces every update before it") {
+        REQUIRE(updated             == 20000);
+        REQUIRE(stats->readTotal(g) == 8);
+      }
+    }
+  }
+}
+
+SCENARIO("Latency histograms report percentiles", "[statskeeper]")
+{
+  GIVEN("A histogram with the values 1 to 1000 recorded")
+  {
+    kisscpp::StatsKeeper      *stats     = kisscpp::StatsKeeper::instance();
+    kisscpp::LatencyHistogram *histogram = stats->registerHistogram("test-latency");
+
+    for(uint64_t i = 1; i <= 1000; ++i) {
+      histogram->record(i);
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("The stats are read") {
+      kisscpp::SharedStatsMapType current = stats->getCurrentStats();
+
+      THEN("The percentiles are within the bucket precision") {
+        REQUIRE((*current)["stats.test-latency.count"] == 1000);
+        REQUIRE((*current)["stats.test-latency.max"  ] == 1000);
+        REQUIRE((*current)["stats.test-latency.p50"  ] >= 500);
+        REQUIRE((*current)["stats.test-latency.p50"  ] <= 500 * 1.0625);
+        REQUIRE((*current)["stats.test-latency.p99"  ] >= 990);
+        REQUIRE((*current)["stats.test-latency.p999" ] <= 1000);
+      }
+    }
+  }
+}
+
+SCENARIO("Totals of pre-forked workers add up", "[statskeeper]")
+{
+  GIVEN("The totals of two workers")
+  {
+    kisscpp::StatsMapType first;
+    kisscpp::StatsMapType second;
+    kisscpp::StatsMapType sum;
+    kisscpp::StatsMapType stats;
+
+    first ["counter:test-sent"          ] = 10;
+    first ["seconds:test-latency.count" ] = 4;
+    first ["seconds:test-latency.max"   ] = 900;
+    second["counter:test-sent"          ] = 5;
+    second["seconds:test-latency.count" ] = 6;
+    second["seconds:test-latency.max"   ] = 300;
+
+    //--------------------------------------------------------------------------------
+    WHEN("They are added up") {
+      kisscpp::StatsKeeper::addTotals    (sum, first);
+      kisscpp::StatsKeeper::addTotals    (sum, second);
+      kisscpp::StatsKeeper::totalsToStats(sum, stats);
+
+      THEN("Counts add up, and the maximum is the largest") {
+        REQUIRE(stats["stats.test-sent"         ] == 15);
+        REQUIRE(stats["stats.test-latency.count"] == 10);
+        REQUIRE(stats["stats.test-latency.max"  ] == 900);
+      }
+    }
+
+    //--------------------------------------------------------------------------------
+    WHEN("They are exposed to OpenMetrics") {
+      std::string out;
+
+      kisscpp::StatsKeeper::writeOpenMetrics(out, first);
+
+      THEN("They keep their types") {
+        REQUIRE(out.find("# TYPE test_sent counter\ntest_sent_total 10\n"                    ) != std::string::npos);
+        REQUIRE(out.find("# TYPE test_latency_seconds summary\n"                              ) != std::string::npos);
+        REQUIRE(out.find("test_latency_seconds_count 4\ntest_latency_seconds_sum 0\n"        ) != std::string::npos);
+        REQUIRE(out.find("quantile"                                                           ) == std::string::npos);
+      }
+    }
+  }
+}
+
+SCENARIO("Stats history keeps the newest values", "[statskeeper]")
+{
+  GIVEN("A history of three values")
+  {
+    kisscpp::StatsRing ring(3);
+
+    //--------------------------------------------------------------------------------
+    WHEN("Five values are pushed") {
+      for(int i = 1; i <= 5; ++i) {
+        ring.push(i);
+      }
+
+      THEN("Only the last three are kept, newest first") {
+        REQUIRE(ring.size() == 3);
+        REQUIRE(ring[0]     == 5);
+        REQUIRE(ring[2]     == 3);
+      }
+    }
+  }
+}
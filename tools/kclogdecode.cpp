@@ -0,0 +1,150 @@
+// File  : kclogdecode.cpp
+// Author: Dirk J. Botha <bothadj@gmail.com>
+//
+// This file is part of kisscpp library.
+//
+// The kisscpp library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// The kisscpp library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with the kisscpp library. If not, see <http://www.gnu.org/licenses/>.
+
+
+// Prints a binary kisscpp log as text, or as JSON (one object per line).
+//
+//   kclogdecode [-j] [file ...]
+//
+// Reads standard input when no file is given.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include "kisscpp/binary_log.hpp"
+
+namespace
+{
+  //--------------------------------------------------------------------------------
+  std::string jsonString(const std::string &s)
+  {
+    std::string out = "\"";
+
+    for(std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
+      switch(*it) {
+        case '"' : out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n";  break;
+        case '\r': out += "\\r";  break;
+        case '\t': out += "\\t";  break;
+        default  :
+          if(static_cast<unsigned char>(*it) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(*it));
+            out += code;
+          } else {
+            out += *it;
+          }
+      }
+    }
+
+    return out + "\"";
+  }
+
+  //--------------------------------------------------------------------------------
+  void printText(const kisscpp::BinaryLogEntry &entry)
+  {
+    std::cout << kisscpp::BinaryLog::formatTime(entry.time) << " [" << entry.source << "] "
+              << ((entry.formatted) ? ": " : "") << entry.message << '\n';
+  }
+
+  //--------------------------------------------------------------------------------
+  void printJson(const kisscpp::BinaryLogEntry &entry)
+  {
+    std::cout << "{\"time\":"    << jsonString(kisscpp::BinaryLog::formatTime(entry.time))
+              << ",\"pid\":"     << entry.pid
+              << ",\"level\":"   << entry.level
+              << ",\"source\":"  << jsonString(entry.source)
+              << ",\"message\":" << jsonString(entry.message);
+
+    if(entry.formatted) {
+      std::cout << ",\"format\":" << jsonString(entry.format) << ",\"args\":[";
+
+      for(std::size_t i = 0; i < entry.args.size(); ++i) {
+        const kisscpp::BinaryLogArg &arg = entry.args[i];
+
+        std::cout << ((i > 0) ? "," : "")
+                  << ((arg.type == kisscpp::BLA_STRING) ? jsonString(arg.s) : arg.toString());
+      }
+
+      std::cout << "]";
+    }
+
+    std::cout << "}\n";
+  }
+
+  //--------------------------------------------------------------------------------
+  void decode(std::istream &in, const std::string &name, bool json)
+  {
+    kisscpp::BinaryLogReader reader(in);
+    kisscpp::BinaryLogEntry  entry;
+
+    try {
+      while(reader.next(entry)) {
+        if(json) {
+          printJson(entry);
+        } else {
+          printText(entry);
+        }
+      }
+    } catch(std::runtime_error &e) {
+      throw std::runtime_error(name + ": " + e.what());
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  bool json  = false;
+  int  files = 0;
+
+  try {
+    for(int i = 1; i < argc; ++i) {
+      if(std::strcmp(argv[i], "-j") == 0) {
+        json = true;
+      } else if(std::strcmp(argv[i], "-h") == 0) {
+        std::cout << "Usage: " << argv[0] << " [-j] [file ...]" << std::endl
+                  << "  -j  print JSON, one object per log line" << std::endl;
+        return 0;
+      } else {
+        std::ifstream in(argv[i], std::ios::in | std::ios::binary);
+
+        if(!in) {
+          throw std::runtime_error(std::string(argv[i]) + ": can not be opened.");
+        }
+
+        decode(in, argv[i], json);
+        ++files;
+      }
+    }
+
+    if(files == 0) {
+      decode(std::cin, "<stdin>", json);
+    }
+  } catch(std::runtime_error &e) {
+    std::cout << std::flush;
+    std::cerr << argv[0] << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}